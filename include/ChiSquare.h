@@ -0,0 +1,88 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHISQUARE_H
+#define CHISQUARE_H 1
+
+#include <vector>
+
+#include <Math/IFunction.h>
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "FitFunction.h"
+
+using std::vector;
+
+// Number of bins whose contributions to the chi-square are summed up by a single task
+const UInt_t CHISQUARE_BLOCK_SIZE = 2048;
+
+// Chi-square of the response to a set of parameters with respect to a spectrum.
+//
+// The model is linear in the parameters, prediction = R^T p, which means that the exact gradient
+// 
+// 	d chi^2 / d p = 2 R W (R^T p - spectrum)
+//
+// (W is the diagonal matrix of the inverse squared uncertainties of the spectrum) costs only one more
+// pass over the response matrix. Value and gradient are calculated together, so that the minimizer
+// does not need to estimate the gradient numerically.
+//
+// Only the parameters in the active range [firstBin(), stopBin()) are variables of the minimizer,
+// where [firstBin(), stopBin()) is [binstart, binstop) restricted to the range of the FitFunction.
+// Variable k corresponds to bin firstBin() + k of the spectrum and the response matrix, all other
+// parameters are zero. This way, the cost of an evaluation scales with the width of the active
+// range and not with the total number of bins.
+// The chi-square is evaluated for the same bins of the spectrum, ignoring bins with zero content
+// like TH1::Fit() does.
+class ChiSquare : public ROOT::Math::IGradientFunctionMultiDim{
+public:
+	ChiSquare(const FitFunction &fitfunction, const TH1F &spectrum, const Int_t binstart, const Int_t binstop);
+	~ChiSquare(){};
+
+	ChiSquare* Clone() const override { return new ChiSquare(*this); };
+	unsigned int NDim() const override { return n_dim; };
+
+	Int_t firstBin() const { return first_bin; };
+	Int_t stopBin() const { return stop_bin; };
+
+	void Gradient(const double *x, double *gradient) const override;
+	void FdF(const double *x, double &value, double *gradient) const override;
+
+	// Diagonal of the Hessian matrix d^2 chi^2 / dp_k^2, which does not depend on the parameters.
+	void HessianDiagonal(double *diagonal) const;
+
+private:
+	double DoEval(const double *x) const override;
+	double DoDerivative(const double *x, unsigned int icoord) const override;
+
+	Double_t evaluate(const double *x, double *gradient) const;
+
+	const FitFunction *fitFunction;
+	Int_t first_bin;
+	Int_t stop_bin;
+	UInt_t n_dim;
+	vector<Double_t> data;
+	vector<Double_t> weight;
+
+	// Buffers, indexed by the bin number
+	mutable vector<Double_t> parameters;
+	mutable vector<Double_t> residual;
+	mutable vector<Double_t> gradient_bins;
+	mutable vector<Double_t> partial_chi2;
+};
+
+#endif
@@ -0,0 +1,82 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef CHOLESKY_H
+#define CHOLESKY_H 1
+
+#include <vector>
+
+#include <TROOT.h>
+
+#include "NormalEquations.h"
+
+using std::vector;
+
+// Number of rows of a block of Cholesky::appendAll()
+const UInt_t CHOLESKY_BLOCK_SIZE = 64;
+
+// Cholesky factorization G_PP = L L^T of the principal submatrix of the normal matrix G
+// which belongs to a set P of (local) parameter indices.
+//
+// Indices can be appended one at a time at the cost of a single forward substitution,
+// which is what active-set methods need when a parameter is released from its bound.
+// L is stored packed row by row, in the order in which the indices were added.
+//
+// Many indices at once are appended by appendAll(), which gives the same factor as a sequence of
+// append() calls, but splits the work among the threads of the ThreadPool: the rows of a block of
+// CHOLESKY_BLOCK_SIZE new indices are independent of each other left of the block, and only the
+// triangle of the block itself is computed sequentially. The inverse is split among the threads in
+// the same way, so that the covariance matrix of a fit can be calculated directly.
+class Cholesky{
+public:
+	Cholesky(const NormalEquations &normal_eq): normal_equations(normal_eq){};
+	~Cholesky(){};
+
+	void clear(){ indices.clear(); L.clear(); };
+	Bool_t factorize(const vector<UInt_t> &index_set);
+	// Returns false and leaves the factorization unchanged if G_PP would not be positive definite any more.
+	Bool_t append(const UInt_t index);
+	// Append the indices in the given order, skipping those for which append() would return false.
+	void appendAll(const vector<UInt_t> &index_set);
+	// Remove an index from P by a rank-1 update of the trailing part of the factor.
+	void remove(const UInt_t index);
+
+	UInt_t size() const { return (UInt_t) indices.size(); };
+	const vector<UInt_t>& getIndices() const { return indices; };
+
+	// Solve G_PP x_P = rhs_P. rhs and x are indexed like G, entries of x outside of P are not touched.
+	void solve(const vector<Double_t> &rhs, vector<Double_t> &x) const;
+	// Diagonal of (G_PP)^-1, in the order of getIndices()
+	void inverseDiagonal(vector<Double_t> &diagonal) const;
+	// Dense (G_PP)^-1, row-major, in the order of getIndices()
+	void inverse(vector<Double_t> &inverse_matrix) const;
+	// Dense correlation matrix (indexed like G) which belongs to (G_PP)^-1. Indices outside of P are uncorrelated.
+	void correlations(vector<Double_t> &correlation) const;
+
+private:
+	Double_t& element(const UInt_t r, const UInt_t c){ return L[(size_t) r*(r + 1)/2 + c]; };
+	Double_t element(const UInt_t r, const UInt_t c) const { return L[(size_t) r*(r + 1)/2 + c]; };
+	void invertFactor(vector<Double_t> &L_inverse) const;
+	// Append a row whose elements in the columns of the first n_left indices are already known
+	Bool_t appendRow(const UInt_t index, const Double_t *left, const UInt_t n_left);
+
+	const NormalEquations &normal_equations;
+	vector<UInt_t> indices;
+	vector<Double_t> L;
+};
+
+#endif
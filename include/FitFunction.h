@@ -18,41 +18,59 @@
 #ifndef FITFUNCTION_H
 #define FITFUNCTION_H 1
 
-#include <TH2.h>
+#include <vector>
 
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "ResponseMatrix.h"
+
+using std::vector;
+
+// The FitFunction does not copy the response matrix, it only refers to it. The matrix has to
+// outlive the FitFunction, or has to be replaced by setResponseMatrix() before the next evaluation.
 class FitFunction{
 	public:
-		FitFunction(const TString name, const TH2F &rema, const UInt_t binning, Int_t binstart, Int_t binstop): 
-			response_matrix(TH2F(name, name, rema.GetNbinsX(), rema.GetXaxis()->GetXmin(), rema.GetXaxis()->GetXmax(), rema.GetNbinsY(), rema.GetYaxis()->GetXmin(), rema.GetYaxis()->GetXmax())),
-			BINNING(binning),
-			inverse_BINNING(1./binning),
+		FitFunction(const ResponseMatrix &rema, Int_t binstart, Int_t binstop): 
+			response_matrix(&rema),
 			bin_start(binstart),
-			bin_stop(binstop)
-	{
-		for(Int_t i = 1; i <= rema.GetNbinsX(); ++i){
-			for(Int_t j = 1; j <= rema.GetNbinsX(); ++j){
-				response_matrix.SetBinContent(i, j, rema.GetBinContent(i, j));
-			}
-		}
-	};
+			bin_stop(binstop),
+			cache_valid(false)
+	{};
 		~FitFunction(){};
-		Double_t operator()(Double_t *x, Double_t *p);
-		Double_t getSimulationStatisticalUncertainty(const Int_t bin, const TH1F &params);
-		Double_t getSpectrumStatisticalUncertainty(const Int_t bin, const TH1F &params, const TH1F &spectrum);
-		void setResponseMatrix(const TH2F &rema){
-			for(Int_t i = 1; i <= rema.GetNbinsX(); ++i){
-				for(Int_t j = 1; j <= rema.GetNbinsX(); ++j){
-					response_matrix.SetBinContent(i, j, rema.GetBinContent(i, j));
-				}
-			}
+		// The cache is invalidated even if rema is the same object, because its elements may have
+		// been changed in the meantime, like those of a fluctuated matrix in the Monte-Carlo loop.
+		void setResponseMatrix(const ResponseMatrix &rema){
+			response_matrix = &rema;
+			cache_valid = false;
 		};
 
+		// Evaluate the response for all bins j in [firstBin(), lastBin()] in a single pass:
+		// prediction[j] = sum_{i = j}^{lastBin()} p[i]*R(i, j)
+		// Both arrays are indexed by the bin number.
+		void forward(const Double_t *p, Double_t *prediction) const;
+		// Same as forward(), but the result is cached together with the parameters.
+		// Calls with the same parameters, like the evaluation of the chi^2 and its gradient at the
+		// same point, return the cached prediction.
+		const vector<Double_t>& predict(const Double_t *p) const;
+		// Adjoint of forward() for all bins i in [firstBin(), lastBin()]:
+		// gradient[i] = sum_{j = firstBin()}^{i} R(i, j)*residual[j]
+		void adjoint(const Double_t *residual, Double_t *gradient) const;
+		// Adjoint of forward() with the squared matrix elements for all bins i in [firstBin(), lastBin()]:
+		// result[i] = sum_{j = firstBin()}^{i} R(i, j)^2*weight[j]
+		void adjointSquared(const Double_t *weight, Double_t *result) const;
+
+		Int_t firstBin() const;
+		Int_t lastBin() const;
+
 	private:
-		TH2F response_matrix;
-		const UInt_t BINNING;
-		const Double_t inverse_BINNING;
+		const ResponseMatrix *response_matrix;
 		const Int_t bin_start;
 		const Int_t bin_stop;
+
+		mutable vector<Double_t> cached_parameters;
+		mutable vector<Double_t> cached_prediction;
+		mutable Bool_t cache_valid;
 };
 
 #endif
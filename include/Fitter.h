@@ -18,37 +18,77 @@
 #ifndef FITTER_H
 #define FITTER_H 1
 
+#include <functional>
 #include <vector>
 
 using std::vector;
 
-#include <TF1.h>
+#include <Math/Minimizer.h>
 #include <TH1.h>
-#include <TH2.h>
 #include <TMatrixDSym.h>
 #include <TROOT.h>
 
+#include "ChiSquare.h"
 #include "FitFunction.h"
+#include "NormalEquations.h"
+#include "ResponseMatrix.h"
 
+// Number of bins of a block of the back substitution in the TopDown algorithm
+const Int_t TOPDOWN_BLOCK_SIZE = 256;
+
+// Algorithm which is used to minimize the chi^2 of the fit
+// minuit: Minuit2 (Migrad) with box constraints on all parameters
+// nnls  : Lawson-Hanson active-set method for the non-negative least-squares problem
+// lbfgs : Limited-memory quasi-Newton method with bounds, which needs only products with the
+//         response matrix and memory linear in the number of bins
+enum class FitSolver { minuit, nnls, lbfgs };
+
+// Method which is used to unfold the spectrum after the TopDown algorithm
+// fit : minimization of the chi^2 with one of the FitSolvers
+// mlem: maximum-likelihood expectation maximization for Poisson-distributed spectra
+enum class UnfoldingMethod { fit, mlem };
+
+// The Fitter refers to the response matrix instead of copying it (see FitFunction), so rema has to
+// outlive the Fitter. fit() switches to the matrix that is passed to it.
 class Fitter{
 public:
-	Fitter(const TH2F &rema, const UInt_t binning, Int_t binstart, Int_t binstop):BINNING(binning), fitFunction("rema_fit", rema, binning, binstart, binstop), chi2(-1.){ fitf = new TF1("fitf", fitFunction, 0., (Double_t) NBINS-1., (Int_t) NBINS/ (Int_t) BINNING); };
-	~Fitter(){};
-
-	void topdown(const TH1F &spectrum, const TH2F &rema, TH1F &params, Int_t binstart, Int_t binstop);
-	void topdown(const TH1F &spectrum, const TH2F &rema, TH1F &params, Int_t binstart, Int_t binstop, TH2F &topdown_steps);
-	void fit(TH1F &spectrum, const TH2F &rema, const TH1F &start_params, TH1F &params, Int_t binstart, Int_t binstop); // Version of Fitter::fit() which does not return uncertainty and does not print output
-	void fit(TH1F &spectrum, const TH2F &rema, const TH1F &start_params, TH1F &params, TH1F &fit_uncertainty, Int_t binstart, Int_t binstop, const Bool_t verbose, const Bool_t correlation, TMatrixDSym &correlation_matrix);
-	void fittedFEP(const TH1F &params, const TH2F &rema, TH1F &fitted_FEP);
-	void fittedSpectrum(const TH1F &params, const TH2F &rema, TH1F &fitted_spectrum);
+	Fitter(const ResponseMatrix &rema, const UInt_t binning, Int_t binstart, Int_t binstop, const FitSolver fit_solver = FitSolver::minuit, const UnfoldingMethod unfolding_method = UnfoldingMethod::fit, const UInt_t n_iterations = 100);
+	~Fitter();
+
+	void topdown(const TH1F &spectrum, const ResponseMatrix &rema, TH1F &params, Int_t binstart, Int_t binstop);
+	// Version of Fitter::topdown() which calls 'step' after the parameter of each bin has been
+	// determined, with the spectrum that remains after subtracting the responses of all bins
+	// from the highest one down to 'bin'. The remaining spectrum is indexed by the bin number.
+	void topdown(const TH1F &spectrum, const ResponseMatrix &rema, TH1F &params, Int_t binstart, Int_t binstop, const std::function<void(const Int_t bin, const vector<Double_t> &remaining_spectrum)> &step);
+	void fit(TH1F &spectrum, const ResponseMatrix &rema, const TH1F &start_params, TH1F &params, Int_t binstart, Int_t binstop); // Version of Fitter::fit() which does not return uncertainty and does not print output
+	void fit(TH1F &spectrum, const ResponseMatrix &rema, const TH1F &start_params, TH1F &params, TH1F &fit_uncertainty, Int_t binstart, Int_t binstop, const Bool_t verbose, const Bool_t correlation, TMatrixDSym &correlation_matrix);
+	void fittedFEP(const TH1F &params, const ResponseMatrix &rema, TH1F &fitted_FEP);
+	void fittedSpectrum(const TH1F &params, const ResponseMatrix &rema, TH1F &fitted_spectrum);
 	void remove_negative(TH1F &hist);
 	void print_fitresult() const;
 
 private:
+	void backSubstitution(const ResponseMatrix &rema, vector<Double_t> &remaining_spectrum, vector<Double_t> &parameters, const Int_t first_bin, const Int_t last_bin) const;
+	void minimize(const TH1F &spectrum, const TH1F &start_params, Int_t binstart, Int_t binstop, const Bool_t verbose);
+	void minimizeLBFGS(const TH1F &spectrum, const TH1F &start_params, Int_t binstart, Int_t binstop, const Bool_t verbose, vector<Double_t> &x);
+	void startValues(const TH1F &start_params, vector<Double_t> &x, vector<Double_t> &upper) const;
+	// Correlations of the fit parameters params from the normal equations. Parameters are at the bound
+	// if they are not positive, so params must not be a Minuit result (see Fitter::fit()).
+	void analyticCorrelations(const NormalEquations &normal_equations, const TH1F &params, TMatrixDSym &correlation_matrix) const;
+	void setActiveParameters(const Double_t *x, const Int_t first_bin, const UInt_t n, TH1F &hist) const;
+	void setCorrelationMatrix(const vector<Double_t> &correlations, const Int_t first_bin, const UInt_t n, TMatrixDSym &correlation_matrix) const;
+	void nnlsStartValues(const NormalEquations &normal_equations, const TH1F &start_params, vector<Double_t> &x);
+	void unfoldMLEM(const TH1F &spectrum, const ResponseMatrix &rema, const TH1F &start_params, Int_t binstart, Int_t binstop, const Bool_t verbose, TH1F &params, TH1F *fit_uncertainty, TMatrixDSym *correlation_matrix);
+	void evaluateChiSquare(const TH1F &spectrum, const vector<Double_t> &x, Int_t binstart, Int_t binstop);
+
 	const UInt_t BINNING;
+	const FitSolver solver;
+	const UnfoldingMethod method;
+	const UInt_t mlem_iterations;
 	FitFunction fitFunction;
 	Double_t chi2;
-	TF1 *fitf;
+	ROOT::Math::Minimizer *minimizer;
+	ChiSquare *chiSquare; // Minuit2 does not copy the function, so it has to be kept alive as long as the minimizer is used.
 };
 
 #endif
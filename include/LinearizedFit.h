@@ -0,0 +1,86 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef LINEARIZEDFIT_H
+#define LINEARIZEDFIT_H 1
+
+#include <vector>
+
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "Cholesky.h"
+#include "NormalEquations.h"
+#include "ResponseMatrix.h"
+
+using std::vector;
+
+// Linearization of the fit of a spectrum around its solution p0, for the Monte-Carlo uncertainty
+// estimation with a fixed response matrix.
+//
+// As long as the same parameters are at their lower bound of zero, the solution for a fluctuated
+// spectrum s' is the solution of the normal equations of the free parameters F,
+//
+// 	G_FF p_F = (R W s')_F,
+//
+// where G = R W R^T and the weights W are those of the original spectrum. G_FF is factorized once
+// in the constructor, so that each fluctuated spectrum costs one adjoint product with the response
+// matrix and two triangular solves instead of a full fit.
+// If the linear solution is not valid, because a free parameter would become negative or a parameter
+// at its bound would be released, the same problem with the weights of the original spectrum is solved
+// with the NNLS solver, starting from p0, and solve() returns false. This way, all fluctuated spectra
+// are fitted with the same weights.
+//
+// The set of parameters at the bound is taken from the solution of the active-set NNLS solver for
+// the original spectrum, which starts from p0. A fit with Minuit2 leaves parameters at the bound
+// slightly positive, because of the transformation of bounded parameters, while the NNLS solution
+// is exactly zero there.
+//
+// Parameters whose column of G cannot be added to the factorization, e.g. because they do not
+// contribute to any bin with content, are kept at their value in p0.
+// solve() does not change the object, so it can be called by several threads at the same time.
+class LinearizedFit{
+public:
+	LinearizedFit(const ResponseMatrix &rema, const TH1F &spectrum, const TH1F &params, const Int_t binstart, const Int_t binstop);
+	~LinearizedFit(){};
+
+	Bool_t solve(const TH1F &fluctuated_spectrum, TH1F &params) const;
+
+	UInt_t getNFree() const { return cholesky.size(); };
+
+private:
+	LinearizedFit(const LinearizedFit&) = delete; // cholesky refers to normal_equations
+	LinearizedFit& operator=(const LinearizedFit&) = delete;
+
+	const ResponseMatrix &response_matrix;
+	NormalEquations normal_equations;
+	Cholesky cholesky;
+	Int_t first_bin;
+	Int_t last_bin;
+
+	// Indexed by the local index of the normal equations
+	vector<Double_t> fixed_parameters; // Values of the parameters which are not free, zero for free ones
+	vector<Double_t> fixed_contribution; // G p_fixed
+	vector<Bool_t> at_bound;
+	vector<Double_t> start_parameters; // NNLS solution for the original spectrum
+
+	// Indexed by the bin number
+	vector<Double_t> weight;
+};
+
+#endif
@@ -0,0 +1,73 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MLEM_H
+#define MLEM_H 1
+
+#include <vector>
+
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "ResponseMatrix.h"
+
+using std::vector;
+
+// Maximum-likelihood expectation-maximization (MLEM) unfolding, also known as Richardson-Lucy
+// deconvolution, for a spectrum whose bin contents are Poisson distributed.
+//
+// Each iteration multiplies the parameters by the back projection of the ratio of measured and
+// predicted spectrum:
+//
+// 	p_i <- p_i / epsilon_i * sum_j R(i, j) s_j / (R^T p)_j,	epsilon_i = sum_j R(i, j),
+//
+// which increases the Poisson likelihood and keeps the parameters non-negative. One iteration costs a
+// forward (R^T p) and an adjoint (R r) product with the response matrix, which are split among the
+// threads of the ThreadPool (see TriangularKernels).
+//
+// Parameters and spectrum bins in [binstart, binstop) are used. Arrays are indexed by the bin number.
+class MLEM{
+public:
+	MLEM(const ResponseMatrix &rema, const TH1F &spectrum, const Int_t binstart, const Int_t binstop);
+	~MLEM(){};
+
+	// p contains the start values on input and the result on output.
+	// Parameters which are not positive at the start would stay zero forever. They are replaced by the
+	// value of a flat spectrum that reproduces the total number of counts.
+	void unfold(vector<Double_t> &p, const UInt_t n_iterations);
+
+	// prediction[j] = sum_i p[i]*R(i, j)
+	void forward(const vector<Double_t> &p, vector<Double_t> &prediction) const;
+	// result[i] = sum_j R(i, j)*r[j]
+	void adjoint(const vector<Double_t> &r, vector<Double_t> &result) const;
+	// Diagonal of the Fisher information matrix of the Poisson likelihood for a given prediction,
+	// F_ii = sum_j R(i, j)^2/prediction[j]
+	void fisherDiagonal(const vector<Double_t> &prediction, vector<Double_t> &diagonal) const;
+
+	Int_t firstBin() const { return first_bin; };
+	Int_t stopBin() const { return stop_bin; };
+
+private:
+	const ResponseMatrix &response_matrix;
+	Int_t first_bin;
+	Int_t stop_bin;
+	vector<Double_t> data;
+	vector<Double_t> sensitivity;
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MERGINGDIGEST_H
+#define MERGINGDIGEST_H 1
+
+#include <vector>
+
+#include <TROOT.h>
+
+using std::vector;
+
+// Default compression of a MergingDigest, which is about the number of centroids that are kept
+const Double_t MERGINGDIGEST_COMPRESSION = 100.;
+
+// Streaming estimate of the quantiles of a sequence of samples with a t-digest
+// (T. Dunning and O. Ertl, "Computing extremely accurate quantiles using t-digests", 2019).
+//
+// The distribution of the samples is approximated by a sorted list of centroids, i.e. of groups of
+// neighbouring samples which are represented by their mean and weight. Close to the tails, the
+// centroids are small, so that extreme quantiles are accurate. The size of the centroids is
+// limited by the scale function k(q) = compression/(2 pi) asin(2q - 1): a centroid may only cover
+// an interval of quantiles with k(q_right) - k(q_left) <= 1. New samples are collected in a buffer,
+// which is merged with the centroids when it is full, so the memory does not depend on the number
+// of samples.
+//
+// Digests of disjoint sets of samples can be merged. The result depends on the order of the
+// samples, so samples should be added in a fixed order.
+class MergingDigest{
+public:
+	MergingDigest(const Double_t compression = MERGINGDIGEST_COMPRESSION);
+	~MergingDigest(){};
+
+	void add(const Double_t x, const Double_t weight = 1.);
+	void merge(const MergingDigest &other);
+
+	// Estimate of the q-quantile (0 <= q <= 1). Returns zero if there are no samples.
+	Double_t quantile(const Double_t q) const;
+	Double_t getWeight() const { return total_weight; };
+
+	// Append the state of the digest to 'state', or restore it from 'state', starting at 'position'.
+	// restoreState() returns the position after the digest.
+	void appendState(vector<Double_t> &state) const;
+	size_t restoreState(const vector<Double_t> &state, size_t position);
+
+private:
+	struct Centroid{
+		Double_t mean;
+		Double_t weight;
+	};
+
+	void compress();
+	Double_t sortedQuantile(const Double_t q) const;
+
+	Double_t compression;
+	Double_t total_weight;
+	Double_t minimum;
+	Double_t maximum;
+	vector<Centroid> centroids;
+	vector<Centroid> buffer;
+};
+
+#endif
@@ -0,0 +1,63 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef MONTECARLOCHECKPOINT_H
+#define MONTECARLOCHECKPOINT_H 1
+
+#include <string>
+#include <vector>
+
+#include <TROOT.h>
+
+#include "RunningCovariance.h"
+#include "RunningStatistics.h"
+
+using std::string;
+using std::vector;
+
+// Checkpoint file of a Monte-Carlo uncertainty estimate, from which an interrupted run can be
+// resumed.
+//
+// The statistics of the MC iterations are accumulated in the order of the iterations, and the
+// random numbers of an iteration depend only on the seed and the iteration index. Therefore, the
+// state of the accumulated statistics, whose number of samples is the number of completed
+// iterations, is all that is needed to continue a run. If the covariance of the MC iterations is
+// accumulated, its state is stored as well.
+// Together with the statistics, the parameters of the run are stored, which must be the same when
+// the run is resumed.
+//
+// A checkpoint is first written to a temporary file, which is then renamed, so that an
+// interruption while writing leaves the previous checkpoint intact.
+class MonteCarloCheckpoint{
+public:
+	MonteCarloCheckpoint(const string &file_name, const vector<Double_t> &parameters): filename(file_name), run_parameters(parameters){};
+	~MonteCarloCheckpoint(){};
+
+	void write(const RunningStatistics &statistics, RunningCovariance *covariance = nullptr) const;
+	// Returns false if the checkpoint file does not exist. Aborts if the checkpoint belongs to a
+	// run with different parameters or bins. The covariance must not contain samples yet.
+	Bool_t read(RunningStatistics &statistics, RunningCovariance *covariance = nullptr) const;
+	void remove() const;
+
+	const string& getFilename() const { return filename; };
+
+private:
+	const string filename;
+	const vector<Double_t> run_parameters;
+};
+
+#endif
@@ -21,29 +21,109 @@
 #include <vector>
 
 #include <TH1.h>
-#include <TH2.h>
 #include <TROOT.h>
-#include <TRandom3.h>
+
+#include "PhiloxRandom.h"
+#include "ResponseMatrix.h"
+#include "RunningCovariance.h"
+#include "RunningStatistics.h"
+#include "SobolSequence.h"
 
 using std::vector;
 
+// Independent streams of random numbers within a Monte-Carlo iteration
+const UInt_t MC_SPECTRUM_STREAM = 0;
+const UInt_t MC_MATRIX_STREAM = 1;
+
+// Default mean above which the elements of the response matrix are sampled from a normal
+// distribution instead of a Poisson distribution
+const Double_t MC_NORMAL_THRESHOLD = 1000.;
+
+// Source of the uniform random numbers from which the fluctuations are sampled by inversion
+// random    : independent pseudo-random numbers
+// antithetic: iterations 2k and 2k + 1 use the uniform random numbers u and 1 - u, which makes
+//             their fluctuations negatively correlated. This reduces the variance of the mean,
+//             but not of the standard deviation, of quantities which depend almost linearly on the
+//             fluctuations.
+// sobol     : scrambled Sobol' points (see SobolSequence), indexed by the iteration, which
+//             stratify the fluctuations of each bin. Works best if the number of iterations is a
+//             power of 2.
+// With 'antithetic' and 'sobol', the iterations are not independent, so the uncertainty of
+// Monte-Carlo estimates which assumes independent iterations is too large.
+enum class MCSampling { random, antithetic, sobol };
+
+// Default minimum number of iterations before the convergence of the Monte-Carlo uncertainty is
+// checked
+const UInt_t MC_MIN_ITERATIONS = 100;
+
+// Histograms which summarize the Monte-Carlo iterations, see MonteCarloUncertainty::evaluateResults()
+struct MonteCarloResults{
+	TH1F mc_fit_params_mean, mc_fit_params_uncertainty, mc_fit_total_uncertainty;
+	TH1F mc_fit_params_min, mc_fit_params_max;
+	TH1F mc_fit_FEP, mc_fit_FEP_uncertainty;
+	TH1F mc_FEP_uncertainty_low, mc_FEP_uncertainty_up;
+	TH1F mc_spectrum_reconstructed, mc_reconstruction_uncertainty;
+	TH1F mc_reconstruction_uncertainty_low, mc_reconstruction_uncertainty_up;
+	vector<TH1F> mc_fit_params_percentiles, mc_fit_FEP_percentiles, mc_spectrum_reconstructed_percentiles;
+	vector<Double_t> mc_reconstruction_covariance; // Empty without the covariance of the iterations
+};
+
+// The random numbers for Monte-Carlo iteration k are taken from a counter-based generator with the
+// key (seed, k). Iteration k always produces the same fluctuated spectrum and response matrix,
+// independent of the order in which the iterations are processed and of the number of threads.
+// The class has no mutable state, so a single instance can be used by several threads.
+//
+// The elements of the response matrix are sampled column by column, each column with its own
+// substream of random numbers. Only the stored lower triangle is touched and zero elements are
+// skipped. Elements with a mean of at least normal_threshold are sampled from the normal
+// approximation N(mu, mu) of the Poisson distribution, rounded to an integer. The normal random
+// numbers of a column are drawn in a single call.
+//
+// With the sampling strategies 'antithetic' and 'sobol', all samples are obtained by inversion of
+// the cumulative distribution function, so that the correlation of the uniform random numbers is
+// carried over to the fluctuations.
 class MonteCarloUncertainty{
 public:
-	MonteCarloUncertainty(const UInt_t binning, const UInt_t seed): BINNING(binning) { random_generator = new TRandom3(seed); };
-	~MonteCarloUncertainty(){ delete random_generator; };
+	MonteCarloUncertainty(const UInt_t binning, const UInt_t seed, const Double_t normal_threshold = MC_NORMAL_THRESHOLD, const MCSampling sampling = MCSampling::random): BINNING(binning), SEED(seed), NORMAL_THRESHOLD(normal_threshold), SAMPLING(sampling) {};
+	~MonteCarloUncertainty(){};
 
-	void apply_fluctuations(TH1F &modified_spectrum, const TH1F &spectrum, const Int_t binstart, const Int_t binstop);
-	void apply_fluctuations(TH2F &modified_response_matrix, const TH2F &response_matrix, const Int_t binstart, const Int_t binstop);
-	void evaluateMeanAndStd(TH1F &mc_mean, TH1F &mc_standard_deviation, const vector<TH1F*> &mc_histograms, const Int_t binstart, const Int_t binstop);
+	void apply_fluctuations(TH1F &modified_spectrum, const TH1F &spectrum, const Int_t binstart, const Int_t binstop, const UInt_t iteration) const;
+	void apply_fluctuations(ResponseMatrix &modified_response_matrix, const ResponseMatrix &response_matrix, const Int_t binstart, const Int_t binstop, const UInt_t iteration) const;
+	void evaluateMeanAndStd(TH1F &mc_mean, TH1F &mc_standard_deviation, const RunningStatistics &mc_statistics) const;
+	void evaluateMinAndMax(TH1F &mc_min, TH1F &mc_max, const RunningStatistics &mc_statistics) const;
+	// Percentile (0 <= percentile <= 100) of the distribution of each bin. Requires that mc_statistics
+	// accumulates the quantiles.
+	void evaluatePercentile(TH1F &mc_percentile, const RunningStatistics &mc_statistics, const Double_t percentile) const;
+	// Covariance matrix of the fit parameters, multiplied by factor_i*factor_j for the bins i and j,
+	// e.g. with the numbers of simulated particles for the covariance of the reconstructed spectrum.
+	// mc_covariance contains the first and the last bin of mc_statistics, followed by the lower
+	// triangle of the symmetric matrix, packed row by row.
+	void evaluateCovariance(vector<Double_t> &mc_covariance, const RunningCovariance &mc_statistics, const TH1F &factors) const;
+	// Evaluation of the Monte-Carlo iterations, which is shared by horst and horst_merge. It only needs
+	// the diagonal of the response matrix, which gives the FEP as in Fitter::fittedFEP(), so that
+	// horst_merge does not have to read the response matrix. mc_covariance may be nullptr.
+	void evaluateResults(MonteCarloResults &results, const RunningStatistics &mc_statistics, const RunningCovariance *mc_covariance, const vector<Double_t> &percentiles, const TH1F &fit_algorithm_uncertainty, const TH1F &response_matrix_diagonal, const TH1F &n_simulated_particles) const;
+	// Total uncertainty of the fit parameters, including the Monte-Carlo uncertainty, and the
+	// corresponding uncertainty of the reconstructed spectrum
+	void evaluateTotalUncertainty(TH1F &fit_total_uncertainty, TH1F &reconstruction_uncertainty, const MonteCarloResults &results, const TH1F &fit_algorithm_uncertainty, const TH1F &fit_algorithm_FEP_uncertainty, const TH1F &fit_simulation_uncertainty, const TH1F &fit_spectrum_uncertainty, const TH1F &response_matrix_diagonal, const TH1F &n_simulated_particles) const;
+	// Name of the histogram of a percentile, e.g. 'mc_fit_params_p16' or 'mc_fit_params_p2_5'
+	TString getPercentileName(const TString &name, const Double_t percentile) const;
+	// Largest relative standard error of the standard deviation among all bins with a nonzero
+	// standard deviation
+	Double_t evaluatePrecision(const RunningStatistics &mc_statistics) const;
 
 private:
-	Double_t get_positive_random_normal(Double_t mu, Double_t sigma) const;	
-	Double_t get_random_poisson(Int_t mean) const;	
-	Double_t get_mean(vector<Double_t> &values) const;
-	Double_t get_stdev(vector<Double_t> &values, Double_t mean) const;
+	// Key of the random numbers of an iteration. Antithetic pairs of iterations share a key.
+	UInt_t get_key(const UInt_t iteration) const { return SAMPLING == MCSampling::antithetic ? iteration - iteration % 2 : iteration; };
+	Double_t get_uniform(PhiloxRandom &random_generator, const SobolSequence &sobol, const UInt_t iteration, const UInt_t dimension) const;
+	Double_t get_positive_random_normal(const Double_t uniform, Double_t mu, Double_t sigma) const;
+	Double_t get_random_poisson(PhiloxRandom &random_generator, Int_t mean) const;
+	Double_t get_poisson_quantile(const Double_t uniform, const Double_t mean) const;
 
-	TRandom3 *random_generator;
 	const UInt_t BINNING;
+	const UInt_t SEED;
+	const Double_t NORMAL_THRESHOLD; // A value of zero or less disables the normal approximation
+	const MCSampling SAMPLING;
 };
 
 #endif
@@ -0,0 +1,91 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MONTECARLOWRITER_H
+#define MONTECARLOWRITER_H 1
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <TROOT.h>
+
+using std::condition_variable;
+using std::mutex;
+using std::string;
+using std::thread;
+using std::vector;
+
+// Number of histograms which can wait in the queue of a MonteCarloWriter
+const UInt_t MC_WRITER_QUEUE_LENGTH = 64;
+
+// Writes the histograms of the Monte-Carlo iterations to the output file in a separate thread.
+//
+// The output file is opened once and stays open until close() is called. write() copies the
+// bin contents of a histogram, including the underflow and overflow bins, into a bounded queue and
+// returns immediately, unless the queue is full.
+// The writer thread takes the histograms from the queue and writes them into one of the
+// directories given to the constructor. Every 'flush_interval' histograms, the directory
+// structure is saved and the file is flushed, so that the output written so far can be read
+// even if the program is interrupted.
+//
+// As long as the writer is open, no other thread may use the output file.
+class MonteCarloWriter{
+public:
+	MonteCarloWriter(const char* filename, const vector<string> &directories, const Int_t nbins, const Double_t max_bin, const UInt_t flush_interval);
+	~MonteCarloWriter();
+
+	// Queue the bin contents 0 to nbins + 1 of a histogram to be written to directory number
+	// 'directory' under 'name'
+	void write(const UInt_t directory, const vector<Double_t> &content, const string &name);
+	// Wait until all queued histograms have been written and the file has been saved
+	void flush();
+	// Write all queued histograms and close the output file
+	void close();
+
+private:
+	struct Entry{
+		UInt_t directory;
+		string name;
+		vector<Double_t> content;
+	};
+
+	void run();
+
+	const string filename;
+	const vector<string> directory_names;
+	const Int_t n_bins;
+	const Double_t max_bin;
+	const UInt_t flush_interval;
+
+	vector<Entry> queue;
+	UInt_t queue_begin;
+	UInt_t queue_size;
+	Bool_t stop;
+	Bool_t flush_requested;
+
+	mutex queue_mutex;
+	condition_variable queue_not_full;
+	condition_variable queue_not_empty;
+	condition_variable flushed;
+	thread writer;
+};
+
+#endif
@@ -0,0 +1,69 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NNLSSOLVER_H
+#define NNLSSOLVER_H 1
+
+#include <vector>
+
+#include <TROOT.h>
+
+#include "Cholesky.h"
+#include "NormalEquations.h"
+
+using std::vector;
+
+// Active-set algorithm of Lawson and Hanson for the non-negative least-squares problem
+//
+// 	min_p chi^2(p) subject to p >= 0,
+//
+// formulated on the normal equations G p = h (see NormalEquations).
+// Variables are split into a passive set P, which is solved for exactly with a Cholesky
+// factorization of G_PP, and an active set which is held at zero.
+// The solver can be started from an approximate solution (e.g. the TopDown result): all
+// parameters which are positive there start in the passive set, which usually leaves only
+// a few iterations to do.
+class NNLSSolver{
+public:
+	NNLSSolver(const NormalEquations &normal_eq): normal_equations(normal_eq), cholesky(normal_eq), n_iterations(0){};
+	~NNLSSolver(){};
+
+	// x contains the start values (indexed like G) on input and the solution on output.
+	void solve(vector<Double_t> &x);
+	// Same as solve(x), but with the right-hand side rhs instead of h, e.g. for a different
+	// spectrum with the same weights.
+	void solve(const vector<Double_t> &rhs, vector<Double_t> &x);
+
+	// Parabolic uncertainties of the solution, i.e. the square roots of the diagonal of G_PP^-1 for
+	// parameters in the passive set. For parameters at the bound, 1/sqrt(G_ii) is returned, which is
+	// the uncertainty if the parameter is varied alone.
+	void uncertainties(vector<Double_t> &uncertainty) const;
+	// Correlation matrix (indexed like G) of the parameters in the passive set.
+	// Parameters at the bound are uncorrelated.
+	void correlations(vector<Double_t> &correlation) const;
+
+	UInt_t getNIterations() const { return n_iterations; };
+
+private:
+	void negativeHalfGradient(const vector<Double_t> &rhs, const vector<Double_t> &x, vector<Double_t> &w) const;
+
+	const NormalEquations &normal_equations;
+	Cholesky cholesky;
+	UInt_t n_iterations;
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NORMALEQUATIONS_H
+#define NORMALEQUATIONS_H 1
+
+#include <vector>
+
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "ResponseMatrix.h"
+
+using std::vector;
+
+// Normal equations G p = h of the weighted linear least-squares problem
+//
+// 	min_p sum_j w_j (sum_i p_i R(i, j) - s_j)^2,
+//
+// i.e. G = R W R^T and h = R W s, restricted to the parameters and spectrum bins in [binstart, binstop).
+// The weights w_j are the inverse uncertainties squared of the spectrum, w_j = 1/|s_j|, and bins with
+// zero content are ignored like in TH1::Fit().
+//
+// G is stored as a dense symmetric matrix. Local index a corresponds to bin binstart + a.
+class NormalEquations{
+public:
+	NormalEquations(const ResponseMatrix &rema, const TH1F &spectrum, const Int_t binstart, const Int_t binstop);
+	~NormalEquations(){};
+
+	UInt_t size() const { return n; };
+	Int_t firstBin() const { return first_bin; };
+
+	Double_t G(const UInt_t a, const UInt_t b) const { return normal_matrix[(size_t) a*n + b]; };
+	const Double_t* row(const UInt_t a) const { return &normal_matrix[(size_t) a*n]; };
+	Double_t h(const UInt_t a) const { return right_hand_side[a]; };
+	const vector<Double_t>& getRightHandSide() const { return right_hand_side; };
+
+private:
+	Int_t first_bin;
+	UInt_t n;
+	vector<Double_t> normal_matrix;
+	vector<Double_t> right_hand_side;
+};
+
+#endif
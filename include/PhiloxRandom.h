@@ -0,0 +1,61 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PHILOXRANDOM_H
+#define PHILOXRANDOM_H 1
+
+#include <cstddef>
+
+#include <TROOT.h>
+
+using std::size_t;
+
+// Counter-based random number generator Philox4x32-10 (J. K. Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3", SC'11).
+//
+// The n-th block of four 32-bit random numbers is a bijective function of the key and the counter
+// n. There is no state apart from the position in the sequence, so a generator for a given key can
+// be created at any time, on any thread, and always returns the same sequence. Here, the key is the
+// pair (seed, iteration) of a Monte-Carlo iteration, and the upper half of the counter selects one
+// of several independent streams within an iteration and, optionally, a substream, e.g. for each
+// column of a matrix, so that parts of a sample can be drawn in parallel.
+class PhiloxRandom{
+public:
+	PhiloxRandom(const UInt_t seed, const UInt_t iteration, const UInt_t stream = 0, const UInt_t substream = 0);
+	~PhiloxRandom(){};
+
+	// Uniformly distributed random number in the open interval (0, 1) with 53 random bits
+	Double_t Uniform();
+	// Uniformly distributed random number in the interval (a, b)
+	Double_t Uniform(const Double_t a, const Double_t b){ return a + (b - a)*Uniform(); };
+	// Poisson-distributed random number with the given mean
+	Double_t Poisson(const Double_t mean);
+	// n standard normal random numbers, generated pairwise with the Box-Muller transformation
+	void Normal(Double_t *normal, const size_t n);
+
+private:
+	UInt_t next();
+	void generateBlock();
+
+	UInt_t key[2];
+	UInt_t counter[4];
+	UInt_t block[4];
+	UInt_t position;
+};
+
+#endif
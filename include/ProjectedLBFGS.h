@@ -0,0 +1,86 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PROJECTEDLBFGS_H
+#define PROJECTEDLBFGS_H 1
+
+#include <vector>
+
+#include <Math/IFunction.h>
+#include <TROOT.h>
+
+using std::vector;
+
+// Limited-memory BFGS minimizer for functions with box constraints lower <= x <= upper.
+//
+// The minimizer needs nothing but the value and the gradient of the function, and its memory
+// grows only linearly with the number of variables (2*memory vectors of corrections), which makes
+// it suitable for fits with many thousand parameters where a dense Hessian is out of question.
+// For the chi^2 of Horst, one iteration costs one forward and one adjoint product with the
+// response matrix.
+//
+// In each iteration, variables which are at a bound and whose gradient points out of the feasible
+// region are held fixed. The quasi-Newton direction for the remaining variables is obtained from the
+// usual two-loop recursion, and a backtracking line search along the projection of this direction
+// onto the box ensures a sufficient decrease of the function.
+// Variables with lower == upper are fixed.
+class ProjectedLBFGS{
+public:
+	ProjectedLBFGS(const ROOT::Math::IGradientFunctionMultiDim &func, const UInt_t mem = 10);
+	~ProjectedLBFGS(){};
+
+	// x contains the start values on input and the position of the minimum on output.
+	// Returns false if the maximum number of iterations was reached before convergence.
+	Bool_t minimize(vector<Double_t> &x, const vector<Double_t> &lower, const vector<Double_t> &upper);
+
+	// Convergence criteria: the largest component of the projected gradient has decreased by a factor
+	// of gradient_tolerance with respect to the start, or the relative decrease of the function in a
+	// single iteration is smaller than function_tolerance.
+	void setGradientTolerance(const Double_t tolerance){ gradient_tolerance = tolerance; };
+	void setFunctionTolerance(const Double_t tolerance){ function_tolerance = tolerance; };
+	void setMaxIterations(const UInt_t max_it){ max_iterations = max_it; };
+	void setVerbose(const Bool_t verb){ verbose = verb; };
+
+	Double_t getMinValue() const { return min_value; };
+	UInt_t getNIterations() const { return n_iterations; };
+	UInt_t getNEvaluations() const { return n_evaluations; };
+
+private:
+	Double_t projectedGradientNorm(const vector<Double_t> &x, const vector<Double_t> &gradient, const vector<Double_t> &lower, const vector<Double_t> &upper) const;
+	void direction(const vector<Double_t> &gradient, const vector<Bool_t> &free, vector<Double_t> &d) const;
+
+	const ROOT::Math::IGradientFunctionMultiDim &function;
+	const UInt_t memory;
+	Double_t gradient_tolerance;
+	Double_t function_tolerance;
+	UInt_t max_iterations;
+	Bool_t verbose;
+
+	Double_t min_value;
+	UInt_t n_iterations;
+	UInt_t n_evaluations;
+
+	// Correction pairs s = x_{k+1} - x_k and y = g_{k+1} - g_k in a ring buffer
+	vector<vector<Double_t> > s;
+	vector<vector<Double_t> > y;
+	vector<Double_t> rho;
+	UInt_t n_corrections;
+	UInt_t newest;
+};
+
+#endif
@@ -20,7 +20,8 @@
 
 #include <TROOT.h>
 #include <TH1.h>
-#include <TH2.h>
+
+#include "ResponseMatrix.h"
 
 class Reconstructor{
 public:
@@ -28,12 +29,12 @@ public:
 	~Reconstructor(){};
 
 	void reconstruct(const TH1F &params, const TH1F &n_simulated_particles, TH1F &reconstructed_spectrum);
-	void uncertainty(const TH1F &total_uncertainty, const TH2F &rema, const TH1F &n_simulated_particles, TH1F &reconstruction_uncertainty);
+	void uncertainty(const TH1F &total_uncertainty, const TH1F &response_matrix_diagonal, const TH1F &n_simulated_particles, TH1F &reconstruction_uncertainty);
 
-	void addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const TH2F &rema, TH1F &response_spectrum);
-	void addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const TH2F &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP);
+	void addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const ResponseMatrix &rema, TH1F &response_spectrum);
+	void addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const ResponseMatrix &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP);
 
-	void addRealisticResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const TH2F &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP);
+	void addRealisticResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const ResponseMatrix &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP);
 
 private:
 	const UInt_t BINNING;
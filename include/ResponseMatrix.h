@@ -0,0 +1,102 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RESPONSEMATRIX_H
+#define RESPONSEMATRIX_H 1
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+#include <TH2.h>
+#include <TROOT.h>
+
+using std::size_t;
+using std::vector;
+
+// Alignment (in bytes) of the start of each column of a ResponseMatrix.
+// 64 bytes is the size of a cache line and of an AVX-512 register.
+const size_t RESPONSE_MATRIX_ALIGNMENT = 64;
+
+template <typename T>
+struct AlignedAllocator{
+	typedef T value_type;
+
+	AlignedAllocator(){};
+	template <typename U> AlignedAllocator(const AlignedAllocator<U> &){};
+
+	T* allocate(size_t n){
+		void *p = nullptr;
+		if(posix_memalign(&p, RESPONSE_MATRIX_ALIGNMENT, n*sizeof(T)) != 0){
+			throw std::bad_alloc();
+		}
+		return static_cast<T*>(p);
+	};
+	void deallocate(T *p, size_t){ free(p); };
+
+	template <typename U> struct rebind{ typedef AlignedAllocator<U> other; };
+};
+
+template <typename T, typename U>
+bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &){ return true; }
+template <typename T, typename U>
+bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &){ return false; }
+
+// Lower-triangular detector response matrix R(i, j), where i is the bin of the
+// energy of the incoming particle and j <= i the bin of the detected energy.
+// Bins are numbered like the bins of the TH2F from which the matrix is created,
+// i.e. from 1 to GetNbins().
+//
+// The elements are stored packed and column by column: column j contains the
+// elements R(j, j), R(j+1, j), ..., R(n, j) in consecutive memory, starting at
+// an address that is aligned to RESPONSE_MATRIX_ALIGNMENT.
+// This way, the evaluation of the response in a single detected-energy bin j,
+// which is a sum over all i >= j, is a contiguous walk through memory.
+// The upper triangle (j > i) is structurally zero and not stored.
+class ResponseMatrix{
+public:
+	ResponseMatrix():n_bins(0), column_offset(1, 0){};
+	ResponseMatrix(const TH2F &rema);
+	~ResponseMatrix(){};
+
+	Int_t GetNbins() const { return n_bins; };
+	size_t GetSize() const { return elements.size(); };
+
+	// Bounds-checked access. Returns zero for elements outside the lower triangle.
+	Double_t GetBinContent(const Int_t i, const Int_t j) const {
+		if(j < 1 || j > i || i > n_bins){
+			return 0.;
+		}
+		return (Double_t) elements[column_offset[(size_t) j] + (size_t) (i - j)];
+	};
+	void SetBinContent(const Int_t i, const Int_t j, const Double_t content);
+
+	// Unchecked access to column j (1 <= j <= GetNbins()).
+	// column(j)[k] is the element R(j+k, j), with 0 <= k <= GetNbins() - j.
+	const Float_t* column(const Int_t j) const { return &elements[column_offset[(size_t) j]]; };
+	Float_t* column(const Int_t j){ return &elements[column_offset[(size_t) j]]; };
+
+private:
+	void allocate(const Int_t nbins);
+
+	Int_t n_bins;
+	vector<size_t> column_offset;
+	vector<Float_t, AlignedAllocator<Float_t> > elements;
+};
+
+#endif
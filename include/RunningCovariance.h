@@ -0,0 +1,113 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef RUNNINGCOVARIANCE_H
+#define RUNNINGCOVARIANCE_H 1
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <TROOT.h>
+
+using std::vector;
+
+// Number of elements of the covariance matrix in a block. A block of 2^15 elements (256 kB) fits
+// into the L2 cache, so that several updates can be applied to it without reloading it from memory.
+const size_t RUNNINGCOVARIANCE_BLOCK_SIZE = 1 << 15;
+
+// Single-pass accumulator for the covariance matrix of the bins [first_bin, last_bin] of a sequence
+// of samples.
+//
+// The sums of products of deviations are updated with the rank-1 update of Welford's algorithm,
+// C += (1 - 1/n) delta delta^T, where delta is the deviation of the n-th sample from the mean of
+// the previous samples. add() only updates the means and stores delta, which needs O(n) operations.
+// The O(n^2) updates of the matrix are applied by update(), which can be called by several threads
+// at the same time. The lower triangle of the matrix is split into blocks of consecutive rows
+// (RUNNINGCOVARIANCE_BLOCK_SIZE elements), and each thread applies all pending updates to one block
+// at a time, which the other threads skip. Every element receives the updates in the order of the
+// samples, so the result does not depend on the number of threads.
+//
+// Accumulators of disjoint sets of samples can be combined with merge(). Their state can be stored
+// with getState() and restored with the constructor.
+class RunningCovariance{
+public:
+	RunningCovariance(const Int_t first_bin, const Int_t last_bin);
+	// Restore an accumulator from the output of getState()
+	RunningCovariance(const vector<Double_t> &state);
+	~RunningCovariance(){};
+
+	// sample is indexed by the bin number. Samples must be added by one thread at a time, in a fixed
+	// order.
+	void add(const Double_t *sample);
+	// Apply the pending updates to all blocks which are not processed by another thread. Can be
+	// called by several threads, also while samples are added.
+	void update();
+	// Apply all pending updates, waiting for the blocks which are processed by other threads.
+	void finish();
+
+	// Add the samples of another accumulator with the same bins, for which finish() has been called,
+	// using the pairwise update of T. F. Chan, G. H. Golub and R. J. LeVeque, Proc. COMPSTAT (1982) 30.
+	void merge(const RunningCovariance &other);
+
+	// Flat representation of the accumulator: first_bin, last_bin, n_samples, followed by the means
+	// and the lower triangle of the sums of products of deviations, packed row by row. Calls finish().
+	void getState(vector<Double_t> &state);
+
+	UInt_t getNSamples() const { return n_samples; };
+	Int_t firstBin() const { return first_bin; };
+	Int_t lastBin() const { return last_bin; };
+
+	// Covariance, normalized to the number of samples N, of two bins in [first_bin, last_bin], and
+	// zero otherwise. Only valid after finish().
+	Double_t covariance(const Int_t bin_i, const Int_t bin_j) const;
+
+private:
+	struct Update{
+		Double_t factor;
+		vector<Double_t> delta;
+	};
+
+	void allocate();
+	void updateBlocks(const Bool_t wait);
+
+	Int_t first_bin;
+	Int_t last_bin;
+	UInt_t n_samples;
+
+	// Indexed by bin - first_bin
+	vector<Double_t> means;
+	vector<Double_t> delta;
+	// Sums of products of deviations, lower triangle packed row by row
+	vector<Double_t> comoments;
+
+	// First row of each block, followed by the number of rows
+	vector<size_t> block_rows;
+	vector<std::mutex> block_mutex;
+	// Number of updates which have been applied to each block, counting from the first update
+	vector<std::atomic<size_t> > n_applied;
+	std::atomic<size_t> next_block;
+
+	// Pending updates. The updates before n_removed have been applied to all blocks and removed.
+	std::mutex update_mutex;
+	std::deque<Update> updates;
+	size_t n_removed;
+	vector<vector<Double_t> > spare_deltas;
+};
+
+#endif
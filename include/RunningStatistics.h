@@ -0,0 +1,109 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef RUNNINGSTATISTICS_H
+#define RUNNINGSTATISTICS_H 1
+
+#include <vector>
+
+#include <TH1.h>
+#include <TROOT.h>
+
+#include "MergingDigest.h"
+
+using std::vector;
+
+// Single-pass accumulator for the mean, variance, minimum and maximum of the bins
+// [first_bin, last_bin] of a sequence of histograms. The third and fourth central
+// moments are accumulated as well, to estimate the uncertainty of the standard deviation.
+// Optionally, the quantiles of each bin are estimated with a MergingDigest.
+//
+// Each sample updates the accumulator and can be discarded afterwards, so the memory does not
+// depend on the number of samples. The mean and the sums of squared deviations are updated with
+// Welford's algorithm (B. P. Welford, Technometrics 4 (1962) 419), which does not suffer from the
+// cancellation of the textbook formula var = <x^2> - <x>^2. The higher moments are updated with
+// the generalization of T. B. Terriberry (2007).
+// The result depends on the order of the samples in the last digits, so samples should be added
+// in a fixed order.
+//
+// Accumulators of disjoint sets of samples, e.g. from different processes, can be combined with
+// merge(). Their state can be stored with getState() and restored with the constructor.
+class RunningStatistics{
+public:
+	RunningStatistics(const Int_t first_bin, const Int_t last_bin, const Bool_t with_quantiles = false);
+	// Restore an accumulator from the output of getState()
+	RunningStatistics(const vector<Double_t> &state);
+	~RunningStatistics(){};
+
+	void add(const TH1F &sample);
+	// sample is indexed by the bin number
+	void add(const Double_t *sample);
+
+	// Add the samples of another accumulator with the same bins, using the pairwise update of
+	// T. F. Chan, G. H. Golub and R. J. LeVeque, Proc. COMPSTAT (1982) 30, and its extension to
+	// higher moments by P. Pebay, Sandia Report SAND2008-6212.
+	void merge(const RunningStatistics &other);
+
+	// Flat representation of the accumulator: first_bin, last_bin, with_quantiles, n_samples,
+	// followed by the means, sums of the second, third and fourth powers of the deviations, minima,
+	// maxima and the states of the digests.
+	void getState(vector<Double_t> &state) const;
+
+	UInt_t getNSamples() const { return n_samples; };
+	Int_t firstBin() const { return first_bin; };
+	Int_t lastBin() const { return last_bin; };
+
+	// All getters return zero for bins outside [first_bin, last_bin].
+	// The variance is normalized to the number of samples N, not N - 1.
+	Double_t mean(const Int_t bin) const;
+	Double_t variance(const Int_t bin) const;
+	Double_t standardDeviation(const Int_t bin) const;
+	// Standard error of standardDeviation(bin), sqrt((m4 - m2^2)/N)/(2 sqrt(m2)) to leading order in
+	// 1/N, where m2 and m4 are the second and fourth central moments. Unlike the error
+	// sqrt(m2/(2N)) for normally distributed samples, this is also valid for skewed distributions,
+	// e.g. of parameters close to their bound.
+	Double_t standardDeviationError(const Int_t bin) const;
+	Double_t minimum(const Int_t bin) const;
+	Double_t maximum(const Int_t bin) const;
+	// Estimate of the q-quantile (0 <= q <= 1). Returns zero if the quantiles are not accumulated.
+	Double_t quantile(const Int_t bin, const Double_t q) const;
+	Bool_t hasQuantiles() const { return with_quantiles; };
+
+private:
+	Bool_t inRange(const Int_t bin) const { return bin >= first_bin && bin <= last_bin; };
+	void allocate();
+
+	Int_t first_bin;
+	Int_t last_bin;
+	Bool_t with_quantiles;
+	UInt_t n_samples;
+
+	// Indexed by bin - first_bin
+	vector<Double_t> means;
+	vector<Double_t> squared_deviations;
+	vector<Double_t> cubed_deviations;
+	vector<Double_t> quartic_deviations;
+	vector<Double_t> minima;
+	vector<Double_t> maxima;
+	vector<MergingDigest> digests;
+
+	vector<Double_t> delta;
+	vector<Double_t> buffer;
+};
+
+#endif
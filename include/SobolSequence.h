@@ -0,0 +1,50 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef SOBOLSEQUENCE_H
+#define SOBOLSEQUENCE_H 1
+
+#include <TROOT.h>
+
+// Randomized quasi-random numbers in an arbitrary number of dimensions, which are used instead of
+// independent random numbers to reduce the variance of Monte-Carlo estimates.
+//
+// Point 'index' is taken from the two-dimensional Sobol' sequence, whose first 2^m points
+// stratify the unit square into 2^m boxes of any shape 2^-a x 2^-b with a + b = m. Each pair of
+// dimensions (2d, 2d + 1) uses its own random permutation of the point index and its own
+// scrambling of the coordinates ("padding", A. B. Owen, SIAM J. Numer. Anal. 36 (1998) 1405),
+// so that the pairs are independent of each other. Index and coordinates are scrambled with the
+// hash-based approximation of Owen's nested uniform scrambling by B. Burley, J. Comput. Graph.
+// Tech. 9 (2020) 10, which keeps the stratification and makes each coordinate uniformly
+// distributed.
+//
+// Like PhiloxRandom, the class has no mutable state. The scrambling is a function of the seed, a
+// stream and a substream.
+class SobolSequence{
+public:
+	SobolSequence(const UInt_t seed, const UInt_t stream = 0, const UInt_t substream = 0);
+	~SobolSequence(){};
+
+	// Coordinate 'dimension' of point 'index' in the open interval (0, 1). The 32 bits of the
+	// scrambled coordinate are completed with 'jitter' in (0, 1), a uniform random number.
+	Double_t Uniform(const UInt_t index, const UInt_t dimension, const Double_t jitter) const;
+
+private:
+	UInt_t scrambling_seed;
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H 1
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <TROOT.h>
+
+using std::vector;
+
+// Process-wide pool of worker threads for data-parallel loops.
+//
+// parallelFor() distributes a number of independent tasks among the workers and the calling thread
+// and returns when all of them are finished. Callers split their work into tasks such that the
+// result does not depend on which thread executes which task (each task writes to its own part of
+// the output, and partial sums are combined in the order of the tasks afterwards). This keeps the
+// results reproducible.
+//
+// The size of the pool is taken from setDefaultSize(), which has to be called before the first use
+// of instance(), from the environment variable HORST_THREADS, or from the number of hardware
+// threads, in this order.
+class ThreadPool{
+public:
+	ThreadPool(const UInt_t n_threads);
+	~ThreadPool();
+
+	static ThreadPool& instance();
+	static void setDefaultSize(const UInt_t n_threads){ default_size = n_threads; };
+
+	// Number of threads, including the calling thread
+	UInt_t size() const { return (UInt_t) workers.size() + 1; };
+
+	// Number of tasks into which a loop with the given amount of work (e.g. number of matrix
+	// elements) should be split: one per thread, but not less than min_work per task.
+	UInt_t nTasks(const size_t work, const size_t min_work = 1 << 16) const;
+
+	// Call task(k) for all k in [0, n_tasks). Calls from inside a task are executed serially by the
+	// calling thread.
+	void parallelFor(const UInt_t n_tasks, const std::function<void(UInt_t)> &task);
+
+private:
+	void work();
+	void runTasks();
+
+	static UInt_t default_size;
+
+	vector<std::thread> workers;
+	std::mutex run_mutex;
+	std::mutex state_mutex;
+	std::condition_variable start_condition;
+	std::condition_variable done_condition;
+
+	const std::function<void(UInt_t)> *current_task;
+	UInt_t n_current_tasks;
+	std::atomic<UInt_t> next_task;
+	UInt_t n_finished_workers;
+	unsigned long generation;
+	Bool_t stop;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TRIANGULARKERNELS_H
+#define TRIANGULARKERNELS_H 1
+
+#include <cstddef>
+
+#include <TROOT.h>
+
+#include "ResponseMatrix.h"
+
+using std::size_t;
+
+// Kernels for the products of the lower-triangular response matrix with a vector, which are the
+// innermost loops of the fit, the Monte-Carlo uncertainty estimation and tsroh.
+//
+// All products are composed of two operations on a single column of the matrix, which is
+// contiguous in memory: a dot product with a vector (forward product, prediction = R^T p) and a
+// scaled addition to a vector (adjoint product, gradient = R r). Both exist in a variant with
+// squared matrix elements, which appears in the propagation of uncertainties.
+//
+// The column kernels have AVX-512 and AVX2 implementations, which are selected at runtime
+// depending on the processor, and a scalar fallback. The environment variable HORST_SIMD can be
+// set to 'scalar', 'avx2' or 'avx512' to restrict the selection, e.g. for comparisons. Other values
+// are rejected.
+// The matrix elements are single precision, all sums are accumulated in double precision.
+//
+// The triangular products are split among the threads of the ThreadPool: the forward products by
+// columns and the adjoint products by rows, in blocks with about the same number of matrix elements.
+// Every element of the result is calculated by a single thread in a fixed order, so the result does
+// not depend on the number of threads.
+//
+// All arrays are indexed by the bin number like the response matrix.
+namespace TriangularKernels{
+	// sum_{k < n} a[k]*x[k]
+	Double_t dot(const Float_t *a, const Double_t *x, const size_t n);
+	// sum_{k < n} a[k]^2*x[k]
+	Double_t dotSquared(const Float_t *a, const Double_t *x, const size_t n);
+	// sum_x = sum_{k < n} a[k]*x[k] and sum_y = sum_{k < n} a[k]^2*y[k] in a single pass over a
+	void dotPair(const Float_t *a, const Double_t *x, const Double_t *y, const size_t n, Double_t &sum_x, Double_t &sum_y);
+	// y[k] += factor*a[k] for k < n
+	void axpy(const Double_t factor, const Float_t *a, Double_t *y, const size_t n);
+	// y[k] += factor*a[k]^2 for k < n
+	void axpySquared(const Double_t factor, const Float_t *a, Double_t *y, const size_t n);
+
+	// prediction[j] = sum_{i = j}^{last_bin} R(i, j)*p[i] for j in [first_bin, last_bin]
+	void forward(const ResponseMatrix &rema, const Double_t *p, Double_t *prediction, const Int_t first_bin, const Int_t last_bin);
+	// prediction[j] = sum_{i = j}^{last_bin} R(i, j)^2*p[i] for j in [first_bin, last_bin]
+	void forwardSquared(const ResponseMatrix &rema, const Double_t *p, Double_t *prediction, const Int_t first_bin, const Int_t last_bin);
+	// simulation[j] = sum_{i = j + 1}^{last_bin} R(i, j)*p[i] and
+	// spectrum[j] = sum_{i = j}^{last_bin} R(i, j)^2*w[i] for j in [first_bin, last_bin],
+	// i.e. the two statistical uncertainties of Uncertainty from a single pass over the matrix.
+	void forwardUncertainty(const ResponseMatrix &rema, const Double_t *p, const Double_t *w, Double_t *simulation, Double_t *spectrum, const Int_t first_bin, const Int_t last_bin);
+	// result[i] = sum_{j = first_bin}^{i} R(i, j)*r[j] for i in [first_bin, last_bin]
+	void adjoint(const ResponseMatrix &rema, const Double_t *r, Double_t *result, const Int_t first_bin, const Int_t last_bin);
+	// result[i] = sum_{j = first_bin}^{i} R(i, j)^2*r[j] for i in [first_bin, last_bin]
+	void adjointSquared(const ResponseMatrix &rema, const Double_t *r, Double_t *result, const Int_t first_bin, const Int_t last_bin);
+
+	// prediction[j] += factor*R(row, j) for j in [first_bin, row], i.e. the change of the forward
+	// product if parameter 'row' is changed by factor. The elements of a row are not contiguous in
+	// memory, so this is a scalar loop.
+	void addRow(const ResponseMatrix &rema, const Int_t row, const Double_t factor, Double_t *prediction, const Int_t first_bin);
+
+	// Name of the instruction set of the selected column kernels
+	const char* instructionSet();
+}
+
+#endif
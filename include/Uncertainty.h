@@ -22,7 +22,8 @@
 
 #include <TROOT.h>
 #include <TH1.h>
-#include <TH2.h>
+
+#include "ResponseMatrix.h"
 
 using std::vector;
 
@@ -31,14 +32,18 @@ public:
 	Uncertainty(const UInt_t binning): BINNING(binning){};
 	~Uncertainty(){};
 
-	void getUncertainty(const TH1F &params, const TH2F &rema, TH1F &simulation_statistical_uncertainty, const Int_t binstart, const Int_t binstop); // Version of Uncertainty::getUncertainty() which does not calculate the statistical uncertainty of the spectrum.
-	void getUncertainty(const TH1F &params, const TH1F &spectrum, const TH2F &rema, TH1F &simulation_statistical_uncertainty, TH1F &spectrum_statistical_uncertainty, const Int_t binstart, const Int_t binstop);
+	void getUncertainty(const TH1F &params, const ResponseMatrix &rema, TH1F &simulation_statistical_uncertainty, const Int_t binstart, const Int_t binstop); // Version of Uncertainty::getUncertainty() which does not calculate the statistical uncertainty of the spectrum.
+	void getUncertainty(const TH1F &params, const TH1F &spectrum, const ResponseMatrix &rema, TH1F &simulation_statistical_uncertainty, TH1F &spectrum_statistical_uncertainty, const Int_t binstart, const Int_t binstop);
 
-	void getTotalUncertainty(vector<TH1F*> &uncertainties, TH1F &total_uncertainty);
+	void getTotalUncertainty(const vector<const TH1F*> &uncertainties, TH1F &total_uncertainty);
 
 	void getLowerAndUpperLimit(const TH1F &spectrum, const TH1F &uncertainty, TH1F &uncertainty_low, TH1F &uncertainty_up, Bool_t no_zeros);
 
 private:
+	void getParameters(const TH1F &params, const ResponseMatrix &rema, const Int_t binstart, const Int_t binstop, vector<Double_t> &parameters);
+	void getWeights(const vector<Double_t> &parameters, const TH1F &spectrum, const ResponseMatrix &rema, const Int_t binstart, const Int_t binstop, vector<Double_t> &weights);
+	void getStatisticalUncertainties(const vector<Double_t> &parameters, const vector<Double_t> &weights, const ResponseMatrix &rema, const Int_t binstart, const Int_t binstop, vector<Double_t> &simulation_uncertainty, vector<Double_t> &spectrum_uncertainty);
+
 	const UInt_t BINNING;
 };
 
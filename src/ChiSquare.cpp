@@ -0,0 +1,123 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "ChiSquare.h"
+#include "ThreadPool.h"
+
+ChiSquare::ChiSquare(const FitFunction &fitfunction, const TH1F &spectrum, const Int_t binstart, const Int_t binstop):
+	fitFunction(&fitfunction),
+	first_bin(binstart),
+	stop_bin(binstop),
+	n_dim(0)
+{
+	if(first_bin < fitFunction->firstBin()){
+		first_bin = fitFunction->firstBin();
+	}
+	if(stop_bin > fitFunction->lastBin() + 1){
+		stop_bin = fitFunction->lastBin() + 1;
+	}
+	if(stop_bin < first_bin){
+		stop_bin = first_bin;
+	}
+	n_dim = (UInt_t) (stop_bin - first_bin);
+
+	const size_t n_buffer = (size_t) (fitFunction->lastBin() > stop_bin ? fitFunction->lastBin() : stop_bin) + 2;
+	data.assign(n_buffer, 0.);
+	weight.assign(n_buffer, 0.);
+	parameters.assign(n_buffer, 0.);
+	residual.assign(n_buffer, 0.);
+	gradient_bins.assign(n_buffer, 0.);
+
+	Double_t bin_content = 0.;
+	for(Int_t j = first_bin; j < stop_bin; ++j){
+		bin_content = spectrum.GetBinContent(j);
+		data[(size_t) j] = bin_content;
+		// The uncertainty of a bin is the square root of its content.
+		if(bin_content != 0.){
+			weight[(size_t) j] = 1./fabs(bin_content);
+		}
+	}
+}
+
+void ChiSquare::Gradient(const double *x, double *gradient) const {
+	evaluate(x, gradient);
+}
+
+void ChiSquare::FdF(const double *x, double &value, double *gradient) const {
+	value = evaluate(x, gradient);
+}
+
+void ChiSquare::HessianDiagonal(double *diagonal) const {
+	fitFunction->adjointSquared(&weight[0], &gradient_bins[0]);
+
+	for(UInt_t k = 0; k < n_dim; ++k){
+		diagonal[k] = 2.*gradient_bins[(size_t) first_bin + k];
+	}
+}
+
+double ChiSquare::DoEval(const double *x) const {
+	return evaluate(x, nullptr);
+}
+
+double ChiSquare::DoDerivative(const double *x, unsigned int icoord) const {
+	vector<Double_t> gradient(n_dim, 0.);
+	evaluate(x, &gradient[0]);
+
+	return gradient[icoord];
+}
+
+Double_t ChiSquare::evaluate(const double *x, double *gradient) const {
+	for(UInt_t k = 0; k < n_dim; ++k){
+		parameters[(size_t) first_bin + k] = x[k];
+	}
+
+	const vector<Double_t> &prediction = fitFunction->predict(&parameters[0]);
+
+	// Reduce in blocks of a fixed number of bins, whose partial sums are added in order,
+	// so that the result does not depend on the number of threads.
+	const UInt_t n_blocks = stop_bin > first_bin ? ((UInt_t) (stop_bin - first_bin) - 1)/CHISQUARE_BLOCK_SIZE + 1 : 0;
+	partial_chi2.assign(n_blocks, 0.);
+
+	ThreadPool::instance().parallelFor(n_blocks, [this, &prediction](const UInt_t block){
+		const Int_t block_begin = first_bin + (Int_t) (block*CHISQUARE_BLOCK_SIZE);
+		const Int_t block_end = block_begin + (Int_t) CHISQUARE_BLOCK_SIZE < stop_bin ? block_begin + (Int_t) CHISQUARE_BLOCK_SIZE : stop_bin;
+
+		Double_t sum = 0.;
+		Double_t difference = 0.;
+		for(Int_t j = block_begin; j < block_end; ++j){
+			difference = prediction[(size_t) j] - data[(size_t) j];
+			sum += weight[(size_t) j]*difference*difference;
+			residual[(size_t) j] = 2.*weight[(size_t) j]*difference;
+		}
+		partial_chi2[block] = sum;
+	});
+
+	Double_t chi2 = 0.;
+	for(auto sum: partial_chi2){
+		chi2 += sum;
+	}
+
+	if(gradient != nullptr){
+		fitFunction->adjoint(&residual[0], &gradient_bins[0]);
+
+		for(UInt_t k = 0; k < n_dim; ++k){
+			gradient[k] = gradient_bins[(size_t) first_bin + k];
+		}
+	}
+
+	return chi2;
+}
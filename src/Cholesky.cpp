@@ -0,0 +1,296 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <limits>
+
+#include "Cholesky.h"
+#include "ThreadPool.h"
+
+using std::numeric_limits;
+
+// Boundaries of n_tasks contiguous ranges of [0, n) with about the same amount of work, if the
+// work of the range [k, n) is proportional to (n - k)^exponent
+static vector<UInt_t> splitTail(const UInt_t n, const UInt_t n_tasks, const Double_t exponent){
+	vector<UInt_t> boundaries(n_tasks + 1, n);
+	for(UInt_t task = 0; task < n_tasks; ++task){
+		boundaries[task] = n - (UInt_t) ((Double_t) n*pow((Double_t) (n_tasks - task)/(Double_t) n_tasks, 1./exponent));
+	}
+	boundaries[0] = 0;
+
+	return boundaries;
+}
+
+Bool_t Cholesky::factorize(const vector<UInt_t> &index_set){
+	clear();
+	L.reserve((size_t) index_set.size()*(index_set.size() + 1)/2);
+
+	for(auto index: index_set){
+		if(!append(index)){
+			return false;
+		}
+	}
+
+	return true;
+}
+
+Bool_t Cholesky::append(const UInt_t index){
+	return appendRow(index, nullptr, 0);
+}
+
+void Cholesky::appendAll(const vector<UInt_t> &index_set){
+	vector<Double_t> left;
+
+	for(size_t block_begin = 0; block_begin < index_set.size(); block_begin += CHOLESKY_BLOCK_SIZE){
+		const UInt_t block_size = index_set.size() - block_begin < CHOLESKY_BLOCK_SIZE ? (UInt_t) (index_set.size() - block_begin) : CHOLESKY_BLOCK_SIZE;
+		const UInt_t p = size();
+
+		// The parts of the new rows left of the block are forward substitutions with the rows of L
+		// before the block, which are independent of each other.
+		left.assign((size_t) block_size*p, 0.);
+		const UInt_t n_tasks = ThreadPool::instance().nTasks((size_t) block_size*p*p/2);
+
+		ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+			Double_t *row = nullptr;
+			const Double_t *G_row = nullptr;
+			Double_t sum = 0.;
+			for(UInt_t k = block_size*task/n_tasks; k < block_size*(task + 1)/n_tasks; ++k){
+				row = &left[(size_t) k*p];
+				G_row = normal_equations.row(index_set[block_begin + k]);
+				for(UInt_t c = 0; c < p; ++c){
+					sum = G_row[indices[c]];
+					for(UInt_t q = 0; q < c; ++q){
+						sum -= element(c, q)*row[q];
+					}
+					row[c] = sum/element(c, c);
+				}
+			}
+		});
+
+		// The triangle of the block depends on the previous rows of the block
+		for(UInt_t k = 0; k < block_size; ++k){
+			appendRow(index_set[block_begin + k], &left[(size_t) k*p], p);
+		}
+	}
+}
+
+Bool_t Cholesky::appendRow(const UInt_t index, const Double_t *left, const UInt_t n_left){
+	const UInt_t p = size();
+	const Double_t *G_row = normal_equations.row(index);
+	const size_t row_offset = L.size();
+
+	// New row l of L solves L l = G_P,index (forward substitution),
+	// the new diagonal element is sqrt(G_index,index - l.l)
+	L.resize(row_offset + p + 1);
+
+	Double_t sum = 0.;
+	Double_t squared_norm = 0.;
+	for(UInt_t c = 0; c < p; ++c){
+		if(c < n_left){
+			L[row_offset + c] = left[c];
+		} else{
+			sum = G_row[indices[c]];
+			for(UInt_t q = 0; q < c; ++q){
+				sum -= element(c, q)*L[row_offset + q];
+			}
+			L[row_offset + c] = sum/element(c, c);
+		}
+		squared_norm += L[row_offset + c]*L[row_offset + c];
+	}
+
+	const Double_t diagonal = G_row[index] - squared_norm;
+	if(!(diagonal > 100.*numeric_limits<Double_t>::epsilon()*G_row[index])){
+		L.resize(row_offset);
+		return false;
+	}
+	L[row_offset + p] = sqrt(diagonal);
+	indices.push_back(index);
+
+	return true;
+}
+
+void Cholesky::remove(const UInt_t index){
+	const UInt_t p = size();
+	UInt_t k = 0;
+	while(k < p && indices[k] != index){
+		++k;
+	}
+	if(k == p){
+		return;
+	}
+
+	// Deleting row and column k of G_PP leaves the trailing block of the factor with
+	// L22' L22'^T = L22 L22^T + v v^T, where v is the part of column k below the diagonal.
+	vector<Double_t> v(p, 0.);
+	for(UInt_t r = k + 1; r < p; ++r){
+		v[r] = element(r, k);
+	}
+
+	Double_t diagonal = 0.;
+	Double_t cosine = 0.;
+	Double_t sine = 0.;
+	for(UInt_t c = k + 1; c < p; ++c){
+		diagonal = sqrt(element(c, c)*element(c, c) + v[c]*v[c]);
+		cosine = diagonal/element(c, c);
+		sine = v[c]/element(c, c);
+		element(c, c) = diagonal;
+		for(UInt_t r = c + 1; r < p; ++r){
+			element(r, c) = (element(r, c) + sine*v[r])/cosine;
+			v[r] = cosine*v[r] - sine*element(r, c);
+		}
+	}
+
+	// Remove row and column k from the packed storage
+	size_t target = (size_t) k*(k + 1)/2;
+	for(UInt_t r = k + 1; r < p; ++r){
+		for(UInt_t c = 0; c <= r; ++c){
+			if(c != k){
+				L[target++] = element(r, c);
+			}
+		}
+	}
+	L.resize(target);
+	indices.erase(indices.begin() + k);
+}
+
+void Cholesky::solve(const vector<Double_t> &rhs, vector<Double_t> &x) const {
+	const UInt_t p = size();
+	vector<Double_t> y(p, 0.);
+
+	// L y = rhs_P
+	Double_t sum = 0.;
+	for(UInt_t r = 0; r < p; ++r){
+		sum = rhs[indices[r]];
+		for(UInt_t c = 0; c < r; ++c){
+			sum -= element(r, c)*y[c];
+		}
+		y[r] = sum/element(r, r);
+	}
+
+	// L^T x_P = y, walking along the rows of L
+	for(UInt_t r = p; r-- > 0;){
+		y[r] /= element(r, r);
+		for(UInt_t c = 0; c < r; ++c){
+			y[c] -= element(r, c)*y[r];
+		}
+	}
+
+	for(UInt_t r = 0; r < p; ++r){
+		x[indices[r]] = y[r];
+	}
+}
+
+void Cholesky::invertFactor(vector<Double_t> &L_inverse) const {
+	// L_inverse is lower triangular and stored packed like L. Its columns are independent, and the
+	// work for the columns [c, p) is proportional to (p - c)^3.
+	const UInt_t p = size();
+	L_inverse.assign(L.size(), 0.);
+
+	const UInt_t n_tasks = ThreadPool::instance().nTasks((size_t) p*p*p/6);
+	const vector<UInt_t> columns = splitTail(p, n_tasks, 3.);
+
+	ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+		Double_t sum = 0.;
+		for(UInt_t c = columns[task]; c < columns[task + 1]; ++c){
+			L_inverse[(size_t) c*(c + 1)/2 + c] = 1./element(c, c);
+			for(UInt_t r = c + 1; r < p; ++r){
+				sum = 0.;
+				for(UInt_t q = c; q < r; ++q){
+					sum -= element(r, q)*L_inverse[(size_t) q*(q + 1)/2 + c];
+				}
+				L_inverse[(size_t) r*(r + 1)/2 + c] = sum/element(r, r);
+			}
+		}
+	});
+}
+
+void Cholesky::inverseDiagonal(vector<Double_t> &diagonal) const {
+	// (L L^T)^-1 = L^-T L^-1, so the k-th diagonal element is the squared norm of column k of L^-1.
+	const UInt_t p = size();
+	vector<Double_t> L_inverse;
+	invertFactor(L_inverse);
+
+	diagonal.assign(p, 0.);
+	Double_t element_value = 0.;
+	for(UInt_t r = 0; r < p; ++r){
+		for(UInt_t c = 0; c <= r; ++c){
+			element_value = L_inverse[(size_t) r*(r + 1)/2 + c];
+			diagonal[c] += element_value*element_value;
+		}
+	}
+}
+
+void Cholesky::inverse(vector<Double_t> &inverse_matrix) const {
+	const UInt_t p = size();
+	vector<Double_t> L_inverse;
+	invertFactor(L_inverse);
+
+	inverse_matrix.assign((size_t) p*p, 0.);
+
+	// (G_PP^-1)(a, b) = sum_{r >= max(a, b)} L^-1(r, a) L^-1(r, b)
+	// The rows a of the lower triangle are split among the threads. Row a needs (a + 1)(p - a)
+	// operations, so the boundaries of the ranges are chosen such that each range contains about
+	// the same number of elements of the lower triangle of the result times the rows of L^-1.
+	const UInt_t n_tasks = ThreadPool::instance().nTasks((size_t) p*p*p/6);
+	vector<UInt_t> rows(n_tasks + 1, p);
+	rows[0] = 0;
+	const Double_t work_per_task = (Double_t) p*p*p/6./(Double_t) n_tasks;
+	Double_t work = 0.;
+	UInt_t task = 1;
+	for(UInt_t a = 0; a < p && task < n_tasks; ++a){
+		work += (Double_t) (a + 1)*(Double_t) (p - a);
+		if(work >= work_per_task*(Double_t) task){
+			rows[task++] = a + 1;
+		}
+	}
+
+	ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t t){
+		const Double_t *L_inverse_row = nullptr;
+		for(UInt_t r = rows[t]; r < p; ++r){
+			L_inverse_row = &L_inverse[(size_t) r*(r + 1)/2];
+			for(UInt_t a = rows[t]; a <= r && a < rows[t + 1]; ++a){
+				for(UInt_t b = 0; b <= a; ++b){
+					inverse_matrix[(size_t) a*p + b] += L_inverse_row[a]*L_inverse_row[b];
+				}
+			}
+		}
+	});
+
+	for(UInt_t a = 0; a < p; ++a){
+		for(UInt_t b = 0; b < a; ++b){
+			inverse_matrix[(size_t) b*p + a] = inverse_matrix[(size_t) a*p + b];
+		}
+	}
+}
+
+void Cholesky::correlations(vector<Double_t> &correlation) const {
+	const UInt_t n = normal_equations.size();
+	correlation.assign((size_t) n*n, 0.);
+
+	for(UInt_t i = 0; i < n; ++i){
+		correlation[(size_t) i*n + i] = 1.;
+	}
+
+	vector<Double_t> inverse_matrix;
+	inverse(inverse_matrix);
+	const size_t p = indices.size();
+	for(size_t a = 0; a < p; ++a){
+		for(size_t b = 0; b < p; ++b){
+			correlation[(size_t) indices[a]*n + indices[b]] = inverse_matrix[a*p + b]/sqrt(inverse_matrix[a*p + a]*inverse_matrix[b*p + b]);
+		}
+	}
+}
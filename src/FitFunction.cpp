@@ -16,39 +16,53 @@
 */
 
 #include "FitFunction.h"
-#include "Config.h"
+#include "TriangularKernels.h"
 
-Double_t FitFunction::operator()(Double_t *x, Double_t *p){
-	Int_t bin = (Int_t) floor(x[0]*inverse_BINNING);
-	Double_t bin_content = 0.;
+void FitFunction::forward(const Double_t *p, Double_t *prediction) const {
+	TriangularKernels::forward(*response_matrix, p, prediction, firstBin(), lastBin());
+}
+
+const vector<Double_t>& FitFunction::predict(const Double_t *p) const {
+	const Int_t first_bin = firstBin();
+	const Int_t last_bin = lastBin();
 
-	for(Int_t i = bin_stop; i >= bin; --i){
-		bin_content += p[i]*response_matrix.GetBinContent(i, bin);
+	if(cache_valid){
+		Bool_t changed = false;
+		for(Int_t k = first_bin; k <= last_bin && !changed; ++k){
+			changed = p[k] != cached_parameters[(size_t) k];
+		}
+		if(!changed){
+			return cached_prediction;
+		}
 	}
 
-	return bin_content;
-}
+	cached_parameters.assign((size_t) last_bin + 2, 0.);
+	cached_prediction.assign((size_t) last_bin + 2, 0.);
+	for(Int_t k = first_bin; k <= last_bin; ++k){
+		cached_parameters[(size_t) k] = p[k];
+	}
 
-Double_t FitFunction::getSimulationStatisticalUncertainty(const Int_t bin, const TH1F &params) {
-	Double_t bin_content = 0.;
+	forward(&cached_parameters[0], &cached_prediction[0]);
+	cache_valid = true;
 
-	for(Int_t i = bin_stop; i > bin; --i){
-		bin_content += params.GetBinContent(i)*response_matrix.GetBinContent(i, bin);
-	}
+	return cached_prediction;
+}
 
-	return sqrt(bin_content);
+void FitFunction::adjoint(const Double_t *residual, Double_t *gradient) const {
+	TriangularKernels::adjoint(*response_matrix, residual, gradient, firstBin(), lastBin());
 }
 
-Double_t FitFunction::getSpectrumStatisticalUncertainty(const Int_t bin, const TH1F &params, const TH1F &spectrum) {
-	Double_t bin_content = 0.;
-	Double_t spectrum_bin_content = 1.;
+void FitFunction::adjointSquared(const Double_t *weight, Double_t *result) const {
+	TriangularKernels::adjointSquared(*response_matrix, weight, result, firstBin(), lastBin());
+}
 
-	for(Int_t i = bin_stop; i >= bin; --i){
-		spectrum_bin_content = spectrum.GetBinContent(i);
-		if(spectrum_bin_content > 0.){	// Ignore bins with negative values (should not be in the original spectrum anyway) or zero content.
-			bin_content += params.GetBinContent(i)*params.GetBinContent(i)*1./spectrum_bin_content*response_matrix.GetBinContent(i, bin)*response_matrix.GetBinContent(i, bin);
-		}
-	}
+Int_t FitFunction::firstBin() const {
+	// Bin 0 is the underflow bin, whose response is zero.
+	return bin_start < 1 ? 1 : bin_start;
+}
 
-	return sqrt(bin_content);
+Int_t FitFunction::lastBin() const {
+	// The sums over the response matrix run up to bin_stop,
+	// but not beyond the last bin of the matrix.
+	return bin_stop < response_matrix->GetNbins() ? bin_stop : response_matrix->GetNbins();
 }
@@ -15,141 +15,459 @@
     along with Horst.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
-#include <TFitResult.h>
+#include <Math/Factory.h>
 
 #include "Config.h"
 #include "Fitter.h"
+#include "MLEM.h"
+#include "NNLSSolver.h"
+#include "ProjectedLBFGS.h"
+#include "ThreadPool.h"
+#include "TriangularKernels.h"
 
 using std::cout;
 using std::endl;
+using std::stringstream;
 using std::vector;
 
-void Fitter::topdown(const TH1F &spectrum, const TH2F &rema, TH1F &params, Int_t binstart, Int_t binstop){
+Fitter::Fitter(const ResponseMatrix &rema, const UInt_t binning, Int_t binstart, Int_t binstop, const FitSolver fit_solver, const UnfoldingMethod unfolding_method, const UInt_t n_iterations):
+	BINNING(binning),
+	solver(fit_solver),
+	method(unfolding_method),
+	mlem_iterations(n_iterations),
+	fitFunction(rema, binstart, binstop),
+	chi2(-1.),
+	chiSquare(nullptr)
+{
+	minimizer = ROOT::Math::Factory::CreateMinimizer("Minuit2", "Migrad");
+}
+
+Fitter::~Fitter(){
+	delete minimizer;
+	delete chiSquare;
+}
 
-	TH1F topdown_unfolded_spectrum("topdown_unfolded_spectrum", "Unfolded_Spectrum_TopDown", (Int_t) NBINS/ (Int_t) BINNING, 0., (Double_t) NBINS - 1);
+void Fitter::topdown(const TH1F &spectrum, const ResponseMatrix &rema, TH1F &params, Int_t binstart, Int_t binstop){
 
-	Double_t parameter = 0.;
-	for(Int_t i = 0; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		topdown_unfolded_spectrum.SetBinContent(i, spectrum.GetBinContent(i));
-		params.SetBinContent(i, 0.);
+	// Bin 0 is the underflow bin, whose response is zero.
+	const Int_t first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t last_bin = binstop > rema.GetNbins() ? rema.GetNbins() : binstop;
+
+	vector<Double_t> parameters((size_t) rema.GetNbins() + 2, 0.);
+	vector<Double_t> remaining_spectrum((size_t) rema.GetNbins() + 2, 0.);
+	for(Int_t i = first_bin; i <= last_bin; ++i){
+		remaining_spectrum[(size_t) i] = spectrum.GetBinContent(i);
 	}
 
-	for(Int_t i = binstop; i >= binstart; --i){
-		parameter = topdown_unfolded_spectrum.GetBinContent(i)/rema.GetBinContent(i, i);
-		params.SetBinContent(i, parameter);
+	backSubstitution(rema, remaining_spectrum, parameters, first_bin, last_bin);
 
-		for(Int_t j = binstop - 1; j >= 0; --j){
-			topdown_unfolded_spectrum.SetBinContent(j, topdown_unfolded_spectrum.GetBinContent(j) - parameter*rema.GetBinContent(i, j));
-		}
+	for(Int_t i = 0; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
+		params.SetBinContent(i, (i >= first_bin && i <= last_bin) ? parameters[(size_t) i] : 0.);
 	}
 }
 
-void Fitter::topdown(const TH1F &spectrum, const TH2F &rema, TH1F &params, Int_t binstart, Int_t binstop, TH2F &topdown_steps){
+void Fitter::topdown(const TH1F &spectrum, const ResponseMatrix &rema, TH1F &params, Int_t binstart, Int_t binstop, const std::function<void(const Int_t bin, const vector<Double_t> &remaining_spectrum)> &step){
 
-	TH1F topdown_unfolded_spectrum("topdown_unfolded_spectrum", "Unfolded_Spectrum_TopDown", (Int_t) NBINS/ (Int_t) BINNING, 0., (Double_t) NBINS - 1);
+	topdown(spectrum, rema, params, binstart, binstop);
 
-	Double_t parameter = 0.;
-	for(Int_t i = 0; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		topdown_unfolded_spectrum.SetBinContent(i, spectrum.GetBinContent(i));
-		params.SetBinContent(i, 0.);
+	// Replay the algorithm in the order of its definition: after determining the parameter of bin i,
+	// its response is subtracted from all lower bins. Only a single copy of the remaining spectrum
+	// exists, which is passed to 'step' after each bin.
+	const Int_t first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t last_bin = binstop > rema.GetNbins() ? rema.GetNbins() : binstop;
+
+	vector<Double_t> remaining_spectrum((size_t) rema.GetNbins() + 2, 0.);
+	for(Int_t i = 0; i <= last_bin; ++i){
+		remaining_spectrum[(size_t) i] = spectrum.GetBinContent(i);
 	}
 
-	for(Int_t i = binstop; i >= binstart; --i){
-		parameter = topdown_unfolded_spectrum.GetBinContent(i)/rema.GetBinContent(i, i);
-		params.SetBinContent(i, parameter);
+	for(Int_t i = last_bin; i >= first_bin; --i){
+		TriangularKernels::addRow(rema, i, -params.GetBinContent(i), &remaining_spectrum[0], first_bin);
+		step(i, remaining_spectrum);
+	}
+}
 
-		for(Int_t j = binstop - 1; j >= 0; --j){
-			topdown_unfolded_spectrum.SetBinContent(j, topdown_unfolded_spectrum.GetBinContent(j) - parameter*rema.GetBinContent(i, j));
+void Fitter::backSubstitution(const ResponseMatrix &rema, vector<Double_t> &remaining_spectrum, vector<Double_t> &parameters, const Int_t first_bin, const Int_t last_bin) const {
+
+	// Back substitution, starting from the highest bin.
+	// Instead of subtracting the response of bin i from the whole spectrum after
+	// determining parameter i (i.e. walking along row i of the matrix), subtract the
+	// responses of all higher bins from bin i before determining parameter i.
+	// This walks along column i of the matrix, which is contiguous in memory.
+	//
+	// The bins are processed in blocks of TOPDOWN_BLOCK_SIZE, from the top. When a block is
+	// reached, the parameters of all higher bins are known, and their responses are subtracted
+	// from all bins of the block at once. These are independent dot products, which are split
+	// among the threads. The remaining triangle inside the block is solved sequentially, while
+	// its part of the matrix and the parameters are still in the cache.
+	Int_t block_begin = 0;
+	for(Int_t block_stop = last_bin + 1; block_stop > first_bin; block_stop = block_begin){
+		block_begin = block_stop - TOPDOWN_BLOCK_SIZE > first_bin ? block_stop - TOPDOWN_BLOCK_SIZE : first_bin;
+
+		if(block_stop <= last_bin){
+			const Int_t n_rows = block_stop - block_begin;
+			const size_t n_known = (size_t) (last_bin - block_stop + 1);
+			const UInt_t n_tasks = ThreadPool::instance().nTasks((size_t) n_rows*n_known);
+
+			ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+				const Int_t row_begin = block_begin + (Int_t) ((Long64_t) n_rows*task/n_tasks);
+				const Int_t row_end = block_begin + (Int_t) ((Long64_t) n_rows*(task + 1)/n_tasks);
+				for(Int_t i = row_begin; i < row_end; ++i){
+					remaining_spectrum[(size_t) i] -= TriangularKernels::dot(rema.column(i) + (block_stop - i), &parameters[(size_t) block_stop], n_known);
+				}
+			});
 		}
 
-		for(Int_t j = binstop; j >= binstart; --j){
-			topdown_steps.SetBinContent(i, j, topdown_unfolded_spectrum.GetBinContent(j));
+		const Float_t *col = nullptr;
+		for(Int_t i = block_stop - 1; i >= block_begin; --i){
+			col = rema.column(i);
+			parameters[(size_t) i] = (remaining_spectrum[(size_t) i] - TriangularKernels::dot(col + 1, &parameters[(size_t) i + 1], (size_t) (block_stop - 1 - i)))/col[0];
 		}
 	}
 }
 
-void Fitter::fit(TH1F &spectrum, const TH2F &rema, const TH1F &start_params, TH1F &params, TH1F &fit_uncertainty, Int_t binstart, Int_t binstop, const Bool_t verbose, const Bool_t correlation, TMatrixDSym &correlation_matrix){
+void Fitter::fit(TH1F &spectrum, const ResponseMatrix &rema, const TH1F &start_params, TH1F &params, TH1F &fit_uncertainty, Int_t binstart, Int_t binstop, const Bool_t verbose, const Bool_t correlation, TMatrixDSym &correlation_matrix){
 
 	fitFunction.setResponseMatrix(rema);
 
-	Double_t fit_upper_limit = 10.*start_params.GetMaximum();
+	if(method == UnfoldingMethod::mlem){
+		unfoldMLEM(spectrum, rema, start_params, binstart, binstop, verbose, params, &fit_uncertainty, correlation ? &correlation_matrix : nullptr);
+		return;
+	}
 
-	for(Int_t i = 0; i <= start_params.GetNbinsX(); ++i){
-		if(i < binstart || i >= binstop){
-			fitf->FixParameter(i, 0.);
-		} else{
-			fitf->SetParameter(i, start_params.GetBinContent(i));
-			fitf->SetParLimits(i, 0., fit_upper_limit);
+	if(solver == FitSolver::nnls){
+		NormalEquations normal_equations(rema, spectrum, binstart, binstop);
+		NNLSSolver nnls(normal_equations);
+		vector<Double_t> x;
+		nnlsStartValues(normal_equations, start_params, x);
+		nnls.solve(x);
+		if(verbose){
+			cout << "> NNLS: converged after " << nnls.getNIterations() << " iterations" << endl;
 		}
-	}
 
-	TFitResultPtr fit_result;
-	if(verbose){
+		vector<Double_t> uncertainty;
+		nnls.uncertainties(uncertainty);
+
+		const Int_t first_bin = normal_equations.firstBin();
+		const UInt_t n = normal_equations.size();
+		setActiveParameters(x.data(), first_bin, n, params);
+		setActiveParameters(uncertainty.data(), first_bin, n, fit_uncertainty);
+
 		if(correlation){
-			fit_result = spectrum.Fit("fitf", "S0N", "", (UInt_t) binstart*BINNING, (UInt_t) binstop*BINNING);
-			correlation_matrix = fit_result->GetCorrelationMatrix();
-		} else{
-			spectrum.Fit("fitf", "0N", "", (UInt_t) binstart*BINNING, (UInt_t) binstop*BINNING);
+			vector<Double_t> correlations;
+			nnls.correlations(correlations);
+			setCorrelationMatrix(correlations, first_bin, n, correlation_matrix);
+		}
+
+		evaluateChiSquare(spectrum, x, first_bin, first_bin + (Int_t) n);
+		return;
+	}
+
+	if(solver == FitSolver::lbfgs){
+		vector<Double_t> x;
+		minimizeLBFGS(spectrum, start_params, binstart, binstop, verbose, x);
+
+		// The inverse of the full Hessian matrix is not available without a dense factorization.
+		// Use the curvature of the chi^2 along each parameter instead, i.e. the uncertainty of a
+		// parameter if all other parameters are kept fixed. This is a lower limit for the parabolic
+		// uncertainty. If the correlation matrix is requested, it is calculated from the dense
+		// normal equations, but the uncertainties stay the same, so that they do not depend on
+		// the '-c' option.
+		const Int_t first_bin = chiSquare->firstBin();
+		const UInt_t n = chiSquare->NDim();
+		vector<Double_t> uncertainty(n, 0.);
+		chiSquare->HessianDiagonal(&uncertainty[0]);
+		for(auto &u: uncertainty){
+			u = u > 0. ? sqrt(2./u) : 0.;
 		}
-	} else{
+
+		setActiveParameters(x.data(), first_bin, n, params);
+		setActiveParameters(uncertainty.data(), first_bin, n, fit_uncertainty);
+
 		if(correlation){
-			fit_result = spectrum.Fit("fitf", "S0QN", "", (UInt_t) binstart*BINNING, (UInt_t) binstop*BINNING);
-			correlation_matrix = fit_result->GetCorrelationMatrix();
-		} else{
-			spectrum.Fit("fitf", "0QN", "", (UInt_t) binstart*BINNING, (UInt_t) binstop*BINNING);
+			NormalEquations normal_equations(rema, spectrum, first_bin, first_bin + (Int_t) n);
+			analyticCorrelations(normal_equations, params, correlation_matrix);
 		}
+		return;
 	}
 
-	chi2 = fitf->GetChisquare();
+	minimize(spectrum, start_params, binstart, binstop, verbose);
 
-	for(Int_t i = 1; i <= start_params.GetNbinsX(); ++i){
-		params.SetBinContent(i, fitf->GetParameter(i-1));
-		fit_uncertainty.SetBinContent(i, fitf->GetParError(i-1));
+	const Int_t first_bin = chiSquare->firstBin();
+	const UInt_t n = chiSquare->NDim();
+
+	chi2 = minimizer->MinValue();
+
+	setActiveParameters(minimizer->X(), first_bin, n, params);
+
+	// Instead of the numerical second derivatives of Minuit's HESSE, which need O(n^2) evaluations
+	// of the chi^2, use the exact covariance matrix of the linear model.
+	// Minuit leaves parameters at the bound slightly positive, because of the transformation of
+	// bounded parameters. Like in LinearizedFit, the parameters at the bound are taken from the
+	// NNLS solution of the same problem instead, which starts from the Minuit result.
+	NormalEquations normal_equations(rema, spectrum, first_bin, first_bin + (Int_t) n);
+	NNLSSolver nnls(normal_equations);
+	vector<Double_t> x;
+	nnlsStartValues(normal_equations, params, x);
+	nnls.solve(x);
+
+	vector<Double_t> uncertainty;
+	nnls.uncertainties(uncertainty);
+	setActiveParameters(uncertainty.data(), normal_equations.firstBin(), normal_equations.size(), fit_uncertainty);
+
+	if(correlation){
+		vector<Double_t> correlations;
+		nnls.correlations(correlations);
+		setCorrelationMatrix(correlations, normal_equations.firstBin(), normal_equations.size(), correlation_matrix);
 	}
 }
 
-void Fitter::fit(TH1F &spectrum, const TH2F &rema, const TH1F &start_params, TH1F &params, Int_t binstart, Int_t binstop){
+void Fitter::fit(TH1F &spectrum, const ResponseMatrix &rema, const TH1F &start_params, TH1F &params, Int_t binstart, Int_t binstop){
 
 	fitFunction.setResponseMatrix(rema);
 
+	if(method == UnfoldingMethod::mlem){
+		unfoldMLEM(spectrum, rema, start_params, binstart, binstop, false, params, nullptr, nullptr);
+		return;
+	}
+
+	if(solver == FitSolver::nnls){
+		NormalEquations normal_equations(rema, spectrum, binstart, binstop);
+		NNLSSolver nnls(normal_equations);
+		vector<Double_t> x;
+		nnlsStartValues(normal_equations, start_params, x);
+		nnls.solve(x);
+
+		setActiveParameters(x.data(), normal_equations.firstBin(), normal_equations.size(), params);
+		return;
+	}
+
+	if(solver == FitSolver::lbfgs){
+		vector<Double_t> x;
+		minimizeLBFGS(spectrum, start_params, binstart, binstop, false, x);
+
+		setActiveParameters(x.data(), chiSquare->firstBin(), chiSquare->NDim(), params);
+		return;
+	}
+
+	minimize(spectrum, start_params, binstart, binstop, false);
+
+	setActiveParameters(minimizer->X(), chiSquare->firstBin(), chiSquare->NDim(), params);
+}
+
+void Fitter::minimize(const TH1F &spectrum, const TH1F &start_params, Int_t binstart, Int_t binstop, const Bool_t verbose){
+
+	delete chiSquare;
+	chiSquare = new ChiSquare(fitFunction, spectrum, binstart, binstop);
+
+	minimizer->Clear();
+	minimizer->SetPrintLevel(verbose ? 1 : 0);
+	minimizer->SetFunction(*chiSquare);
+
+	vector<Double_t> x, upper;
+	startValues(start_params, x, upper);
+
+	// Only the parameters in the active range are variables of the minimizer
+	stringstream parameter_name;
+
+	for(UInt_t k = 0; k < chiSquare->NDim(); ++k){
+		parameter_name.str("");
+		parameter_name << "p" << chiSquare->firstBin() + (Int_t) k;
+
+		minimizer->SetLimitedVariable(k, parameter_name.str(), x[k], x[k] > 0. ? 0.1*x[k] : 0.01*upper[k], 0., upper[k]);
+	}
+
+	minimizer->Minimize();
+}
+
+void Fitter::minimizeLBFGS(const TH1F &spectrum, const TH1F &start_params, Int_t binstart, Int_t binstop, const Bool_t verbose, vector<Double_t> &x){
+
+	delete chiSquare;
+	chiSquare = new ChiSquare(fitFunction, spectrum, binstart, binstop);
+
+	vector<Double_t> upper;
+	startValues(start_params, x, upper);
+	vector<Double_t> lower(x.size(), 0.);
+
+	ProjectedLBFGS lbfgs(*chiSquare);
+	lbfgs.setVerbose(verbose);
+	if(!lbfgs.minimize(x, lower, upper)){
+		cout << "> L-BFGS: Warning: No convergence after " << lbfgs.getNIterations() << " iterations." << endl;
+	}
+
+	chi2 = lbfgs.getMinValue();
+}
+
+void Fitter::startValues(const TH1F &start_params, vector<Double_t> &x, vector<Double_t> &upper) const {
+	// Start values and upper limits for the variables of the current chi^2 function,
+	// variable k belongs to bin chiSquare->firstBin() + k. The lower limit is zero.
+	const UInt_t n_parameters = chiSquare->NDim();
+	x.assign(n_parameters, 0.);
+
 	Double_t fit_upper_limit = 10.*start_params.GetMaximum();
+	if(!(fit_upper_limit > 0.)){
+		fit_upper_limit = 1.;
+	}
+	upper.assign(n_parameters, fit_upper_limit);
 
-	for(Int_t i = 0; i <= start_params.GetNbinsX(); ++i){
-		if(i < binstart || i >= binstop){
-			fitf->FixParameter(i, 0.);
-		} else{
-			fitf->SetParameter(i, start_params.GetBinContent(i));
-			fitf->SetParLimits(i, 0., fit_upper_limit);
-		}
+	Double_t start_value = 0.;
+	for(UInt_t k = 0; k < n_parameters; ++k){
+		start_value = start_params.GetBinContent(chiSquare->firstBin() + (Int_t) k);
+		x[k] = start_value > 0. ? start_value : 0.; // Also catches NaN from a vanishing diagonal element in the TopDown algorithm
+	}
+}
+
+void Fitter::nnlsStartValues(const NormalEquations &normal_equations, const TH1F &start_params, vector<Double_t> &x){
+	// Start values for the active-set algorithm, indexed like the normal equations
+	const Int_t first_bin = normal_equations.firstBin();
+	x.assign(normal_equations.size(), 0.);
+
+	Double_t start_value = 0.;
+	for(UInt_t a = 0; a < normal_equations.size(); ++a){
+		start_value = start_params.GetBinContent(first_bin + (Int_t) a);
+		x[a] = start_value > 0. ? start_value : 0.; // Also catches NaN from a vanishing diagonal element in the TopDown algorithm
+	}
+}
 
+void Fitter::unfoldMLEM(const TH1F &spectrum, const ResponseMatrix &rema, const TH1F &start_params, Int_t binstart, Int_t binstop, const Bool_t verbose, TH1F &params, TH1F *fit_uncertainty, TMatrixDSym *correlation_matrix){
+
+	MLEM mlem(rema, spectrum, binstart, binstop);
+	const Int_t first_bin = mlem.firstBin();
+	const Int_t stop_bin = mlem.stopBin();
+
+	vector<Double_t> p((size_t) rema.GetNbins() + 2, 0.);
+	for(Int_t i = first_bin; i < stop_bin; ++i){
+		p[(size_t) i] = start_params.GetBinContent(i);
 	}
 
-	spectrum.Fit("fitf", "0QN", "", (UInt_t) binstart*BINNING, (UInt_t) binstop*BINNING);
+	mlem.unfold(p, mlem_iterations);
+	if(verbose){
+		cout << "> MLEM: " << mlem_iterations << " iterations" << endl;
+	}
 
 	for(Int_t i = 1; i <= start_params.GetNbinsX(); ++i){
-		params.SetBinContent(i, fitf->GetParameter(i-1));
+		params.SetBinContent(i, i < (Int_t) p.size() ? p[(size_t) i] : 0.);
+	}
+
+	if(fit_uncertainty == nullptr){
+		return;
+	}
+
+	// The uncertainty of each parameter from the curvature of the Poisson likelihood,
+	// with all other parameters fixed. The MLEM result has no simple covariance matrix,
+	// because it is usually stopped long before convergence.
+	vector<Double_t> prediction;
+	vector<Double_t> fisher_diagonal;
+	mlem.forward(p, prediction);
+	mlem.fisherDiagonal(prediction, fisher_diagonal);
+
+	for(Int_t i = 1; i <= start_params.GetNbinsX(); ++i){
+		fit_uncertainty->SetBinContent(i, (i < (Int_t) fisher_diagonal.size() && fisher_diagonal[(size_t) i] > 0.) ? 1./sqrt(fisher_diagonal[(size_t) i]) : 0.);
+	}
+
+	if(correlation_matrix != nullptr){
+		// The Fisher information matrix R W R^T with W = 1/prediction has the form of the normal
+		// equations of a fit to the predicted spectrum.
+		TH1F predicted_spectrum("mlem_prediction", "MLEM Prediction", (Int_t) NBINS/ (Int_t) BINNING, 0., (Double_t) NBINS - 1);
+		for(Int_t j = first_bin; j < stop_bin; ++j){
+			predicted_spectrum.SetBinContent(j, prediction[(size_t) j]);
+		}
+
+		NormalEquations normal_equations(rema, predicted_spectrum, binstart, binstop);
+		analyticCorrelations(normal_equations, params, *correlation_matrix);
+	}
+
+	vector<Double_t> x(p.begin() + first_bin, p.begin() + stop_bin);
+	evaluateChiSquare(spectrum, x, first_bin, stop_bin);
+}
+
+void Fitter::evaluateChiSquare(const TH1F &spectrum, const vector<Double_t> &x, Int_t binstart, Int_t binstop){
+	// x holds the parameters of the bins [binstart, binstop)
+	delete chiSquare;
+	chiSquare = new ChiSquare(fitFunction, spectrum, binstart, binstop);
+
+	vector<Double_t> parameters(chiSquare->NDim(), 0.);
+	for(size_t k = 0; k < parameters.size(); ++k){
+		const size_t a = (size_t) (chiSquare->firstBin() - binstart) + k;
+		parameters[k] = a < x.size() ? x[a] : 0.;
+	}
+	chi2 = (*chiSquare)(parameters.empty() ? nullptr : &parameters[0]);
+}
+
+void Fitter::analyticCorrelations(const NormalEquations &normal_equations, const TH1F &params, TMatrixDSym &correlation_matrix) const {
+	// The chi^2 of the fit is quadratic in the parameters, so the covariance matrix of the parameters
+	// which are not at their bound of zero is the inverse of their normal matrix G = R W R^T.
+	// Parameters at the bound are uncorrelated.
+	const Int_t first_bin = normal_equations.firstBin();
+	const UInt_t n = normal_equations.size();
+
+	vector<UInt_t> free_parameters;
+	for(UInt_t a = 0; a < n; ++a){
+		if(params.GetBinContent(first_bin + (Int_t) a) > 0. && normal_equations.G(a, a) > 0.){
+			free_parameters.push_back(a);
+		}
+	}
+	Cholesky cholesky(normal_equations);
+	cholesky.appendAll(free_parameters);
+
+	vector<Double_t> correlations;
+	cholesky.correlations(correlations);
+	setCorrelationMatrix(correlations, first_bin, n, correlation_matrix);
+}
+
+void Fitter::setActiveParameters(const Double_t *x, const Int_t first_bin, const UInt_t n, TH1F &hist) const {
+	// Parameters outside of the active range are zero
+	for(Int_t i = 1; i <= hist.GetNbinsX(); ++i){
+		hist.SetBinContent(i, 0.);
+	}
+	for(UInt_t a = 0; a < n; ++a){
+		hist.SetBinContent(first_bin + (Int_t) a, x[a]);
 	}
 }
 
-void Fitter::fittedFEP(const TH1F &params, const TH2F &rema, TH1F &fitted_FEP){
+void Fitter::setCorrelationMatrix(const vector<Double_t> &correlations, const Int_t first_bin, const UInt_t n, TMatrixDSym &correlation_matrix) const {
+	const Int_t n_parameters = (Int_t) (NBINS/BINNING);
+	for(Int_t i = 0; i < n_parameters; ++i){
+		for(Int_t j = 0; j < n_parameters; ++j){
+			correlation_matrix(i, j) = i == j ? 1. : 0.;
+		}
+	}
+
+	// Element (a, b) of correlations belongs to the bins first_bin + a and first_bin + b,
+	// row and column k of the correlation matrix to bin k + 1
+	for(UInt_t a = 0; a < n; ++a){
+		for(UInt_t b = 0; b < n; ++b){
+			correlation_matrix(first_bin - 1 + (Int_t) a, first_bin - 1 + (Int_t) b) = correlations[(size_t) a*n + b];
+		}
+	}
+}
+
+void Fitter::fittedFEP(const TH1F &params, const ResponseMatrix &rema, TH1F &fitted_FEP){
 	for(Int_t i = 1; i <= (Int_t) NBINS/ (Int_t) BINNING; ++i){
 		fitted_FEP.SetBinContent(i, params.GetBinContent(i)*rema.GetBinContent(i, i));
 	}
 }
 
-void Fitter::fittedSpectrum(const TH1F &params, const TH2F &rema, TH1F &fitted_spectrum){
+void Fitter::fittedSpectrum(const TH1F &params, const ResponseMatrix &rema, TH1F &fitted_spectrum){
 
-	vector<Double_t> parameters((long unsigned int) NBINS/ (long unsigned int) BINNING + 1);
-	for(Int_t i = 1; i <= (Int_t) NBINS/ (Int_t) BINNING; ++i)
-		parameters[(long unsigned int) i] = params.GetBinContent(i);
+	const Int_t n = (Int_t) NBINS/ (Int_t) BINNING;
+	const Int_t last_bin = fitFunction.lastBin() < rema.GetNbins() ? fitFunction.lastBin() : rema.GetNbins();
 
-	Double_t bin = 0.;
-	for(Int_t i = 1; i <= (Int_t) NBINS/ (Int_t) BINNING; ++i){
-		bin = (Double_t) i*BINNING;
-		fitted_spectrum.SetBinContent(i, fitFunction(&bin, &parameters[0]));
+	vector<Double_t> parameters((size_t) n + 2, 0.);
+	vector<Double_t> prediction((size_t) n + 2, 0.);
+	for(Int_t i = 1; i <= n; ++i)
+		parameters[(size_t) i] = params.GetBinContent(i);
+
+	// The response in each bin includes all parameters up to the end of the fit range
+	TriangularKernels::forward(rema, &parameters[0], &prediction[0], 1, last_bin);
+
+	for(Int_t i = 1; i <= n; ++i){
+		fitted_spectrum.SetBinContent(i, prediction[(size_t) i]);
 	}
 }
 
@@ -0,0 +1,162 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+
+#include "LinearizedFit.h"
+#include "NNLSSolver.h"
+#include "TriangularKernels.h"
+
+// Tolerance for the release of a parameter from its bound, relative to the largest absolute value of
+// the right-hand side
+const Double_t LINEARIZEDFIT_RELEASE_TOLERANCE = 1e-10;
+
+LinearizedFit::LinearizedFit(const ResponseMatrix &rema, const TH1F &spectrum, const TH1F &params, const Int_t binstart, const Int_t binstop):
+	response_matrix(rema),
+	normal_equations(rema, spectrum, binstart, binstop),
+	cholesky(normal_equations),
+	first_bin(normal_equations.firstBin()),
+	last_bin(normal_equations.firstBin() + (Int_t) normal_equations.size() - 1)
+{
+	const UInt_t n = normal_equations.size();
+	fixed_parameters.assign(n, 0.);
+	fixed_contribution.assign(n, 0.);
+	at_bound.assign(n, false);
+	weight.assign((size_t) rema.GetNbins() + 2, 0.);
+
+	Double_t bin_content = 0.;
+	for(Int_t j = first_bin; j <= last_bin; ++j){
+		bin_content = spectrum.GetBinContent(j);
+		if(bin_content != 0.){
+			weight[(size_t) j] = 1./fabs(bin_content);
+		}
+	}
+
+	vector<Double_t> p0(n, 0.);
+	for(UInt_t a = 0; a < n; ++a){
+		p0[a] = params.GetBinContent(first_bin + (Int_t) a);
+	}
+	NNLSSolver nnls(normal_equations);
+	nnls.solve(p0);
+	start_parameters = p0;
+
+	Double_t p = 0.;
+	vector<UInt_t> free_set;
+	for(UInt_t a = 0; a < n; ++a){
+		if(!(normal_equations.G(a, a) > 0.)){
+			// No response in the fit range, so the NNLS solver has set the parameter to zero
+			p = params.GetBinContent(first_bin + (Int_t) a);
+			fixed_parameters[a] = p > 0. ? p : 0.;
+		} else if(p0[a] > 0.){
+			free_set.push_back(a);
+		} else{
+			at_bound[a] = true;
+		}
+	}
+
+	// Parameters which cannot be added to the factorization are kept fixed as well
+	cholesky.appendAll(free_set);
+	vector<Bool_t> factorized(n, false);
+	for(auto a: cholesky.getIndices()){
+		factorized[a] = true;
+	}
+	for(auto a: free_set){
+		if(!factorized[a]){
+			fixed_parameters[a] = p0[a];
+		}
+	}
+
+	const Double_t *G_row = nullptr;
+	for(UInt_t a = 0; a < n; ++a){
+		G_row = normal_equations.row(a);
+		for(UInt_t b = 0; b < n; ++b){
+			fixed_contribution[a] += G_row[b]*fixed_parameters[b];
+		}
+	}
+}
+
+Bool_t LinearizedFit::solve(const TH1F &fluctuated_spectrum, TH1F &params) const {
+	const UInt_t n = normal_equations.size();
+
+	// Right-hand side R W s', indexed by the bin number
+	vector<Double_t> weighted_spectrum((size_t) response_matrix.GetNbins() + 2, 0.);
+	vector<Double_t> rhs_bins((size_t) response_matrix.GetNbins() + 2, 0.);
+	for(Int_t j = first_bin; j <= last_bin; ++j){
+		weighted_spectrum[(size_t) j] = weight[(size_t) j]*fluctuated_spectrum.GetBinContent(j);
+	}
+	if(n > 0){
+		TriangularKernels::adjoint(response_matrix, &weighted_spectrum[0], &rhs_bins[0], first_bin, last_bin);
+	}
+
+	vector<Double_t> rhs(n, 0.);
+	Double_t rhs_norm = 0.;
+	for(UInt_t a = 0; a < n; ++a){
+		rhs[a] = rhs_bins[(size_t) first_bin + a] - fixed_contribution[a];
+		rhs_norm = fabs(rhs_bins[(size_t) first_bin + a]) > rhs_norm ? fabs(rhs_bins[(size_t) first_bin + a]) : rhs_norm;
+	}
+
+	vector<Double_t> x(fixed_parameters);
+	cholesky.solve(rhs, x);
+
+	Bool_t linear = true;
+	for(auto index: cholesky.getIndices()){
+		if(x[index] < 0.){
+			linear = false;
+			break;
+		}
+	}
+
+	// A parameter at its bound stays there if the chi^2 does not decrease when it is increased,
+	// i.e. if (R W s' - G x)_a <= 0.
+	const Double_t *G_row = nullptr;
+	Double_t gradient = 0.;
+	for(UInt_t a = 0; linear && a < n; ++a){
+		if(!at_bound[a]){
+			continue;
+		}
+		G_row = normal_equations.row(a);
+		gradient = rhs_bins[(size_t) first_bin + a];
+		for(UInt_t b = 0; b < n; ++b){
+			gradient -= G_row[b]*x[b];
+		}
+		if(gradient > LINEARIZEDFIT_RELEASE_TOLERANCE*rhs_norm){
+			linear = false;
+		}
+	}
+
+	if(!linear){
+		// The NNLS solver has its own factorization, so this is safe for concurrent calls as well
+		for(UInt_t a = 0; a < n; ++a){
+			rhs[a] = rhs_bins[(size_t) first_bin + a];
+		}
+		x = start_parameters;
+		NNLSSolver nnls(normal_equations);
+		nnls.solve(rhs, x);
+		for(UInt_t a = 0; a < n; ++a){
+			if(!(normal_equations.G(a, a) > 0.)){
+				x[a] = fixed_parameters[a];
+			}
+		}
+	}
+
+	for(Int_t i = 1; i <= params.GetNbinsX(); ++i){
+		params.SetBinContent(i, (i >= first_bin && i <= last_bin) ? x[(size_t) (i - first_bin)] : 0.);
+	}
+
+	return linear;
+}
@@ -0,0 +1,101 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include "MLEM.h"
+#include "TriangularKernels.h"
+
+MLEM::MLEM(const ResponseMatrix &rema, const TH1F &spectrum, const Int_t binstart, const Int_t binstop):
+	response_matrix(rema)
+{
+	// Bin 0 is the underflow bin, whose response is zero.
+	first_bin = binstart < 1 ? 1 : binstart;
+	stop_bin = binstop > rema.GetNbins() + 1 ? rema.GetNbins() + 1 : binstop;
+	if(stop_bin < first_bin){
+		stop_bin = first_bin;
+	}
+
+	// Negative bin contents, for example after a background subtraction, are not compatible with
+	// Poisson statistics.
+	data.assign((size_t) rema.GetNbins() + 2, 0.);
+	Double_t bin_content = 0.;
+	for(Int_t j = first_bin; j < stop_bin; ++j){
+		bin_content = spectrum.GetBinContent(j);
+		data[(size_t) j] = bin_content > 0. ? bin_content : 0.;
+	}
+
+	vector<Double_t> ones(data.size(), 1.);
+	adjoint(ones, sensitivity);
+}
+
+void MLEM::unfold(vector<Double_t> &p, const UInt_t n_iterations){
+	vector<Double_t> prediction;
+	vector<Double_t> correction;
+
+	Double_t total_counts = 0.;
+	Double_t total_sensitivity = 0.;
+	for(Int_t i = first_bin; i < stop_bin; ++i){
+		total_counts += data[(size_t) i];
+		total_sensitivity += sensitivity[(size_t) i];
+	}
+	const Double_t flat = total_sensitivity > 0. ? total_counts/total_sensitivity : 0.;
+
+	for(size_t i = 0; i < p.size(); ++i){
+		if((Int_t) i < first_bin || (Int_t) i >= stop_bin || !(sensitivity[i] > 0.)){
+			p[i] = 0.;
+		} else if(!(p[i] > 0.)){ // Also catches NaN
+			p[i] = flat;
+		}
+	}
+
+	for(UInt_t iteration = 0; iteration < n_iterations; ++iteration){
+		forward(p, prediction);
+		for(Int_t j = first_bin; j < stop_bin; ++j){
+			prediction[(size_t) j] = prediction[(size_t) j] > 0. ? data[(size_t) j]/prediction[(size_t) j] : 0.;
+		}
+
+		adjoint(prediction, correction);
+		for(Int_t i = first_bin; i < stop_bin; ++i){
+			if(sensitivity[(size_t) i] > 0.){
+				p[(size_t) i] *= correction[(size_t) i]/sensitivity[(size_t) i];
+			}
+		}
+	}
+}
+
+void MLEM::forward(const vector<Double_t> &p, vector<Double_t> &prediction) const {
+	prediction.assign(data.size(), 0.);
+	TriangularKernels::forward(response_matrix, &p[0], &prediction[0], first_bin, stop_bin - 1);
+}
+
+void MLEM::adjoint(const vector<Double_t> &r, vector<Double_t> &result) const {
+	result.assign(data.size(), 0.);
+	TriangularKernels::adjoint(response_matrix, &r[0], &result[0], first_bin, stop_bin - 1);
+}
+
+void MLEM::fisherDiagonal(const vector<Double_t> &prediction, vector<Double_t> &diagonal) const {
+	diagonal.assign(data.size(), 0.);
+
+	vector<Double_t> inverse_prediction(data.size(), 0.);
+	for(Int_t j = first_bin; j < stop_bin; ++j){
+		if(prediction[(size_t) j] > 0.){
+			inverse_prediction[(size_t) j] = 1./prediction[(size_t) j];
+		}
+	}
+
+	TriangularKernels::adjointSquared(response_matrix, &inverse_prediction[0], &diagonal[0], first_bin, stop_bin - 1);
+}
@@ -0,0 +1,181 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "MergingDigest.h"
+
+using std::cout;
+using std::endl;
+
+// Number of buffered samples, in units of the compression, after which the buffer is merged with
+// the centroids
+const Double_t MERGINGDIGEST_BUFFER_FACTOR = 5.;
+
+MergingDigest::MergingDigest(const Double_t compression_factor):
+	compression(compression_factor),
+	total_weight(0.),
+	minimum(0.),
+	maximum(0.)
+{}
+
+void MergingDigest::add(const Double_t x, const Double_t weight){
+	if(total_weight == 0. || x < minimum){
+		minimum = x;
+	}
+	if(total_weight == 0. || x > maximum){
+		maximum = x;
+	}
+	total_weight += weight;
+
+	buffer.push_back({x, weight});
+	if((Double_t) buffer.size() >= MERGINGDIGEST_BUFFER_FACTOR*compression){
+		compress();
+	}
+}
+
+void MergingDigest::merge(const MergingDigest &other){
+	if(other.total_weight == 0.){
+		return;
+	}
+	const Double_t other_minimum = other.minimum;
+	const Double_t other_maximum = other.maximum;
+
+	for(auto centroid: other.centroids){
+		add(centroid.mean, centroid.weight);
+	}
+	for(auto centroid: other.buffer){
+		add(centroid.mean, centroid.weight);
+	}
+
+	// The extreme samples of 'other' may be hidden in centroids
+	minimum = other_minimum < minimum ? other_minimum : minimum;
+	maximum = other_maximum > maximum ? other_maximum : maximum;
+}
+
+void MergingDigest::compress(){
+	if(buffer.empty()){
+		return;
+	}
+
+	buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+	std::stable_sort(buffer.begin(), buffer.end(), [](const Centroid &a, const Centroid &b){ return a.mean < b.mean; });
+
+	// Inverse of the scale function, q(k) = (sin(2 pi k/compression) + 1)/2
+	const Double_t k_scale = compression/(2.*M_PI);
+	auto weight_limit = [&](const Double_t weight_so_far){
+		const Double_t k = k_scale*asin(2.*weight_so_far/total_weight - 1.) + 1.;
+		return k >= 0.25*compression ? total_weight : 0.5*(sin(k/k_scale) + 1.)*total_weight;
+	};
+
+	centroids.clear();
+	Centroid current = buffer[0];
+	Double_t weight_so_far = 0.;
+	Double_t limit = weight_limit(weight_so_far);
+
+	for(size_t i = 1; i < buffer.size(); ++i){
+		if(weight_so_far + current.weight + buffer[i].weight <= limit){
+			current.weight += buffer[i].weight;
+			current.mean += (buffer[i].mean - current.mean)*buffer[i].weight/current.weight;
+		} else{
+			weight_so_far += current.weight;
+			centroids.push_back(current);
+			limit = weight_limit(weight_so_far);
+			current = buffer[i];
+		}
+	}
+	centroids.push_back(current);
+
+	buffer.clear();
+}
+
+Double_t MergingDigest::quantile(const Double_t q) const {
+	if(total_weight == 0.){
+		return 0.;
+	}
+	if(buffer.empty()){
+		return sortedQuantile(q);
+	}
+
+	MergingDigest compressed(*this);
+	compressed.compress();
+	return compressed.sortedQuantile(q);
+}
+
+Double_t MergingDigest::sortedQuantile(const Double_t q) const {
+	// Interpolate linearly between the centers of neighbouring centroids. Below the center of the
+	// first and above the center of the last centroid, interpolate to the minimum and maximum.
+	const Double_t index = (q < 0. ? 0. : (q > 1. ? 1. : q))*total_weight;
+
+	const Centroid &first = centroids.front();
+	if(index < 0.5*first.weight){
+		return minimum + (first.mean - minimum)*index/(0.5*first.weight);
+	}
+
+	Double_t weight_so_far = 0.5*first.weight;
+	Double_t step = 0.;
+	for(size_t i = 0; i + 1 < centroids.size(); ++i){
+		step = 0.5*(centroids[i].weight + centroids[i + 1].weight);
+		if(weight_so_far + step > index){
+			return centroids[i].mean + (centroids[i + 1].mean - centroids[i].mean)*(index - weight_so_far)/step;
+		}
+		weight_so_far += step;
+	}
+
+	const Centroid &last = centroids.back();
+	return last.mean + (maximum - last.mean)*(index - weight_so_far)/(0.5*last.weight);
+}
+
+void MergingDigest::appendState(vector<Double_t> &state) const {
+	state.insert(state.end(), {compression, total_weight, minimum, maximum, (Double_t) centroids.size(), (Double_t) buffer.size()});
+	for(auto array: {&centroids, &buffer}){
+		for(auto centroid: *array){
+			state.push_back(centroid.mean);
+			state.push_back(centroid.weight);
+		}
+	}
+}
+
+size_t MergingDigest::restoreState(const vector<Double_t> &state, size_t position){
+	if(position + 6 > state.size()){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Invalid state of the digest. Aborting ..." << endl;
+		abort();
+	}
+	compression = state[position];
+	total_weight = state[position + 1];
+	minimum = state[position + 2];
+	maximum = state[position + 3];
+	centroids.resize((size_t) state[position + 4]);
+	buffer.resize((size_t) state[position + 5]);
+	position += 6;
+
+	if(position + 2*(centroids.size() + buffer.size()) > state.size()){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Invalid state of the digest. Aborting ..." << endl;
+		abort();
+	}
+	for(auto array: {&centroids, &buffer}){
+		for(auto &centroid: *array){
+			centroid.mean = state[position++];
+			centroid.weight = state[position++];
+		}
+	}
+
+	return position;
+}
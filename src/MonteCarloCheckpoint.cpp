@@ -0,0 +1,109 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include <iostream>
+
+#include <TFile.h>
+#include <TSystem.h>
+
+#include "MonteCarloCheckpoint.h"
+
+using std::cout;
+using std::endl;
+
+void MonteCarloCheckpoint::write(const RunningStatistics &statistics, RunningCovariance *covariance) const {
+	const string temporary_filename = filename + ".tmp";
+
+	vector<Double_t> state;
+	statistics.getState(state);
+	vector<Double_t> covariance_state;
+	if(covariance != nullptr){
+		covariance->getState(covariance_state);
+	}
+
+	TFile file(temporary_filename.c_str(), "RECREATE");
+	if(file.IsZombie()){
+		cout << "> Warning: Could not create checkpoint file " << temporary_filename << ". Continuing without checkpoint ..." << endl;
+		return;
+	}
+	file.WriteObject(&run_parameters, "run_parameters");
+	file.WriteObject(&state, "mc_statistics");
+	if(covariance != nullptr){
+		file.WriteObject(&covariance_state, "mc_covariance");
+	}
+	file.Close();
+
+	if(rename(temporary_filename.c_str(), filename.c_str()) != 0){
+		cout << "> Warning: Could not rename " << temporary_filename << " to " << filename << ". Continuing without checkpoint ..." << endl;
+	}
+}
+
+Bool_t MonteCarloCheckpoint::read(RunningStatistics &statistics, RunningCovariance *covariance) const {
+	// AccessPathName() returns true if the file does NOT exist
+	if(gSystem->AccessPathName(filename.c_str())){
+		return false;
+	}
+
+	TFile file(filename.c_str(), "READ");
+	vector<Double_t> *parameters = nullptr;
+	vector<Double_t> *state = nullptr;
+	file.GetObject("run_parameters", parameters);
+	file.GetObject("mc_statistics", state);
+	if(file.IsZombie() || parameters == nullptr || state == nullptr){
+		cout << "Error: Could not read checkpoint file " << filename << ". Aborting ..." << endl;
+		abort();
+	}
+	if(*parameters != run_parameters){
+		cout << "Error: Checkpoint file " << filename << " was written by a run with different options. Aborting ..." << endl;
+		abort();
+	}
+
+	RunningStatistics checkpoint_statistics(*state);
+	if(checkpoint_statistics.firstBin() != statistics.firstBin() || checkpoint_statistics.lastBin() != statistics.lastBin()){
+		cout << "Error: Checkpoint file " << filename << " contains the statistics of the bins [" << checkpoint_statistics.firstBin() << ", " << checkpoint_statistics.lastBin() << "] instead of [" << statistics.firstBin() << ", " << statistics.lastBin() << "]. Aborting ..." << endl;
+		abort();
+	}
+	statistics = checkpoint_statistics;
+
+	// Merging into an empty accumulator restores the state exactly
+	if(covariance != nullptr){
+		vector<Double_t> *covariance_state = nullptr;
+		file.GetObject("mc_covariance", covariance_state);
+		if(covariance_state == nullptr){
+			cout << "Error: Checkpoint file " << filename << " does not contain the covariance of the Monte-Carlo iterations. Aborting ..." << endl;
+			abort();
+		}
+		RunningCovariance checkpoint_covariance(*covariance_state);
+		if(checkpoint_covariance.getNSamples() != statistics.getNSamples()){
+			cout << "Error: Checkpoint file " << filename << " contains the covariance of " << checkpoint_covariance.getNSamples() << " instead of " << statistics.getNSamples() << " Monte-Carlo iterations. Aborting ..." << endl;
+			abort();
+		}
+		covariance->merge(checkpoint_covariance);
+		delete covariance_state;
+	}
+
+	delete parameters;
+	delete state;
+
+	return true;
+}
+
+void MonteCarloCheckpoint::remove() const {
+	::remove(filename.c_str());
+}
@@ -15,42 +15,161 @@
     along with Horst.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
+#include <iostream>
+#include <sstream>
 #include <vector>
 
 #include "Math/DistFunc.h"
 
 #include "Config.h"
 #include "MonteCarloUncertainty.h"
+#include "Reconstructor.h"
+#include "ThreadPool.h"
+#include "Uncertainty.h"
 
 #define USE_POISSON 1
 
+using std::cout;
+using std::endl;
+using std::stringstream;
 using std::vector;
 
 using ROOT::Math::normal_cdf;
 using ROOT::Math::normal_quantile;
+using ROOT::Math::poisson_cdf;
 
-void MonteCarloUncertainty::evaluateMeanAndStd(TH1F &mc_mean, TH1F &mc_standard_deviation, const vector<TH1F*> &mc_histograms, const Int_t binstart, const Int_t binstop){
-	const UInt_t nrandom = (UInt_t) mc_histograms.size();
+// Product of two histograms, bin by bin
+static void multiply(const TH1F &factor_1, const TH1F &factor_2, TH1F &product){
+	for(Int_t i = 1; i <= product.GetNbinsX(); ++i){
+		product.SetBinContent(i, factor_1.GetBinContent(i)*factor_2.GetBinContent(i));
+	}
+}
 
-	vector<Double_t> values(nrandom, 0.);
+void MonteCarloUncertainty::evaluateMeanAndStd(TH1F &mc_mean, TH1F &mc_standard_deviation, const RunningStatistics &mc_statistics) const {
+	// Bins outside of the range of mc_statistics are zero
+	for(Int_t i = 1; i <= (Int_t) NBINS / (Int_t) BINNING; ++i){
+		mc_mean.SetBinContent(i, mc_statistics.mean(i));
+		mc_standard_deviation.SetBinContent(i, mc_statistics.standardDeviation(i));
+	}
+}
 
-	for(UInt_t i = 1; i <= NBINS / BINNING; ++i){
-		if(i < (UInt_t) binstart || i > (UInt_t) binstop){
-			mc_mean.SetBinContent((Int_t) i, 0.);
-			mc_standard_deviation.SetBinContent((Int_t) i, 0.);
-		} else{
-			for(UInt_t j = 0; j < nrandom; ++j){
-				values[j] = mc_histograms[j]->GetBinContent((Int_t) i);
-			}
+void MonteCarloUncertainty::evaluateMinAndMax(TH1F &mc_min, TH1F &mc_max, const RunningStatistics &mc_statistics) const {
+	for(Int_t i = 1; i <= (Int_t) NBINS / (Int_t) BINNING; ++i){
+		mc_min.SetBinContent(i, mc_statistics.minimum(i));
+		mc_max.SetBinContent(i, mc_statistics.maximum(i));
+	}
+}
+
+void MonteCarloUncertainty::evaluatePercentile(TH1F &mc_percentile, const RunningStatistics &mc_statistics, const Double_t percentile) const {
+	for(Int_t i = 1; i <= (Int_t) NBINS / (Int_t) BINNING; ++i){
+		mc_percentile.SetBinContent(i, mc_statistics.quantile(i, 0.01*percentile));
+	}
+}
+
+void MonteCarloUncertainty::evaluateCovariance(vector<Double_t> &mc_covariance, const RunningCovariance &mc_statistics, const TH1F &factors) const {
+	mc_covariance.assign({(Double_t) mc_statistics.firstBin(), (Double_t) mc_statistics.lastBin()});
+	const size_t n = (size_t) (mc_statistics.lastBin() - mc_statistics.firstBin() + 1);
+	mc_covariance.reserve(2 + n*(n + 1)/2);
+	for(Int_t i = mc_statistics.firstBin(); i <= mc_statistics.lastBin(); ++i){
+		for(Int_t j = mc_statistics.firstBin(); j <= i; ++j){
+			mc_covariance.push_back(mc_statistics.covariance(i, j)*factors.GetBinContent(i)*factors.GetBinContent(j));
+		}
+	}
+}
+
+void MonteCarloUncertainty::evaluateResults(MonteCarloResults &results, const RunningStatistics &mc_statistics, const RunningCovariance *mc_covariance, const vector<Double_t> &percentiles, const TH1F &fit_algorithm_uncertainty, const TH1F &response_matrix_diagonal, const TH1F &n_simulated_particles) const {
+	const Int_t nbins = (Int_t) NBINS / (Int_t) BINNING;
+	const Double_t max_bin = (Double_t) NBINS - 1.;
+	Reconstructor reconstructor(BINNING);
+	Uncertainty uncertainty(BINNING);
+
+	results.mc_fit_params_mean = TH1F("mc_fit_params_mean", "MC Fit Parameters", nbins, 0., max_bin);
+	results.mc_fit_params_uncertainty = TH1F("mc_fit_params_uncertainty", "MC Fit Parameters Uncertainty", nbins, 0., max_bin);
+	results.mc_fit_total_uncertainty = TH1F("mc_fit_total_uncertainty", "MC Fit Total Uncertainty", nbins, 0., max_bin);
+	results.mc_fit_params_min = TH1F("mc_fit_params_min", "MC Fit Parameters Minimum", nbins, 0., max_bin);
+	results.mc_fit_params_max = TH1F("mc_fit_params_max", "MC Fit Parameters Maximum", nbins, 0., max_bin);
+
+	results.mc_fit_FEP = TH1F("mc_fit_FEP", "MC Fit FEP", nbins, 0., max_bin);
+	results.mc_fit_FEP_uncertainty = TH1F("mc_fit_FEP_uncertainty", "MC Fit FEP Uncertainty", nbins, 0., max_bin);
+	results.mc_FEP_uncertainty_low = TH1F("mc_FEP_uncertainty_low", "MC Fit FEP Uncertainty lower Limit", nbins, 0., max_bin);
+	results.mc_FEP_uncertainty_up = TH1F("mc_FEP_uncertainty_up", "MC Fit FEP Uncertainty upper Limit", nbins, 0., max_bin);
+
+	results.mc_spectrum_reconstructed = TH1F("mc_spectrum_reconstructed", "MC Reconstructed Spectrum", nbins, 0., max_bin);
+	results.mc_reconstruction_uncertainty = TH1F("mc_reconstruction_uncertainty", "MC Reconstruction Uncertainty", nbins, 0., max_bin);
+	results.mc_reconstruction_uncertainty_low = TH1F("mc_reconstruction_uncertainty_low", "MC Reconstruction Uncertainty lower Limit", nbins, 0., max_bin);
+	results.mc_reconstruction_uncertainty_up = TH1F("mc_reconstruction_uncertainty_up", "MC Reconstruction Uncertainty upper Limit", nbins, 0., max_bin);
+
+	evaluateMeanAndStd(results.mc_fit_params_mean, results.mc_fit_params_uncertainty, mc_statistics);
+	evaluateMinAndMax(results.mc_fit_params_min, results.mc_fit_params_max, mc_statistics);
+
+	// Use the fit uncertainty from a single fit as an estimate for the uncertainty
+	// of the fitting algorithm
+	const vector<const TH1F*> uncertainties = {&fit_algorithm_uncertainty, &results.mc_fit_params_uncertainty};
+	uncertainty.getTotalUncertainty(uncertainties, results.mc_fit_total_uncertainty);
+
+	multiply(results.mc_fit_params_mean, response_matrix_diagonal, results.mc_fit_FEP);
+	multiply(results.mc_fit_params_uncertainty, response_matrix_diagonal, results.mc_fit_FEP_uncertainty);
+	uncertainty.getLowerAndUpperLimit(results.mc_fit_FEP, results.mc_fit_FEP_uncertainty, results.mc_FEP_uncertainty_low, results.mc_FEP_uncertainty_up, true);
+
+	reconstructor.reconstruct(results.mc_fit_params_mean, n_simulated_particles, results.mc_spectrum_reconstructed);
+	reconstructor.reconstruct(results.mc_fit_total_uncertainty, n_simulated_particles, results.mc_reconstruction_uncertainty);
+	uncertainty.getLowerAndUpperLimit(results.mc_spectrum_reconstructed, results.mc_reconstruction_uncertainty, results.mc_reconstruction_uncertainty_low, results.mc_reconstruction_uncertainty_up, true);
+
+	// The FEP and the reconstructed spectrum are the fit parameters, multiplied by nonnegative
+	// factors for each bin, so their percentiles are the multiplied percentiles of the parameters.
+	results.mc_fit_params_percentiles.clear();
+	results.mc_fit_FEP_percentiles.clear();
+	results.mc_spectrum_reconstructed_percentiles.clear();
+	for(auto percentile: percentiles){
+		results.mc_fit_params_percentiles.push_back(TH1F(getPercentileName("mc_fit_params", percentile), "MC Fit Parameters Percentile", nbins, 0., max_bin));
+		results.mc_fit_FEP_percentiles.push_back(TH1F(getPercentileName("mc_fit_FEP", percentile), "MC Fit FEP Percentile", nbins, 0., max_bin));
+		results.mc_spectrum_reconstructed_percentiles.push_back(TH1F(getPercentileName("mc_spectrum_reconstructed", percentile), "MC Reconstructed Spectrum Percentile", nbins, 0., max_bin));
+
+		evaluatePercentile(results.mc_fit_params_percentiles.back(), mc_statistics, percentile);
+		multiply(results.mc_fit_params_percentiles.back(), response_matrix_diagonal, results.mc_fit_FEP_percentiles.back());
+		reconstructor.reconstruct(results.mc_fit_params_percentiles.back(), n_simulated_particles, results.mc_spectrum_reconstructed_percentiles.back());
+	}
+
+	results.mc_reconstruction_covariance.clear();
+	if(mc_covariance != nullptr){
+		evaluateCovariance(results.mc_reconstruction_covariance, *mc_covariance, n_simulated_particles);
+	}
+}
 
-			Double_t mean = get_mean(values);
-			mc_mean.SetBinContent((Int_t) i, mean);
-			mc_standard_deviation.SetBinContent((Int_t) i, get_stdev(values, mean));
+void MonteCarloUncertainty::evaluateTotalUncertainty(TH1F &fit_total_uncertainty, TH1F &reconstruction_uncertainty, const MonteCarloResults &results, const TH1F &fit_algorithm_uncertainty, const TH1F &fit_algorithm_FEP_uncertainty, const TH1F &fit_simulation_uncertainty, const TH1F &fit_spectrum_uncertainty, const TH1F &response_matrix_diagonal, const TH1F &n_simulated_particles) const {
+	Reconstructor reconstructor(BINNING);
+	Uncertainty uncertainty(BINNING);
+
+	const vector<const TH1F*> uncertainties = {&fit_algorithm_uncertainty, &results.mc_fit_params_uncertainty, &fit_algorithm_FEP_uncertainty, &fit_simulation_uncertainty, &fit_spectrum_uncertainty};
+	uncertainty.getTotalUncertainty(uncertainties, fit_total_uncertainty);
+
+	reconstructor.uncertainty(fit_total_uncertainty, response_matrix_diagonal, n_simulated_particles, reconstruction_uncertainty);
+}
+
+TString MonteCarloUncertainty::getPercentileName(const TString &name, const Double_t percentile) const {
+	stringstream percentile_name;
+	percentile_name << name << "_p" << percentile;
+
+	TString result = percentile_name.str().c_str();
+	result.ReplaceAll(".", "_");
+	return result;
+}
+
+Double_t MonteCarloUncertainty::evaluatePrecision(const RunningStatistics &mc_statistics) const {
+	Double_t precision = 0.;
+	Double_t standard_deviation = 0.;
+	for(Int_t i = mc_statistics.firstBin(); i <= mc_statistics.lastBin(); ++i){
+		standard_deviation = mc_statistics.standardDeviation(i);
+		if(standard_deviation > 0. && mc_statistics.standardDeviationError(i) > precision*standard_deviation){
+			precision = mc_statistics.standardDeviationError(i)/standard_deviation;
 		}
 	}
+
+	return precision;
 }
 
-void MonteCarloUncertainty::apply_fluctuations(TH1F &modified_spectrum, const TH1F &spectrum, const Int_t binstart, const Int_t binstop){
+void MonteCarloUncertainty::apply_fluctuations(TH1F &modified_spectrum, const TH1F &spectrum, const Int_t binstart, const Int_t binstop, const UInt_t iteration) const {
 	// The content of each bin in a measured spectrum is a random sample from a distribution.
 	// The experiment is assumed to be a statistical counting experiment of uncorrelated events, where the underlying distribution is a Poissonian distribution P(lambda) with mean value lambda.
 	// To simulate the influence of counting statistics on the measured spectrum, assume that the actually measured value of a bin is the mean value lambda of the Poissonian distribution, and sample a new value from it.
@@ -61,6 +180,9 @@ void MonteCarloUncertainty::apply_fluctuations(TH1F &modified_spectrum, const TH
 	// In the history of 'horst', the normal distribution was used first.
 	// However, it was decided to switch to the more general Poissonian distribution.
 	// The old implementation is kept here and it can be switched on using the preprocessor variable USE_POISSON
+	PhiloxRandom random_generator(SEED, get_key(iteration), MC_SPECTRUM_STREAM);
+	const SobolSequence sobol(SEED, MC_SPECTRUM_STREAM);
+
 	Double_t mu = 0.;
 #ifndef USE_POISSON
 	Double_t sigma = 0.;
@@ -78,50 +200,139 @@ void MonteCarloUncertainty::apply_fluctuations(TH1F &modified_spectrum, const TH
 		} else{
 #ifndef USE_POISSON
 			sigma = sqrt(mu);
-			modified_spectrum.SetBinContent(i, get_positive_random_normal(mu, sigma));
+			modified_spectrum.SetBinContent(i, get_positive_random_normal(get_uniform(random_generator, sobol, iteration, (UInt_t) i), mu, sigma));
 #endif
 #ifdef USE_POISSON
-			modified_spectrum.SetBinContent(i, get_random_poisson((Int_t) round(mu)));
+			if(SAMPLING == MCSampling::random){
+				modified_spectrum.SetBinContent(i, get_random_poisson(random_generator, (Int_t) round(mu)));
+			} else{
+				modified_spectrum.SetBinContent(i, get_poisson_quantile(get_uniform(random_generator, sobol, iteration, (UInt_t) i), round(mu)));
+			}
 #endif
 		}
 	}
 }
 
-void MonteCarloUncertainty::apply_fluctuations(TH2F &modified_response_matrix, const TH2F &response_matrix, const Int_t binstart, const Int_t binstop){
-	Double_t mu = 0.;
+void MonteCarloUncertainty::apply_fluctuations(ResponseMatrix &modified_response_matrix, const ResponseMatrix &response_matrix, const Int_t binstart, const Int_t binstop, const UInt_t iteration) const {
+	if(modified_response_matrix.GetNbins() != response_matrix.GetNbins()){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Response matrices with " << modified_response_matrix.GetNbins() << " and " << response_matrix.GetNbins() << " bins. Aborting ..." << endl;
+		abort();
+	}
 
-	for(Int_t i = binstart; i <= binstop; ++i){
-		for(Int_t j = binstart; j <= binstop; ++j){
-			mu = response_matrix.GetBinContent(i, j);
-			if(mu == 0.){
-				modified_response_matrix.SetBinContent(i, j, 0.);
-			} else{
-				modified_response_matrix.SetBinContent(i, j, get_random_poisson((Int_t) round(mu)));
+	const Int_t first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t last_bin = binstop > response_matrix.GetNbins() ? response_matrix.GetNbins() : binstop;
+	if(last_bin < first_bin){
+		return;
+	}
+
+	// Columns are independent, because each of them has its own substream
+	const size_t n_columns = (size_t) (last_bin - first_bin + 1);
+	const UInt_t n_tasks = ThreadPool::instance().nTasks(n_columns*(n_columns + 1)/2);
+
+	ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+		const Int_t column_begin = first_bin + (Int_t) (n_columns*task/n_tasks);
+		const Int_t column_end = first_bin + (Int_t) (n_columns*(task + 1)/n_tasks);
+
+		vector<Int_t> large_elements(n_columns, 0);
+		vector<Double_t> normal(n_columns, 0.);
+
+		const Float_t *column = nullptr;
+		Float_t *modified_column = nullptr;
+		Double_t mu = 0.;
+		Double_t sample = 0.;
+		size_t n_large = 0;
+
+		// Only the lower triangle j <= i is stored, the upper triangle is zero.
+		// column[k] is the element (j + k, j).
+		for(Int_t j = column_begin; j < column_end; ++j){
+			PhiloxRandom random_generator(SEED, get_key(iteration), MC_MATRIX_STREAM, (UInt_t) j);
+			column = response_matrix.column(j);
+			modified_column = modified_response_matrix.column(j);
+			n_large = 0;
+
+			if(SAMPLING != MCSampling::random){
+				const SobolSequence sobol(SEED, MC_MATRIX_STREAM, (UInt_t) j);
+				Double_t uniform = 0.;
+				for(Int_t k = 0; k <= last_bin - j; ++k){
+					mu = (Double_t) column[k];
+					if(mu == 0.){
+						modified_column[k] = 0.f;
+						continue;
+					}
+					uniform = get_uniform(random_generator, sobol, iteration, (UInt_t) k);
+					if(NORMAL_THRESHOLD > 0. && mu >= NORMAL_THRESHOLD){
+						sample = round(mu + sqrt(mu)*normal_quantile(uniform, 1.));
+						modified_column[k] = sample > 0. ? (Float_t) sample : 0.f;
+					} else{
+						modified_column[k] = (Float_t) get_poisson_quantile(uniform, mu);
+					}
+				}
+				continue;
+			}
+
+			for(Int_t k = 0; k <= last_bin - j; ++k){
+				mu = (Double_t) column[k];
+				if(mu == 0.){
+					modified_column[k] = 0.f;
+				} else if(NORMAL_THRESHOLD > 0. && mu >= NORMAL_THRESHOLD){
+					large_elements[n_large++] = k;
+				} else{
+					modified_column[k] = (Float_t) random_generator.Poisson(mu);
+				}
+			}
+
+			if(n_large > 0){
+				random_generator.Normal(&normal[0], n_large);
+				for(size_t a = 0; a < n_large; ++a){
+					mu = (Double_t) column[large_elements[a]];
+					sample = round(mu + sqrt(mu)*normal[a]);
+					modified_column[large_elements[a]] = sample > 0. ? (Float_t) sample : 0.f;
+				}
 			}
 		}
-	}
+	});
 }
 
-Double_t MonteCarloUncertainty::get_positive_random_normal(Double_t mu, Double_t sigma) const {
-	return normal_quantile(random_generator->Uniform(normal_cdf(-mu/sigma), 1.), sigma) + mu;
+Double_t MonteCarloUncertainty::get_uniform(PhiloxRandom &random_generator, const SobolSequence &sobol, const UInt_t iteration, const UInt_t dimension) const {
+	switch(SAMPLING){
+		case MCSampling::antithetic:
+			return iteration % 2 == 0 ? random_generator.Uniform() : 1. - random_generator.Uniform();
+		case MCSampling::sobol:
+			return sobol.Uniform(iteration, dimension, random_generator.Uniform());
+		default:
+			return random_generator.Uniform();
+	}
 }
 
-Double_t MonteCarloUncertainty::get_random_poisson(Int_t mean) const {
-	return random_generator->Poisson(mean);
+Double_t MonteCarloUncertainty::get_positive_random_normal(const Double_t uniform, Double_t mu, Double_t sigma) const {
+	const Double_t lower_limit = normal_cdf(-mu/sigma);
+	return normal_quantile(lower_limit + (1. - lower_limit)*uniform, sigma) + mu;
 }
 
-Double_t MonteCarloUncertainty::get_mean(vector<Double_t> &values) const {
-	Double_t sum = 0.;
-	for(auto v: values)
-		sum += v;
-
-	return sum / (Double_t) values.size();
+Double_t MonteCarloUncertainty::get_random_poisson(PhiloxRandom &random_generator, Int_t mean) const {
+	return random_generator.Poisson(mean);
 }
 
-Double_t MonteCarloUncertainty::get_stdev(vector<Double_t> &values, Double_t mean) const {
-	Double_t sum = 0.;
-	for(auto v: values)
-		sum += (v - mean)*(v - mean);
+Double_t MonteCarloUncertainty::get_poisson_quantile(const Double_t uniform, const Double_t mean) const {
+	// Smallest k with P(X <= k) >= uniform. The search starts at the mode, so that the number of
+	// steps is of the order of sqrt(mean).
+	Double_t k = floor(mean);
+	Double_t probability = exp(k*log(mean) - mean - lgamma(k + 1.));
+	Double_t cdf = poisson_cdf((UInt_t) k, mean);
+
+	if(uniform <= cdf){
+		while(k > 0. && uniform <= cdf - probability){
+			cdf -= probability;
+			probability *= k/mean;
+			k -= 1.;
+		}
+	} else{
+		while(uniform > cdf && probability > 0.){
+			k += 1.;
+			probability *= mean/k;
+			cdf += probability;
+		}
+	}
 
-	return sqrt(sum / (Double_t) values.size());
+	return k;
 }
@@ -0,0 +1,154 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TH1.h>
+
+#include "MonteCarloWriter.h"
+
+using std::cout;
+using std::endl;
+using std::unique_lock;
+
+MonteCarloWriter::MonteCarloWriter(const char* file_name, const vector<string> &directories, const Int_t nbins, const Double_t maximum_bin, const UInt_t interval):
+	filename(file_name),
+	directory_names(directories),
+	n_bins(nbins),
+	max_bin(maximum_bin),
+	flush_interval(interval),
+	queue(MC_WRITER_QUEUE_LENGTH),
+	queue_begin(0),
+	queue_size(0),
+	stop(false),
+	flush_requested(false)
+{
+	for(auto &entry: queue){
+		entry.content.assign((size_t) n_bins + 2, 0.);
+	}
+
+	writer = thread(&MonteCarloWriter::run, this);
+}
+
+MonteCarloWriter::~MonteCarloWriter(){
+	close();
+}
+
+void MonteCarloWriter::write(const UInt_t directory, const vector<Double_t> &content, const string &name){
+	unique_lock<mutex> lock(queue_mutex);
+	queue_not_full.wait(lock, [this]{ return queue_size < queue.size(); });
+
+	Entry &entry = queue[(queue_begin + queue_size) % queue.size()];
+	entry.directory = directory;
+	entry.name = name;
+	for(Int_t i = 0; i <= n_bins + 1; ++i){
+		entry.content[(size_t) i] = content[(size_t) i];
+	}
+	++queue_size;
+
+	lock.unlock();
+	queue_not_empty.notify_one();
+}
+
+void MonteCarloWriter::flush(){
+	unique_lock<mutex> lock(queue_mutex);
+	flush_requested = true;
+	queue_not_empty.notify_one();
+	flushed.wait(lock, [this]{ return !flush_requested; });
+}
+
+void MonteCarloWriter::close(){
+	{
+		unique_lock<mutex> lock(queue_mutex);
+		stop = true;
+	}
+	queue_not_empty.notify_one();
+
+	if(writer.joinable()){
+		writer.join();
+	}
+}
+
+void MonteCarloWriter::run(){
+	// All ROOT objects of the writer live in this thread
+	TFile file(filename.c_str(), "UPDATE");
+	if(file.IsZombie()){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Could not open output file " << filename << ". Aborting ..." << endl;
+		abort();
+	}
+
+	vector<TDirectory*> directories(directory_names.size(), nullptr);
+	for(size_t d = 0; d < directory_names.size(); ++d){
+		directories[d] = file.GetDirectory(directory_names[d].c_str());
+		if(directories[d] == nullptr){
+			cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Directory " << directory_names[d] << " does not exist in output file " << filename << ". Aborting ..." << endl;
+			abort();
+		}
+	}
+
+	TH1F histogram("mc_histogram", "mc_histogram", n_bins, 0., max_bin);
+	histogram.SetDirectory(nullptr);
+
+	UInt_t n_written = 0;
+
+	while(true){
+		unique_lock<mutex> lock(queue_mutex);
+		queue_not_empty.wait(lock, [this]{ return queue_size > 0 || stop || flush_requested; });
+		if(queue_size == 0){
+			if(flush_requested){
+				lock.unlock();
+				file.Write();
+				file.Flush();
+				lock.lock();
+				flush_requested = false;
+				lock.unlock();
+				flushed.notify_all();
+				continue;
+			}
+			break;
+		}
+
+		// The entry stays in the queue until it has been written, so that write() does not
+		// overwrite it, but the lock is released while ROOT writes to the file.
+		Entry &entry = queue[queue_begin];
+		lock.unlock();
+
+		for(Int_t i = 0; i <= n_bins + 1; ++i){
+			histogram.SetBinContent(i, entry.content[(size_t) i]);
+		}
+		histogram.SetName(entry.name.c_str());
+		histogram.SetTitle(entry.name.c_str());
+		directories[entry.directory]->WriteTObject(&histogram);
+
+		++n_written;
+		if(flush_interval > 0 && n_written % flush_interval == 0){
+			file.Write();
+			file.Flush();
+		}
+
+		lock.lock();
+		queue_begin = (queue_begin + 1) % (UInt_t) queue.size();
+		--queue_size;
+		lock.unlock();
+		queue_not_full.notify_one();
+	}
+
+	file.Close();
+}
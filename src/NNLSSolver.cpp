@@ -0,0 +1,179 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+#include <limits>
+
+#include "NNLSSolver.h"
+
+using std::numeric_limits;
+
+void NNLSSolver::solve(vector<Double_t> &x){
+	solve(normal_equations.getRightHandSide(), x);
+}
+
+void NNLSSolver::solve(const vector<Double_t> &rhs, vector<Double_t> &x){
+	const UInt_t n = normal_equations.size();
+
+	// Parameters without any response in the fit range (G_ii == 0) are undetermined.
+	// Keep them at zero.
+	vector<Bool_t> passive(n, false);
+	vector<Bool_t> excluded(n, false);
+	vector<UInt_t> start_set;
+	for(UInt_t i = 0; i < n; ++i){
+		if(!(normal_equations.G(i, i) > 0.)){
+			excluded[i] = true;
+		} else if(x[i] > 0.){
+			start_set.push_back(i);
+		}
+	}
+	cholesky.clear();
+	cholesky.appendAll(start_set);
+	for(auto i: cholesky.getIndices()){
+		passive[i] = true;
+	}
+	for(UInt_t i = 0; i < n; ++i){
+		if(!passive[i]){
+			x[i] = 0.;
+		}
+	}
+
+	Double_t tolerance = 0.;
+	for(UInt_t i = 0; i < n; ++i){
+		tolerance = fabs(rhs[i]) > tolerance ? fabs(rhs[i]) : tolerance;
+	}
+	tolerance *= 1e3*numeric_limits<Double_t>::epsilon()*(n > 0 ? n : 1);
+
+	vector<Double_t> z(n, 0.);
+	vector<Double_t> w(n, 0.);
+	vector<UInt_t> passive_set;
+	UInt_t released = n;
+	const UInt_t max_iterations = 3*n + 10;
+	n_iterations = 0;
+
+	while(n_iterations < max_iterations){
+		++n_iterations;
+
+		// Inner loop: solve the unconstrained problem on the passive set and move back
+		// towards the previous feasible point until all passive variables are positive.
+		while(true){
+			passive_set = cholesky.getIndices();
+			cholesky.solve(rhs, z);
+
+			// Step length to the first passive variable which hits the bound
+			Double_t alpha = 1.;
+			Double_t ratio = 0.;
+			UInt_t blocking = n;
+			for(auto i: passive_set){
+				if(z[i] <= 0.){
+					ratio = x[i] - z[i] > 0. ? x[i]/(x[i] - z[i]) : 0.;
+					if(blocking == n || ratio < alpha){
+						alpha = ratio;
+						blocking = i;
+					}
+				}
+			}
+
+			if(blocking == n){
+				for(auto i: passive_set){
+					x[i] = z[i];
+				}
+				break;
+			}
+
+			for(auto i: passive_set){
+				x[i] += alpha*(z[i] - x[i]);
+			}
+			x[blocking] = 0.;
+			for(auto i: passive_set){
+				if(x[i] <= 0.){
+					x[i] = 0.;
+					passive[i] = false;
+					cholesky.remove(i);
+				}
+			}
+			// A variable which was just released, but immediately hits the bound again,
+			// only does so because of rounding errors. Do not try to release it again.
+			if(alpha == 0. && blocking == released){
+				excluded[blocking] = true;
+			}
+		}
+
+		// Outer loop: release the variable at the bound whose gradient points most strongly
+		// into the feasible region.
+		negativeHalfGradient(rhs, x, w);
+
+		UInt_t release = n;
+		Double_t max_w = tolerance;
+		for(UInt_t i = 0; i < n; ++i){
+			if(!passive[i] && !excluded[i] && w[i] > max_w){
+				max_w = w[i];
+				release = i;
+			}
+		}
+
+		if(release == n){
+			break;
+		}
+
+		if(cholesky.append(release)){
+			passive[release] = true;
+			released = release;
+		} else{
+			// Linearly dependent on the passive set, cannot be released.
+			excluded[release] = true;
+		}
+	}
+}
+
+void NNLSSolver::negativeHalfGradient(const vector<Double_t> &rhs, const vector<Double_t> &x, vector<Double_t> &w) const {
+	// -1/2 d chi^2 / dp = h - G p
+	const UInt_t n = normal_equations.size();
+	const Double_t *G_row = nullptr;
+	Double_t sum = 0.;
+
+	for(UInt_t a = 0; a < n; ++a){
+		G_row = normal_equations.row(a);
+		sum = rhs[a];
+		for(UInt_t b = 0; b < n; ++b){
+			sum -= G_row[b]*x[b];
+		}
+		w[a] = sum;
+	}
+}
+
+void NNLSSolver::uncertainties(vector<Double_t> &uncertainty) const {
+	const UInt_t n = normal_equations.size();
+	uncertainty.assign(n, 0.);
+
+	for(UInt_t i = 0; i < n; ++i){
+		if(normal_equations.G(i, i) > 0.){
+			uncertainty[i] = 1./sqrt(normal_equations.G(i, i));
+		}
+	}
+
+	vector<Double_t> diagonal;
+	cholesky.inverseDiagonal(diagonal);
+	const vector<UInt_t> &passive_set = cholesky.getIndices();
+	for(size_t k = 0; k < passive_set.size(); ++k){
+		uncertainty[passive_set[k]] = sqrt(diagonal[k]);
+	}
+}
+
+void NNLSSolver::correlations(vector<Double_t> &correlation) const {
+	cholesky.correlations(correlation);
+}
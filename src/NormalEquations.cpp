@@ -0,0 +1,64 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <cmath>
+
+#include "NormalEquations.h"
+#include "TriangularKernels.h"
+
+NormalEquations::NormalEquations(const ResponseMatrix &rema, const TH1F &spectrum, const Int_t binstart, const Int_t binstop){
+	// Bin 0 is the underflow bin, whose response is zero.
+	first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t stop_bin = binstop > rema.GetNbins() + 1 ? rema.GetNbins() + 1 : binstop;
+	n = stop_bin > first_bin ? (UInt_t) (stop_bin - first_bin) : 0;
+
+	normal_matrix.assign((size_t) n*n, 0.);
+	right_hand_side.assign(n, 0.);
+
+	// Column j of the response matrix contributes w_j R(i, j) R(k, j) to all G(i, k) with i, k >= j,
+	// i.e. it is a weighted rank-1 update of the lower right block of G.
+	// Accumulate the lower triangle and mirror it afterwards.
+	const Float_t *col = nullptr;
+	Double_t bin_content = 0.;
+	Double_t weight = 0.;
+	Double_t weighted_element = 0.;
+	Double_t *G_row = nullptr;
+
+	for(UInt_t c = 0; c < n; ++c){
+		const Int_t j = first_bin + (Int_t) c;
+		bin_content = spectrum.GetBinContent(j);
+		if(bin_content == 0.){
+			continue;
+		}
+		weight = 1./fabs(bin_content);
+		col = rema.column(j);
+
+		for(UInt_t a = c; a < n; ++a){
+			weighted_element = weight*col[a - c];
+			right_hand_side[a] += weighted_element*bin_content;
+
+			G_row = &normal_matrix[(size_t) a*n];
+			TriangularKernels::axpy(weighted_element, col, G_row + c, a - c + 1);
+		}
+	}
+
+	for(UInt_t a = 0; a < n; ++a){
+		for(UInt_t b = 0; b < a; ++b){
+			normal_matrix[(size_t) b*n + a] = normal_matrix[(size_t) a*n + b];
+		}
+	}
+}
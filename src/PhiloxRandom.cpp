@@ -0,0 +1,159 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+
+#include "PhiloxRandom.h"
+
+namespace{
+	const UInt_t PHILOX_M0 = 0xD2511F53;
+	const UInt_t PHILOX_M1 = 0xCD9E8D57;
+	const UInt_t PHILOX_W0 = 0x9E3779B9;
+	const UInt_t PHILOX_W1 = 0xBB67AE85;
+	const UInt_t PHILOX_ROUNDS = 10;
+
+	// Below this mean, the Poisson distribution is sampled by multiplying uniform random numbers
+	const Double_t POISSON_SMALL_MEAN = 10.;
+
+	inline void mulhilo(const UInt_t a, const UInt_t b, UInt_t &hi, UInt_t &lo){
+		const ULong64_t product = (ULong64_t) a*b;
+		hi = (UInt_t) (product >> 32);
+		lo = (UInt_t) product;
+	}
+}
+
+PhiloxRandom::PhiloxRandom(const UInt_t seed, const UInt_t iteration, const UInt_t stream, const UInt_t substream):
+	position(4)
+{
+	key[0] = seed;
+	key[1] = iteration;
+	counter[0] = 0;
+	counter[1] = 0;
+	counter[2] = stream;
+	counter[3] = substream;
+	block[0] = block[1] = block[2] = block[3] = 0;
+}
+
+Double_t PhiloxRandom::Uniform(){
+	const ULong64_t high = next() >> 5; // 27 bits
+	const ULong64_t low = next() >> 6; // 26 bits
+
+	return ((Double_t) ((high << 26) | low) + 0.5)/9007199254740992.; // 2^53
+}
+
+Double_t PhiloxRandom::Poisson(const Double_t mean){
+	if(!(mean > 0.)){
+		return 0.;
+	}
+
+	if(mean < POISSON_SMALL_MEAN){
+		// Multiplication method (D. E. Knuth, The Art of Computer Programming, Vol. 2)
+		const Double_t limit = exp(-mean);
+		Double_t product = Uniform();
+		Double_t k = 0.;
+		while(product > limit){
+			product *= Uniform();
+			k += 1.;
+		}
+		return k;
+	}
+
+	// Transformed rejection with squeeze, PTRS (W. Hörmann, Insurance: Mathematics and Economics
+	// 12 (1993) 39), which is exact and needs about 1.1 pairs of uniform random numbers per sample.
+	const Double_t sqrt_mean = sqrt(mean);
+	const Double_t log_mean = log(mean);
+	const Double_t b = 0.931 + 2.53*sqrt_mean;
+	const Double_t a = -0.059 + 0.02483*b;
+	const Double_t inverse_alpha = 1.1239 + 1.1328/(b - 3.4);
+	const Double_t v_r = 0.9277 - 3.6224/(b - 2.);
+
+	Double_t u = 0., v = 0., us = 0., k = 0.;
+	while(true){
+		u = Uniform() - 0.5;
+		v = Uniform();
+		us = 0.5 - fabs(u);
+		k = floor((2.*a/us + b)*u + mean + 0.43);
+		if(us >= 0.07 && v <= v_r){
+			return k;
+		}
+		if(k < 0. || (us < 0.013 && v > us)){
+			continue;
+		}
+		if(log(v) + log(inverse_alpha) - log(a/(us*us) + b) <= -mean + k*log_mean - lgamma(k + 1.)){
+			return k;
+		}
+	}
+}
+
+void PhiloxRandom::Normal(Double_t *normal, const size_t n){
+	// Draw all uniform random numbers first, so that the transformation is a simple loop
+	for(size_t k = 0; k < n; ++k){
+		normal[k] = Uniform();
+	}
+	Double_t last_uniform = 0.;
+	if(n % 2 == 1){
+		last_uniform = Uniform();
+	}
+
+	Double_t radius = 0.;
+	Double_t angle = 0.;
+	for(size_t k = 0; k + 1 < n; k += 2){
+		radius = sqrt(-2.*log(normal[k]));
+		angle = 2.*M_PI*normal[k + 1];
+		normal[k] = radius*cos(angle);
+		normal[k + 1] = radius*sin(angle);
+	}
+	if(n % 2 == 1){
+		normal[n - 1] = sqrt(-2.*log(normal[n - 1]))*cos(2.*M_PI*last_uniform);
+	}
+}
+
+UInt_t PhiloxRandom::next(){
+	if(position == 4){
+		generateBlock();
+		position = 0;
+	}
+	return block[position++];
+}
+
+void PhiloxRandom::generateBlock(){
+	UInt_t c[4] = {counter[0], counter[1], counter[2], counter[3]};
+	UInt_t k[2] = {key[0], key[1]};
+	UInt_t hi0 = 0, lo0 = 0, hi1 = 0, lo1 = 0;
+
+	for(UInt_t round = 0; round < PHILOX_ROUNDS; ++round){
+		mulhilo(PHILOX_M0, c[0], hi0, lo0);
+		mulhilo(PHILOX_M1, c[2], hi1, lo1);
+		c[0] = hi1^c[1]^k[0];
+		c[1] = lo1;
+		c[2] = hi0^c[3]^k[1];
+		c[3] = lo0;
+		k[0] += PHILOX_W0;
+		k[1] += PHILOX_W1;
+	}
+
+	block[0] = c[0];
+	block[1] = c[1];
+	block[2] = c[2];
+	block[3] = c[3];
+
+	// The lower half of the counter numbers the blocks within a stream
+	if(++counter[0] == 0){
+		++counter[1];
+	}
+}
@@ -0,0 +1,277 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+#include "ProjectedLBFGS.h"
+
+using std::cout;
+using std::endl;
+using std::numeric_limits;
+
+ProjectedLBFGS::ProjectedLBFGS(const ROOT::Math::IGradientFunctionMultiDim &func, const UInt_t mem):
+	function(func),
+	memory(mem > 0 ? mem : 1),
+	gradient_tolerance(1e-8),
+	function_tolerance(1e-12),
+	max_iterations(10000),
+	verbose(false),
+	min_value(0.),
+	n_iterations(0),
+	n_evaluations(0),
+	n_corrections(0),
+	newest(0)
+{}
+
+Bool_t ProjectedLBFGS::minimize(vector<Double_t> &x, const vector<Double_t> &lower, const vector<Double_t> &upper){
+	const UInt_t n = function.NDim();
+
+	for(UInt_t k = 0; k < n; ++k){
+		if(!(x[k] >= lower[k])){ // Also catches NaN
+			x[k] = lower[k];
+		} else if(x[k] > upper[k]){
+			x[k] = upper[k];
+		}
+	}
+
+	s.assign(memory, vector<Double_t>(n, 0.));
+	y.assign(memory, vector<Double_t>(n, 0.));
+	rho.assign(memory, 0.);
+	n_corrections = 0;
+	newest = 0;
+
+	vector<Double_t> gradient(n, 0.);
+	vector<Double_t> x_new(n, 0.);
+	vector<Double_t> gradient_new(n, 0.);
+	vector<Double_t> d(n, 0.);
+	vector<Bool_t> free(n, false);
+
+	Double_t value = 0.;
+	function.FdF(&x[0], value, &gradient[0]);
+	n_evaluations = 1;
+	n_iterations = 0;
+
+	const Double_t initial_gradient_norm = projectedGradientNorm(x, gradient, lower, upper);
+	Bool_t converged = !(initial_gradient_norm > 0.);
+
+	Double_t value_new = 0.;
+	Double_t directional_derivative = 0.;
+	Double_t decrease = 0.;
+	Double_t alpha = 0.;
+	Double_t norm = 0.;
+	Bool_t accepted = false;
+
+	while(!converged && n_iterations < max_iterations){
+		++n_iterations;
+
+		// Hold variables at a bound if the gradient points out of the feasible region
+		for(UInt_t k = 0; k < n; ++k){
+			free[k] = lower[k] < upper[k] && !(x[k] <= lower[k] && gradient[k] > 0.) && !(x[k] >= upper[k] && gradient[k] < 0.);
+		}
+
+		direction(gradient, free, d);
+		directional_derivative = 0.;
+		for(UInt_t k = 0; k < n; ++k){
+			directional_derivative += gradient[k]*d[k];
+		}
+
+		// The quasi-Newton matrix restricted to the free variables is not guaranteed to be positive
+		// definite. Fall back to the steepest descent if it does not give a descent direction.
+		if(!(directional_derivative < 0.)){
+			n_corrections = 0;
+			direction(gradient, free, d);
+			directional_derivative = 0.;
+			for(UInt_t k = 0; k < n; ++k){
+				directional_derivative += gradient[k]*d[k];
+			}
+			if(!(directional_derivative < 0.)){
+				converged = true;
+				break;
+			}
+		}
+
+		// Without curvature information, the steepest-descent step has no natural length.
+		alpha = 1.;
+		if(n_corrections == 0){
+			norm = 0.;
+			for(UInt_t k = 0; k < n; ++k){
+				norm += d[k]*d[k];
+			}
+			alpha = 1./sqrt(norm);
+		}
+
+		// Backtracking line search along the projected path x(alpha) = P(x + alpha*d)
+		accepted = false;
+		for(UInt_t step = 0; step < 40; ++step){
+			for(UInt_t k = 0; k < n; ++k){
+				x_new[k] = x[k] + alpha*d[k];
+				if(x_new[k] < lower[k]){
+					x_new[k] = lower[k];
+				} else if(x_new[k] > upper[k]){
+					x_new[k] = upper[k];
+				}
+			}
+
+			function.FdF(&x_new[0], value_new, &gradient_new[0]);
+			++n_evaluations;
+
+			decrease = 0.;
+			for(UInt_t k = 0; k < n; ++k){
+				decrease += gradient[k]*(x_new[k] - x[k]);
+			}
+
+			if(value_new <= value + 1e-4*decrease){
+				accepted = true;
+				break;
+			}
+
+			// Minimum of the quadratic interpolation along d, safeguarded
+			norm = value_new - value - alpha*directional_derivative;
+			if(norm > 0.){
+				norm = -0.5*directional_derivative*alpha*alpha/norm;
+				alpha = norm < 0.1*alpha ? 0.1*alpha : (norm > 0.5*alpha ? 0.5*alpha : norm);
+			} else{
+				alpha *= 0.5;
+			}
+		}
+
+		if(!accepted){
+			if(n_corrections > 0){
+				// Try again with the steepest descent
+				n_corrections = 0;
+				continue;
+			}
+			break;
+		}
+
+		// Store the correction pair if it satisfies the curvature condition
+		Double_t sy = 0.;
+		Double_t yy = 0.;
+		for(UInt_t k = 0; k < n; ++k){
+			sy += (x_new[k] - x[k])*(gradient_new[k] - gradient[k]);
+			yy += (gradient_new[k] - gradient[k])*(gradient_new[k] - gradient[k]);
+		}
+		if(sy > numeric_limits<Double_t>::epsilon()*yy){
+			newest = n_corrections == 0 ? 0 : (newest + 1) % memory;
+			for(UInt_t k = 0; k < n; ++k){
+				s[newest][k] = x_new[k] - x[k];
+				y[newest][k] = gradient_new[k] - gradient[k];
+			}
+			rho[newest] = 1./sy;
+			if(n_corrections < memory){
+				++n_corrections;
+			}
+		}
+
+		decrease = (value - value_new)/fmax(fmax(fabs(value), fabs(value_new)), 1.);
+
+		x.swap(x_new);
+		gradient.swap(gradient_new);
+		value = value_new;
+
+		if(verbose && n_iterations % 100 == 0){
+			cout << "> L-BFGS: iteration " << n_iterations << ", f = " << value << endl;
+		}
+
+		if(projectedGradientNorm(x, gradient, lower, upper) <= gradient_tolerance*initial_gradient_norm || decrease <= function_tolerance){
+			converged = true;
+		}
+	}
+
+	min_value = value;
+
+	if(verbose){
+		cout << "> L-BFGS: " << (converged ? "converged" : "stopped") << " after " << n_iterations << " iterations and " << n_evaluations << " function evaluations, f = " << min_value << endl;
+	}
+
+	return converged;
+}
+
+Double_t ProjectedLBFGS::projectedGradientNorm(const vector<Double_t> &x, const vector<Double_t> &gradient, const vector<Double_t> &lower, const vector<Double_t> &upper) const {
+	Double_t max_norm = 0.;
+	Double_t projected = 0.;
+
+	for(size_t k = 0; k < x.size(); ++k){
+		projected = x[k] - gradient[k];
+		if(projected < lower[k]){
+			projected = lower[k];
+		} else if(projected > upper[k]){
+			projected = upper[k];
+		}
+		max_norm = fabs(projected - x[k]) > max_norm ? fabs(projected - x[k]) : max_norm;
+	}
+
+	return max_norm;
+}
+
+void ProjectedLBFGS::direction(const vector<Double_t> &gradient, const vector<Bool_t> &free, vector<Double_t> &d) const {
+	// Two-loop recursion for d = -H g, restricted to the free variables
+	const size_t n = gradient.size();
+	for(size_t k = 0; k < n; ++k){
+		d[k] = free[k] ? -gradient[k] : 0.;
+	}
+
+	if(n_corrections == 0){
+		return;
+	}
+
+	vector<Double_t> alpha(n_corrections, 0.);
+	UInt_t index = 0;
+	Double_t sum = 0.;
+
+	for(UInt_t c = 0; c < n_corrections; ++c){
+		index = (newest + memory - c) % memory;
+		sum = 0.;
+		for(size_t k = 0; k < n; ++k){
+			sum += s[index][k]*d[k];
+		}
+		alpha[c] = rho[index]*sum;
+		for(size_t k = 0; k < n; ++k){
+			if(free[k]){
+				d[k] -= alpha[c]*y[index][k];
+			}
+		}
+	}
+
+	// Initial matrix H_0 = gamma*I with gamma = s^T y/y^T y of the newest pair
+	Double_t yy = 0.;
+	for(size_t k = 0; k < n; ++k){
+		yy += y[newest][k]*y[newest][k];
+	}
+	const Double_t gamma = 1./(rho[newest]*yy);
+	for(size_t k = 0; k < n; ++k){
+		d[k] *= gamma;
+	}
+
+	Double_t beta = 0.;
+	for(UInt_t c = n_corrections; c-- > 0;){
+		index = (newest + memory - c) % memory;
+		sum = 0.;
+		for(size_t k = 0; k < n; ++k){
+			sum += y[index][k]*d[k];
+		}
+		beta = rho[index]*sum;
+		for(size_t k = 0; k < n; ++k){
+			if(free[k]){
+				d[k] += (alpha[c] - beta)*s[index][k];
+			}
+		}
+	}
+}
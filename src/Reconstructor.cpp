@@ -15,10 +15,15 @@
     along with Horst.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <vector>
+
 #include <TRandom3.h>
 
 #include "Config.h"
 #include "Reconstructor.h"
+#include "TriangularKernels.h"
+
+using std::vector;
 
 void Reconstructor::reconstruct(const TH1F &params, const TH1F &n_simulated_particles, TH1F &reconstructed_spectrum){
 
@@ -27,51 +32,53 @@ void Reconstructor::reconstruct(const TH1F &params, const TH1F &n_simulated_part
 	}
 }
 
-void Reconstructor::uncertainty(const TH1F &total_uncertainty, const TH2F &rema, const TH1F &n_simulated_particles, TH1F &reconstruction_uncertainty){
+void Reconstructor::uncertainty(const TH1F &total_uncertainty, const TH1F &response_matrix_diagonal, const TH1F &n_simulated_particles, TH1F &reconstruction_uncertainty){
 
 	for(Int_t i = 1; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		reconstruction_uncertainty.SetBinContent(i, total_uncertainty.GetBinContent(i)*n_simulated_particles.GetBinContent(i)/rema.GetBinContent(i, i));
+		reconstruction_uncertainty.SetBinContent(i, total_uncertainty.GetBinContent(i)*n_simulated_particles.GetBinContent(i)/response_matrix_diagonal.GetBinContent(i));
 	}
 }
 
-void Reconstructor::addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const TH2F &rema, TH1F &response_spectrum){
+void Reconstructor::addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const ResponseMatrix &rema, TH1F &response_spectrum){
 	
-	Double_t factor = 1.;
+	const Int_t n = rema.GetNbins();
+	vector<Double_t> factor((size_t) n + 1, 0.);
 
-	for(Int_t i = 1; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		response_spectrum.SetBinContent(i, 0.);
+	for(Int_t i = 1; i <= n; ++i){
+		factor[(size_t) i] = spectrum.GetBinContent(i)*inverse_n_simulated_particles.GetBinContent(i);
 	}
 
-	for(Int_t i = 1; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		factor = spectrum.GetBinContent(i)*inverse_n_simulated_particles.GetBinContent(i);
+	vector<Double_t> response((size_t) n + 1, 0.);
+	TriangularKernels::forward(rema, &factor[0], &response[0], 1, n);
 
-		for(Int_t j = i; j > 0; --j){
-			response_spectrum.SetBinContent(j, response_spectrum.GetBinContent(j) + factor*rema.GetBinContent(i, j));
-		}
+	for(Int_t j = 1; j <= n; ++j){
+		response_spectrum.SetBinContent(j, response[(size_t) j]);
 	}
 }
 
-void Reconstructor::addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const TH2F &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP){
+void Reconstructor::addResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const ResponseMatrix &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP){
 	
-	Double_t factor = 1.;
-	Double_t factor_without_efficiency = 1.;
+	const Int_t n = rema.GetNbins();
+	vector<Double_t> factor((size_t) n + 1, 0.);
+	vector<Double_t> factor_without_efficiency((size_t) n + 1, 0.);
 
-	for(Int_t i = 1; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		response_spectrum.SetBinContent(i, 0.);
+	for(Int_t i = 1; i <= n; ++i){
+		factor[(size_t) i] = spectrum.GetBinContent(i)*inverse_n_simulated_particles.GetBinContent(i);
+		factor_without_efficiency[(size_t) i] = spectrum.GetBinContent(i)/rema.GetBinContent(i, i);
 	}
 
-	for(Int_t i = 1; i <= (Int_t) NBINS/((Int_t) BINNING); ++i){
-		factor = spectrum.GetBinContent(i)*inverse_n_simulated_particles.GetBinContent(i);
-		factor_without_efficiency = spectrum.GetBinContent(i)/rema.GetBinContent(i,i);
+	vector<Double_t> response((size_t) n + 1, 0.);
+	vector<Double_t> response_FEP((size_t) n + 1, 0.);
+	TriangularKernels::forward(rema, &factor[0], &response[0], 1, n);
+	TriangularKernels::forward(rema, &factor_without_efficiency[0], &response_FEP[0], 1, n);
 
-		for(Int_t j = i; j > 0; --j){
-			response_spectrum.SetBinContent(j, response_spectrum.GetBinContent(j) + factor*rema.GetBinContent(i, j));
-			response_spectrum_FEP.SetBinContent(j, response_spectrum_FEP.GetBinContent(j) + factor_without_efficiency*rema.GetBinContent(i,j));
-		}
+	for(Int_t j = 1; j <= n; ++j){
+		response_spectrum.SetBinContent(j, response[(size_t) j]);
+		response_spectrum_FEP.SetBinContent(j, response_FEP[(size_t) j]);
 	}
 }
 
-void Reconstructor::addRealisticResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const TH2F &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP){
+void Reconstructor::addRealisticResponse(const TH1F &spectrum, const TH1F &inverse_n_simulated_particles, const ResponseMatrix &rema, TH1F &response_spectrum, TH1F &response_spectrum_FEP){
 
 	Double_t factor = 1.;
 	Double_t factor_without_efficiency = 1.;
@@ -0,0 +1,62 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+
+#include "ResponseMatrix.h"
+
+using std::cout;
+using std::endl;
+
+ResponseMatrix::ResponseMatrix(const TH2F &rema){
+	allocate(rema.GetNbinsX());
+
+	Float_t *col = nullptr;
+	for(Int_t j = 1; j <= n_bins; ++j){
+		col = column(j);
+		for(Int_t i = j; i <= n_bins; ++i){
+			col[i - j] = (Float_t) rema.GetBinContent(i, j);
+		}
+	}
+}
+
+void ResponseMatrix::SetBinContent(const Int_t i, const Int_t j, const Double_t content){
+	if(j < 1 || j > i || i > n_bins){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Element (" << i << ", " << j << ") is outside the lower triangle of the response matrix. Aborting ..." << endl;
+		abort();
+	}
+	elements[column_offset[(size_t) j] + (size_t) (i - j)] = (Float_t) content;
+}
+
+void ResponseMatrix::allocate(const Int_t nbins){
+	// Pad each column to a multiple of the alignment, so that every column
+	// starts at an aligned address. The padding elements are zero.
+	const size_t elements_per_alignment = RESPONSE_MATRIX_ALIGNMENT/sizeof(Float_t);
+
+	n_bins = nbins;
+	column_offset.assign((size_t) n_bins + 1, 0);
+
+	size_t offset = 0;
+	size_t column_length = 0;
+	for(Int_t j = 1; j <= n_bins; ++j){
+		column_offset[(size_t) j] = offset;
+		column_length = (size_t) (n_bins - j + 1);
+		offset += (column_length + elements_per_alignment - 1)/elements_per_alignment*elements_per_alignment;
+	}
+
+	elements.assign(offset, 0.f);
+}
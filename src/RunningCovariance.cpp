@@ -0,0 +1,230 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "RunningCovariance.h"
+
+using std::cout;
+using std::endl;
+
+// Number of leading entries of the state which describe the accumulator
+const size_t RUNNINGCOVARIANCE_STATE_HEADER = 3;
+
+RunningCovariance::RunningCovariance(const Int_t first, const Int_t last):
+	first_bin(first < 1 ? 1 : first),
+	last_bin(last),
+	n_samples(0),
+	next_block(0),
+	n_removed(0)
+{
+	if(last_bin < first_bin){
+		last_bin = first_bin - 1;
+	}
+
+	allocate();
+}
+
+RunningCovariance::RunningCovariance(const vector<Double_t> &state):
+	first_bin(1),
+	last_bin(0),
+	n_samples(0),
+	next_block(0),
+	n_removed(0)
+{
+	if(state.size() >= RUNNINGCOVARIANCE_STATE_HEADER){
+		first_bin = (Int_t) state[0];
+		last_bin = (Int_t) state[1];
+		n_samples = (UInt_t) state[2];
+	}
+
+	const size_t n = last_bin >= first_bin ? (size_t) (last_bin - first_bin + 1) : 0;
+	if(first_bin < 1 || state.size() != RUNNINGCOVARIANCE_STATE_HEADER + n + n*(n + 1)/2){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Invalid state of the covariance with " << state.size() << " entries. Aborting ..." << endl;
+		abort();
+	}
+
+	allocate();
+
+	vector<Double_t>::const_iterator entry = state.begin() + (long) RUNNINGCOVARIANCE_STATE_HEADER;
+	std::copy(entry, entry + (long) n, means.begin());
+	std::copy(entry + (long) n, state.end(), comoments.begin());
+}
+
+void RunningCovariance::allocate(){
+	const size_t n = (size_t) (last_bin - first_bin + 1);
+	means.assign(n, 0.);
+	delta.assign(n, 0.);
+	comoments.assign(n*(n + 1)/2, 0.);
+
+	// Row a of the lower triangle has a + 1 elements
+	block_rows.assign(1, 0);
+	size_t n_elements = 0;
+	for(size_t a = 0; a < n; ++a){
+		n_elements += a + 1;
+		if(n_elements >= RUNNINGCOVARIANCE_BLOCK_SIZE && a + 1 < n){
+			block_rows.push_back(a + 1);
+			n_elements = 0;
+		}
+	}
+	block_rows.push_back(n);
+
+	block_mutex = vector<std::mutex>(block_rows.size() - 1);
+	n_applied = vector<std::atomic<size_t> >(block_rows.size() - 1);
+	for(auto &applied: n_applied){
+		applied = 0;
+	}
+}
+
+void RunningCovariance::add(const Double_t *sample){
+	++n_samples;
+	const Double_t inverse_n = 1./(Double_t) n_samples;
+
+	for(size_t a = 0; a < means.size(); ++a){
+		delta[a] = sample[(size_t) first_bin + a] - means[a];
+		means[a] += delta[a]*inverse_n;
+	}
+
+	std::lock_guard<std::mutex> lock(update_mutex);
+	updates.push_back(Update());
+	updates.back().factor = 1. - inverse_n;
+	if(!spare_deltas.empty()){
+		updates.back().delta.swap(spare_deltas.back());
+		spare_deltas.pop_back();
+	}
+	updates.back().delta.swap(delta);
+	delta.resize(means.size());
+}
+
+void RunningCovariance::update(){
+	updateBlocks(false);
+}
+
+void RunningCovariance::finish(){
+	updateBlocks(true);
+}
+
+void RunningCovariance::updateBlocks(const Bool_t wait){
+	const size_t n_blocks = block_mutex.size();
+	// Threads start at different blocks, so that they do not wait for each other
+	const size_t first_block = next_block++;
+
+	vector<const Update*> pending;
+	size_t block = 0;
+	Double_t *row = nullptr;
+	Double_t factor_a = 0.;
+
+	for(size_t i = 0; i < n_blocks; ++i){
+		block = (first_block + i) % n_blocks;
+		if(wait){
+			block_mutex[block].lock();
+		} else if(!block_mutex[block].try_lock()){
+			continue;
+		}
+
+		// References to elements of a deque stay valid when elements are added at the end. Updates
+		// are only removed after they have been applied to this block.
+		pending.clear();
+		{
+			std::lock_guard<std::mutex> lock(update_mutex);
+			for(size_t k = n_applied[block]; k < n_removed + updates.size(); ++k){
+				pending.push_back(&updates[k - n_removed]);
+			}
+		}
+
+		// All pending updates are applied to the block before the next block is loaded
+		for(auto u: pending){
+			for(size_t a = block_rows[block]; a < block_rows[block + 1]; ++a){
+				row = &comoments[a*(a + 1)/2];
+				factor_a = u->factor*u->delta[a];
+				for(size_t b = 0; b <= a; ++b){
+					row[b] += factor_a*u->delta[b];
+				}
+			}
+		}
+		n_applied[block] += pending.size();
+
+		block_mutex[block].unlock();
+	}
+
+	std::lock_guard<std::mutex> lock(update_mutex);
+	size_t n_applied_to_all = n_removed + updates.size();
+	for(auto &applied: n_applied){
+		n_applied_to_all = applied < n_applied_to_all ? applied.load() : n_applied_to_all;
+	}
+	while(n_removed < n_applied_to_all){
+		spare_deltas.push_back(vector<Double_t>());
+		spare_deltas.back().swap(updates.front().delta);
+		updates.pop_front();
+		++n_removed;
+	}
+}
+
+void RunningCovariance::merge(const RunningCovariance &other){
+	if(other.first_bin != first_bin || other.last_bin != last_bin){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Covariance of bins [" << other.first_bin << ", " << other.last_bin << "] cannot be merged into covariance of bins [" << first_bin << ", " << last_bin << "]. Aborting ..." << endl;
+		abort();
+	}
+	if(other.n_samples == 0){
+		return;
+	}
+
+	finish();
+
+	const Double_t n_a = (Double_t) n_samples;
+	const Double_t n_b = (Double_t) other.n_samples;
+	const Double_t weight_b = n_b/(n_a + n_b);
+	const Double_t factor = n_a*weight_b;
+
+	for(size_t a = 0; a < means.size(); ++a){
+		// delta is the difference of the means of both sets
+		delta[a] = other.means[a] - means[a];
+		means[a] += delta[a]*weight_b;
+	}
+
+	Double_t *row = nullptr;
+	const Double_t *other_row = nullptr;
+	for(size_t a = 0; a < means.size(); ++a){
+		row = &comoments[a*(a + 1)/2];
+		other_row = &other.comoments[a*(a + 1)/2];
+		for(size_t b = 0; b <= a; ++b){
+			row[b] += other_row[b] + factor*delta[a]*delta[b];
+		}
+	}
+
+	n_samples += other.n_samples;
+}
+
+void RunningCovariance::getState(vector<Double_t> &state){
+	finish();
+
+	state.assign({(Double_t) first_bin, (Double_t) last_bin, (Double_t) n_samples});
+	state.insert(state.end(), means.begin(), means.end());
+	state.insert(state.end(), comoments.begin(), comoments.end());
+}
+
+Double_t RunningCovariance::covariance(const Int_t bin_i, const Int_t bin_j) const {
+	if(bin_i < first_bin || bin_i > last_bin || bin_j < first_bin || bin_j > last_bin || n_samples == 0){
+		return 0.;
+	}
+	const size_t a = (size_t) ((bin_i > bin_j ? bin_i : bin_j) - first_bin);
+	const size_t b = (size_t) ((bin_i > bin_j ? bin_j : bin_i) - first_bin);
+
+	return comoments[a*(a + 1)/2 + b]/(Double_t) n_samples;
+}
@@ -0,0 +1,239 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "RunningStatistics.h"
+
+using std::cout;
+using std::endl;
+
+// Number of leading entries of the state which describe the accumulator
+const size_t RUNNINGSTATISTICS_STATE_HEADER = 4;
+
+RunningStatistics::RunningStatistics(const Int_t first, const Int_t last, const Bool_t quantiles):
+	first_bin(first < 1 ? 1 : first),
+	last_bin(last),
+	with_quantiles(quantiles),
+	n_samples(0)
+{
+	if(last_bin < first_bin){
+		last_bin = first_bin - 1;
+	}
+
+	allocate();
+}
+
+RunningStatistics::RunningStatistics(const vector<Double_t> &state):
+	first_bin(1),
+	last_bin(0),
+	with_quantiles(false),
+	n_samples(0)
+{
+	if(state.size() >= RUNNINGSTATISTICS_STATE_HEADER){
+		first_bin = (Int_t) state[0];
+		last_bin = (Int_t) state[1];
+		with_quantiles = state[2] != 0.;
+		n_samples = (UInt_t) state[3];
+	}
+
+	// The digests have a variable size and follow the fixed part of the state
+	const size_t n = last_bin >= first_bin ? (size_t) (last_bin - first_bin + 1) : 0;
+	const size_t state_size = RUNNINGSTATISTICS_STATE_HEADER + 6*n;
+	if(first_bin < 1 || state.size() < state_size || (!with_quantiles && state.size() != state_size)){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Invalid state of the statistics with " << state.size() << " entries. Aborting ..." << endl;
+		abort();
+	}
+
+	allocate();
+
+	vector<Double_t>::const_iterator entry = state.begin() + (long) RUNNINGSTATISTICS_STATE_HEADER;
+	for(auto array: {&means, &squared_deviations, &cubed_deviations, &quartic_deviations, &minima, &maxima}){
+		std::copy(entry, entry + (long) array->size(), array->begin());
+		entry += (long) array->size();
+	}
+
+	size_t position = state_size;
+	for(auto &digest: digests){
+		position = digest.restoreState(state, position);
+	}
+	if(position != state.size()){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Invalid state of the statistics with " << state.size() << " entries. Aborting ..." << endl;
+		abort();
+	}
+}
+
+void RunningStatistics::allocate(){
+	const size_t n = (size_t) (last_bin - first_bin + 1);
+	means.assign(n, 0.);
+	squared_deviations.assign(n, 0.);
+	cubed_deviations.assign(n, 0.);
+	quartic_deviations.assign(n, 0.);
+	minima.assign(n, 0.);
+	maxima.assign(n, 0.);
+	delta.assign(n, 0.);
+	buffer.assign((size_t) last_bin + 1, 0.);
+	if(with_quantiles){
+		digests.assign(n, MergingDigest());
+	}
+}
+
+void RunningStatistics::add(const TH1F &sample){
+	for(Int_t i = first_bin; i <= last_bin; ++i){
+		buffer[(size_t) i] = sample.GetBinContent(i);
+	}
+	add(&buffer[0]);
+}
+
+void RunningStatistics::add(const Double_t *sample){
+	++n_samples;
+	const Double_t n_new = (Double_t) n_samples;
+	const Double_t inverse_n = 1./n_new;
+	const size_t n = means.size();
+
+	Double_t x = 0.;
+	Double_t delta_n = 0.;
+	Double_t term = 0.;
+	for(size_t a = 0; a < n; ++a){
+		x = sample[(size_t) first_bin + a];
+
+		// delta is the deviation from the old mean, (x - new mean) = (1 - 1/n)*delta
+		delta[a] = x - means[a];
+		delta_n = delta[a]*inverse_n;
+		means[a] += delta_n;
+		term = delta[a]*(x - means[a]);
+		// The higher moments are updated with the lower moments of the previous samples
+		quartic_deviations[a] += term*delta_n*delta_n*(n_new*n_new - 3.*n_new + 3.) + 6.*delta_n*delta_n*squared_deviations[a] - 4.*delta_n*cubed_deviations[a];
+		cubed_deviations[a] += term*delta_n*(n_new - 2.) - 3.*delta_n*squared_deviations[a];
+		squared_deviations[a] += term;
+
+		if(n_samples == 1 || x < minima[a]){
+			minima[a] = x;
+		}
+		if(n_samples == 1 || x > maxima[a]){
+			maxima[a] = x;
+		}
+	}
+
+	if(with_quantiles){
+		for(size_t a = 0; a < n; ++a){
+			digests[a].add(sample[(size_t) first_bin + a]);
+		}
+	}
+}
+
+void RunningStatistics::merge(const RunningStatistics &other){
+	if(other.first_bin != first_bin || other.last_bin != last_bin || other.with_quantiles != with_quantiles){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Statistics of bins [" << other.first_bin << ", " << other.last_bin << "] cannot be merged into statistics of bins [" << first_bin << ", " << last_bin << "]. Aborting ..." << endl;
+		abort();
+	}
+	if(other.n_samples == 0){
+		return;
+	}
+
+	const Double_t n_a = (Double_t) n_samples;
+	const Double_t n_b = (Double_t) other.n_samples;
+	const Double_t n_ab = n_a + n_b;
+	const Double_t weight_b = n_b/n_ab;
+	const Double_t factor = n_a*weight_b;
+	const size_t n = means.size();
+	const Bool_t first_merge = n_samples == 0;
+
+	Double_t delta_2 = 0.;
+	for(size_t a = 0; a < n; ++a){
+		// delta is the difference of the means of both sets
+		delta[a] = other.means[a] - means[a];
+		delta_2 = delta[a]*delta[a];
+		means[a] += delta[a]*weight_b;
+		// The higher moments are updated with the lower moments of both sets before the merge
+		quartic_deviations[a] += other.quartic_deviations[a] + factor*delta_2*delta_2*(n_a*n_a - n_a*n_b + n_b*n_b)/(n_ab*n_ab) + 6.*delta_2*(n_a*n_a*other.squared_deviations[a] + n_b*n_b*squared_deviations[a])/(n_ab*n_ab) + 4.*delta[a]*(n_a*other.cubed_deviations[a] - n_b*cubed_deviations[a])/n_ab;
+		cubed_deviations[a] += other.cubed_deviations[a] + factor*delta_2*delta[a]*(n_a - n_b)/n_ab + 3.*delta[a]*(n_a*other.squared_deviations[a] - n_b*squared_deviations[a])/n_ab;
+		squared_deviations[a] += other.squared_deviations[a] + factor*delta_2;
+
+		if(first_merge || other.minima[a] < minima[a]){
+			minima[a] = other.minima[a];
+		}
+		if(first_merge || other.maxima[a] > maxima[a]){
+			maxima[a] = other.maxima[a];
+		}
+	}
+
+	for(size_t a = 0; a < digests.size(); ++a){
+		digests[a].merge(other.digests[a]);
+	}
+
+	n_samples += other.n_samples;
+}
+
+void RunningStatistics::getState(vector<Double_t> &state) const {
+	state.assign({(Double_t) first_bin, (Double_t) last_bin, with_quantiles ? 1. : 0., (Double_t) n_samples});
+	for(auto array: {&means, &squared_deviations, &cubed_deviations, &quartic_deviations, &minima, &maxima}){
+		state.insert(state.end(), array->begin(), array->end());
+	}
+	for(auto &digest: digests){
+		digest.appendState(state);
+	}
+}
+
+Double_t RunningStatistics::mean(const Int_t bin) const {
+	return inRange(bin) ? means[(size_t) (bin - first_bin)] : 0.;
+}
+
+Double_t RunningStatistics::variance(const Int_t bin) const {
+	if(!inRange(bin) || n_samples == 0){
+		return 0.;
+	}
+	return squared_deviations[(size_t) (bin - first_bin)]/(Double_t) n_samples;
+}
+
+Double_t RunningStatistics::standardDeviation(const Int_t bin) const {
+	return sqrt(variance(bin));
+}
+
+Double_t RunningStatistics::standardDeviationError(const Int_t bin) const {
+	if(!inRange(bin) || n_samples == 0){
+		return 0.;
+	}
+	const size_t a = (size_t) (bin - first_bin);
+	const Double_t n = (Double_t) n_samples;
+	const Double_t m2 = squared_deviations[a]/n;
+	const Double_t m4 = quartic_deviations[a]/n;
+	if(m2 <= 0. || m4 <= m2*m2){
+		return 0.;
+	}
+
+	return 0.5*sqrt((m4 - m2*m2)/n/m2);
+}
+
+Double_t RunningStatistics::minimum(const Int_t bin) const {
+	return inRange(bin) ? minima[(size_t) (bin - first_bin)] : 0.;
+}
+
+Double_t RunningStatistics::maximum(const Int_t bin) const {
+	return inRange(bin) ? maxima[(size_t) (bin - first_bin)] : 0.;
+}
+
+Double_t RunningStatistics::quantile(const Int_t bin, const Double_t q) const {
+	if(!with_quantiles || !inRange(bin) || n_samples == 0){
+		return 0.;
+	}
+
+	return digests[(size_t) (bin - first_bin)].quantile(q);
+}
@@ -0,0 +1,83 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include "PhiloxRandom.h"
+#include "SobolSequence.h"
+
+// The seed of the scrambling is taken from streams of PhiloxRandom which are not used by the
+// Monte-Carlo iterations
+const UInt_t SOBOL_STREAM_OFFSET = 1u << 16;
+
+// 32-bit integer hash (C. Wellons, "lowbias32")
+static UInt_t hash(UInt_t x){
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static UInt_t reverseBits(UInt_t x){
+	x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+	x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+	x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+	x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+	return (x >> 16) | (x << 16);
+}
+
+// Bijection in which each bit of the result depends only on the same and less significant bits of
+// x (B. Burley, 2020). Applied to the reversed bits, each bit of a coordinate is flipped depending
+// only on the more significant bits, like in Owen's nested uniform scrambling.
+static UInt_t nestedUniformScramble(UInt_t x, const UInt_t seed){
+	x = reverseBits(x);
+	x ^= x*0x3d20adeau;
+	x += seed;
+	x *= (seed >> 16) | 1u;
+	x ^= x*0x05526c56u;
+	x ^= x*0x53a22864u;
+	return reverseBits(x);
+}
+
+// Second dimension of the Sobol' sequence, whose generator matrix is the Pascal matrix modulo 2.
+// The first dimension is the van der Corput sequence, i.e. the reversed bits of the index.
+static UInt_t sobolSecondDimension(UInt_t index){
+	UInt_t direction = 1u << 31;
+	UInt_t x = 0;
+	for(; index != 0; index >>= 1){
+		if(index & 1u){
+			x ^= direction;
+		}
+		direction ^= direction >> 1;
+	}
+	return x;
+}
+
+SobolSequence::SobolSequence(const UInt_t seed, const UInt_t stream, const UInt_t substream){
+	PhiloxRandom random_generator(seed, 0, SOBOL_STREAM_OFFSET + stream, substream);
+	scrambling_seed = (UInt_t) (random_generator.Uniform()*4294967296.); // 2^32
+}
+
+Double_t SobolSequence::Uniform(const UInt_t index, const UInt_t dimension, const Double_t jitter) const {
+	const UInt_t pair_seed = hash(scrambling_seed ^ hash(dimension >> 1));
+	const UInt_t shuffled_index = nestedUniformScramble(index, hash(pair_seed ^ 0x2c1b3c6du));
+
+	UInt_t x = (dimension & 1u) ? sobolSecondDimension(shuffled_index) : reverseBits(shuffled_index);
+	x = nestedUniformScramble(x, hash(pair_seed ^ (0x297a2d39u + (dimension & 1u))));
+
+	return ((Double_t) x + jitter)/4294967296.; // 2^32
+}
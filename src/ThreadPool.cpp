@@ -0,0 +1,146 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdlib>
+
+#include "ThreadPool.h"
+
+using std::lock_guard;
+using std::thread;
+using std::unique_lock;
+
+namespace{
+	// True in the workers of a pool and in a thread which executes the tasks of parallelFor()
+	thread_local Bool_t inside_pool = false;
+}
+
+UInt_t ThreadPool::default_size = 0;
+
+ThreadPool::ThreadPool(const UInt_t n_threads):
+	current_task(nullptr),
+	n_current_tasks(0),
+	next_task(0),
+	n_finished_workers(0),
+	generation(0),
+	stop(false)
+{
+	for(UInt_t t = 1; t < n_threads; ++t){
+		workers.push_back(thread(&ThreadPool::work, this));
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	{
+		lock_guard<std::mutex> lock(state_mutex);
+		stop = true;
+	}
+	start_condition.notify_all();
+	for(auto &worker: workers){
+		worker.join();
+	}
+}
+
+ThreadPool& ThreadPool::instance(){
+	static ThreadPool pool([](){
+		UInt_t n_threads = default_size;
+		if(n_threads == 0){
+			const char *environment = getenv("HORST_THREADS");
+			if(environment != nullptr && atoi(environment) > 0){
+				n_threads = (UInt_t) atoi(environment);
+			}
+		}
+		if(n_threads == 0){
+			n_threads = thread::hardware_concurrency();
+		}
+		return n_threads > 0 ? n_threads : 1;
+	}());
+
+	return pool;
+}
+
+UInt_t ThreadPool::nTasks(const size_t work, const size_t min_work) const {
+	const size_t max_tasks = min_work > 0 ? work/min_work : work;
+	if(max_tasks < 1){
+		return 1;
+	}
+	return max_tasks < size() ? (UInt_t) max_tasks : size();
+}
+
+void ThreadPool::parallelFor(const UInt_t n_tasks, const std::function<void(UInt_t)> &task){
+	if(n_tasks == 0){
+		return;
+	}
+
+	if(workers.empty() || n_tasks == 1 || inside_pool){
+		for(UInt_t k = 0; k < n_tasks; ++k){
+			task(k);
+		}
+		return;
+	}
+
+	// Only one loop at a time can use the workers
+	lock_guard<std::mutex> run_lock(run_mutex);
+
+	{
+		lock_guard<std::mutex> lock(state_mutex);
+		current_task = &task;
+		n_current_tasks = n_tasks;
+		next_task = 0;
+		n_finished_workers = 0;
+		++generation;
+	}
+	start_condition.notify_all();
+
+	inside_pool = true;
+	runTasks();
+	inside_pool = false;
+
+	unique_lock<std::mutex> lock(state_mutex);
+	done_condition.wait(lock, [this](){ return n_finished_workers == workers.size(); });
+	current_task = nullptr;
+}
+
+void ThreadPool::work(){
+	inside_pool = true;
+	unsigned long last_generation = 0;
+
+	while(true){
+		{
+			unique_lock<std::mutex> lock(state_mutex);
+			start_condition.wait(lock, [this, last_generation](){ return stop || generation != last_generation; });
+			if(stop){
+				return;
+			}
+			last_generation = generation;
+		}
+
+		runTasks();
+
+		{
+			lock_guard<std::mutex> lock(state_mutex);
+			++n_finished_workers;
+		}
+		done_condition.notify_one();
+	}
+}
+
+void ThreadPool::runTasks(){
+	for(UInt_t k = next_task++; k < n_current_tasks; k = next_task++){
+		(*current_task)(k);
+	}
+}
@@ -0,0 +1,503 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRIANGULARKERNELS_X86 1
+#endif
+
+#include "ThreadPool.h"
+#include "TriangularKernels.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+namespace{
+
+/************ Scalar kernels *************/
+
+Double_t dot_scalar(const Float_t *a, const Double_t *x, const size_t n){
+	Double_t sum = 0.;
+	for(size_t k = 0; k < n; ++k){
+		sum += a[k]*x[k];
+	}
+	return sum;
+}
+
+Double_t dotSquared_scalar(const Float_t *a, const Double_t *x, const size_t n){
+	Double_t sum = 0.;
+	for(size_t k = 0; k < n; ++k){
+		sum += (Double_t) a[k]*a[k]*x[k];
+	}
+	return sum;
+}
+
+void dotPair_scalar(const Float_t *a, const Double_t *x, const Double_t *y, const size_t n, Double_t &sum_x, Double_t &sum_y){
+	sum_x = 0.;
+	sum_y = 0.;
+	for(size_t k = 0; k < n; ++k){
+		sum_x += a[k]*x[k];
+		sum_y += (Double_t) a[k]*a[k]*y[k];
+	}
+}
+
+void axpy_scalar(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	for(size_t k = 0; k < n; ++k){
+		y[k] += factor*a[k];
+	}
+}
+
+void axpySquared_scalar(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	for(size_t k = 0; k < n; ++k){
+		y[k] += factor*a[k]*a[k];
+	}
+}
+
+#ifdef TRIANGULARKERNELS_X86
+
+/************ AVX2 kernels *************/
+// 8 matrix elements per iteration, converted to two vectors of 4 doubles.
+
+__attribute__((target("avx2,fma")))
+Double_t horizontalSum_avx2(const __m256d sum){
+	__m128d s = _mm_add_pd(_mm256_castpd256_pd128(sum), _mm256_extractf128_pd(sum, 1));
+	s = _mm_add_sd(s, _mm_unpackhi_pd(s, s));
+	return _mm_cvtsd_f64(s);
+}
+
+__attribute__((target("avx2,fma")))
+Double_t dot_avx2(const Float_t *a, const Double_t *x, const size_t n){
+	__m256d sum_low = _mm256_setzero_pd();
+	__m256d sum_high = _mm256_setzero_pd();
+	__m256 a8;
+
+	size_t k = 0;
+	for(; k + 8 <= n; k += 8){
+		a8 = _mm256_loadu_ps(a + k);
+		sum_low = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(a8)), _mm256_loadu_pd(x + k), sum_low);
+		sum_high = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm256_extractf128_ps(a8, 1)), _mm256_loadu_pd(x + k + 4), sum_high);
+	}
+
+	Double_t sum = horizontalSum_avx2(_mm256_add_pd(sum_low, sum_high));
+	for(; k < n; ++k){
+		sum += a[k]*x[k];
+	}
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+Double_t dotSquared_avx2(const Float_t *a, const Double_t *x, const size_t n){
+	__m256d sum_low = _mm256_setzero_pd();
+	__m256d sum_high = _mm256_setzero_pd();
+	__m256 a8;
+	__m256d a4;
+
+	size_t k = 0;
+	for(; k + 8 <= n; k += 8){
+		a8 = _mm256_loadu_ps(a + k);
+		a4 = _mm256_cvtps_pd(_mm256_castps256_ps128(a8));
+		sum_low = _mm256_fmadd_pd(_mm256_mul_pd(a4, a4), _mm256_loadu_pd(x + k), sum_low);
+		a4 = _mm256_cvtps_pd(_mm256_extractf128_ps(a8, 1));
+		sum_high = _mm256_fmadd_pd(_mm256_mul_pd(a4, a4), _mm256_loadu_pd(x + k + 4), sum_high);
+	}
+
+	Double_t sum = horizontalSum_avx2(_mm256_add_pd(sum_low, sum_high));
+	for(; k < n; ++k){
+		sum += (Double_t) a[k]*a[k]*x[k];
+	}
+	return sum;
+}
+
+__attribute__((target("avx2,fma")))
+void dotPair_avx2(const Float_t *a, const Double_t *x, const Double_t *y, const size_t n, Double_t &sum_x, Double_t &sum_y){
+	__m256d sum_x_low = _mm256_setzero_pd();
+	__m256d sum_x_high = _mm256_setzero_pd();
+	__m256d sum_y_low = _mm256_setzero_pd();
+	__m256d sum_y_high = _mm256_setzero_pd();
+	__m256 a8;
+	__m256d a4;
+
+	size_t k = 0;
+	for(; k + 8 <= n; k += 8){
+		a8 = _mm256_loadu_ps(a + k);
+		a4 = _mm256_cvtps_pd(_mm256_castps256_ps128(a8));
+		sum_x_low = _mm256_fmadd_pd(a4, _mm256_loadu_pd(x + k), sum_x_low);
+		sum_y_low = _mm256_fmadd_pd(_mm256_mul_pd(a4, a4), _mm256_loadu_pd(y + k), sum_y_low);
+		a4 = _mm256_cvtps_pd(_mm256_extractf128_ps(a8, 1));
+		sum_x_high = _mm256_fmadd_pd(a4, _mm256_loadu_pd(x + k + 4), sum_x_high);
+		sum_y_high = _mm256_fmadd_pd(_mm256_mul_pd(a4, a4), _mm256_loadu_pd(y + k + 4), sum_y_high);
+	}
+
+	sum_x = horizontalSum_avx2(_mm256_add_pd(sum_x_low, sum_x_high));
+	sum_y = horizontalSum_avx2(_mm256_add_pd(sum_y_low, sum_y_high));
+	for(; k < n; ++k){
+		sum_x += a[k]*x[k];
+		sum_y += (Double_t) a[k]*a[k]*y[k];
+	}
+}
+
+__attribute__((target("avx2,fma")))
+void axpy_avx2(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	const __m256d f = _mm256_set1_pd(factor);
+	__m256 a8;
+
+	size_t k = 0;
+	for(; k + 8 <= n; k += 8){
+		a8 = _mm256_loadu_ps(a + k);
+		_mm256_storeu_pd(y + k, _mm256_fmadd_pd(f, _mm256_cvtps_pd(_mm256_castps256_ps128(a8)), _mm256_loadu_pd(y + k)));
+		_mm256_storeu_pd(y + k + 4, _mm256_fmadd_pd(f, _mm256_cvtps_pd(_mm256_extractf128_ps(a8, 1)), _mm256_loadu_pd(y + k + 4)));
+	}
+	for(; k < n; ++k){
+		y[k] += factor*a[k];
+	}
+}
+
+__attribute__((target("avx2,fma")))
+void axpySquared_avx2(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	const __m256d f = _mm256_set1_pd(factor);
+	__m256 a8;
+	__m256d a4;
+
+	size_t k = 0;
+	for(; k + 8 <= n; k += 8){
+		a8 = _mm256_loadu_ps(a + k);
+		a4 = _mm256_cvtps_pd(_mm256_castps256_ps128(a8));
+		_mm256_storeu_pd(y + k, _mm256_fmadd_pd(_mm256_mul_pd(f, a4), a4, _mm256_loadu_pd(y + k)));
+		a4 = _mm256_cvtps_pd(_mm256_extractf128_ps(a8, 1));
+		_mm256_storeu_pd(y + k + 4, _mm256_fmadd_pd(_mm256_mul_pd(f, a4), a4, _mm256_loadu_pd(y + k + 4)));
+	}
+	for(; k < n; ++k){
+		y[k] += factor*a[k]*a[k];
+	}
+}
+
+/************ AVX-512 kernels *************/
+// 16 matrix elements per iteration, converted to two vectors of 8 doubles.
+
+__attribute__((target("avx512f")))
+Double_t dot_avx512(const Float_t *a, const Double_t *x, const size_t n){
+	__m512d sum_low = _mm512_setzero_pd();
+	__m512d sum_high = _mm512_setzero_pd();
+
+	size_t k = 0;
+	for(; k + 16 <= n; k += 16){
+		sum_low = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(a + k)), _mm512_loadu_pd(x + k), sum_low);
+		sum_high = _mm512_fmadd_pd(_mm512_cvtps_pd(_mm256_loadu_ps(a + k + 8)), _mm512_loadu_pd(x + k + 8), sum_high);
+	}
+
+	Double_t sum = _mm512_reduce_add_pd(_mm512_add_pd(sum_low, sum_high));
+	for(; k < n; ++k){
+		sum += a[k]*x[k];
+	}
+	return sum;
+}
+
+__attribute__((target("avx512f")))
+Double_t dotSquared_avx512(const Float_t *a, const Double_t *x, const size_t n){
+	__m512d sum_low = _mm512_setzero_pd();
+	__m512d sum_high = _mm512_setzero_pd();
+	__m512d a8;
+
+	size_t k = 0;
+	for(; k + 16 <= n; k += 16){
+		a8 = _mm512_cvtps_pd(_mm256_loadu_ps(a + k));
+		sum_low = _mm512_fmadd_pd(_mm512_mul_pd(a8, a8), _mm512_loadu_pd(x + k), sum_low);
+		a8 = _mm512_cvtps_pd(_mm256_loadu_ps(a + k + 8));
+		sum_high = _mm512_fmadd_pd(_mm512_mul_pd(a8, a8), _mm512_loadu_pd(x + k + 8), sum_high);
+	}
+
+	Double_t sum = _mm512_reduce_add_pd(_mm512_add_pd(sum_low, sum_high));
+	for(; k < n; ++k){
+		sum += (Double_t) a[k]*a[k]*x[k];
+	}
+	return sum;
+}
+
+__attribute__((target("avx512f")))
+void dotPair_avx512(const Float_t *a, const Double_t *x, const Double_t *y, const size_t n, Double_t &sum_x, Double_t &sum_y){
+	__m512d sum_x_low = _mm512_setzero_pd();
+	__m512d sum_x_high = _mm512_setzero_pd();
+	__m512d sum_y_low = _mm512_setzero_pd();
+	__m512d sum_y_high = _mm512_setzero_pd();
+	__m512d a8;
+
+	size_t k = 0;
+	for(; k + 16 <= n; k += 16){
+		a8 = _mm512_cvtps_pd(_mm256_loadu_ps(a + k));
+		sum_x_low = _mm512_fmadd_pd(a8, _mm512_loadu_pd(x + k), sum_x_low);
+		sum_y_low = _mm512_fmadd_pd(_mm512_mul_pd(a8, a8), _mm512_loadu_pd(y + k), sum_y_low);
+		a8 = _mm512_cvtps_pd(_mm256_loadu_ps(a + k + 8));
+		sum_x_high = _mm512_fmadd_pd(a8, _mm512_loadu_pd(x + k + 8), sum_x_high);
+		sum_y_high = _mm512_fmadd_pd(_mm512_mul_pd(a8, a8), _mm512_loadu_pd(y + k + 8), sum_y_high);
+	}
+
+	sum_x = _mm512_reduce_add_pd(_mm512_add_pd(sum_x_low, sum_x_high));
+	sum_y = _mm512_reduce_add_pd(_mm512_add_pd(sum_y_low, sum_y_high));
+	for(; k < n; ++k){
+		sum_x += a[k]*x[k];
+		sum_y += (Double_t) a[k]*a[k]*y[k];
+	}
+}
+
+__attribute__((target("avx512f")))
+void axpy_avx512(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	const __m512d f = _mm512_set1_pd(factor);
+
+	size_t k = 0;
+	for(; k + 16 <= n; k += 16){
+		_mm512_storeu_pd(y + k, _mm512_fmadd_pd(f, _mm512_cvtps_pd(_mm256_loadu_ps(a + k)), _mm512_loadu_pd(y + k)));
+		_mm512_storeu_pd(y + k + 8, _mm512_fmadd_pd(f, _mm512_cvtps_pd(_mm256_loadu_ps(a + k + 8)), _mm512_loadu_pd(y + k + 8)));
+	}
+	for(; k < n; ++k){
+		y[k] += factor*a[k];
+	}
+}
+
+__attribute__((target("avx512f")))
+void axpySquared_avx512(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	const __m512d f = _mm512_set1_pd(factor);
+	__m512d a8;
+
+	size_t k = 0;
+	for(; k + 16 <= n; k += 16){
+		a8 = _mm512_cvtps_pd(_mm256_loadu_ps(a + k));
+		_mm512_storeu_pd(y + k, _mm512_fmadd_pd(_mm512_mul_pd(f, a8), a8, _mm512_loadu_pd(y + k)));
+		a8 = _mm512_cvtps_pd(_mm256_loadu_ps(a + k + 8));
+		_mm512_storeu_pd(y + k + 8, _mm512_fmadd_pd(_mm512_mul_pd(f, a8), a8, _mm512_loadu_pd(y + k + 8)));
+	}
+	for(; k < n; ++k){
+		y[k] += factor*a[k]*a[k];
+	}
+}
+
+#endif
+
+/************ Runtime dispatch *************/
+
+struct ColumnKernels{
+	Double_t (*dot)(const Float_t*, const Double_t*, const size_t);
+	Double_t (*dotSquared)(const Float_t*, const Double_t*, const size_t);
+	void (*dotPair)(const Float_t*, const Double_t*, const Double_t*, const size_t, Double_t&, Double_t&);
+	void (*axpy)(const Double_t, const Float_t*, Double_t*, const size_t);
+	void (*axpySquared)(const Double_t, const Float_t*, Double_t*, const size_t);
+	const char *name;
+};
+
+ColumnKernels selectKernels(){
+	const char *requested = getenv("HORST_SIMD");
+	if(requested != nullptr && requested[0] == '\0'){
+		requested = nullptr;
+	}
+	if(requested != nullptr && strcmp(requested, "scalar") != 0 && strcmp(requested, "avx2") != 0 && strcmp(requested, "avx512") != 0){
+		cout << __FILE__ << ":" << __FUNCTION__ << "():" << __LINE__ << ": Error: Unknown instruction set HORST_SIMD='" << requested << "'. Valid values are 'scalar', 'avx2' and 'avx512'. Aborting ..." << endl;
+		abort();
+	}
+	const Bool_t allow_avx512 = requested == nullptr || strcmp(requested, "avx512") == 0;
+	const Bool_t allow_avx2 = allow_avx512 || strcmp(requested, "avx2") == 0;
+
+#ifdef TRIANGULARKERNELS_X86
+	__builtin_cpu_init();
+	if(allow_avx512 && __builtin_cpu_supports("avx512f")){
+		return ColumnKernels{dot_avx512, dotSquared_avx512, dotPair_avx512, axpy_avx512, axpySquared_avx512, "AVX-512"};
+	}
+	if(allow_avx2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")){
+		return ColumnKernels{dot_avx2, dotSquared_avx2, dotPair_avx2, axpy_avx2, axpySquared_avx2, "AVX2"};
+	}
+#else
+	(void) allow_avx2;
+#endif
+
+	return ColumnKernels{dot_scalar, dotSquared_scalar, dotPair_scalar, axpy_scalar, axpySquared_scalar, "scalar"};
+}
+
+const ColumnKernels& kernels(){
+	static const ColumnKernels selected = selectKernels();
+	return selected;
+}
+
+/************ Triangular products *************/
+
+void forwardColumns(const ResponseMatrix &rema, const Double_t *p, Double_t *prediction, const Int_t column_begin, const Int_t column_end, const Int_t last_bin, const Bool_t squared){
+	const ColumnKernels &k = kernels();
+	for(Int_t j = column_begin; j <= column_end; ++j){
+		prediction[j] = (squared ? k.dotSquared : k.dot)(rema.column(j), p + j, (size_t) (last_bin - j + 1));
+	}
+}
+
+// The diagonal element only enters the squared sum, so the column is walked from its second
+// element on and the diagonal term is added separately.
+void uncertaintyColumns(const ResponseMatrix &rema, const Double_t *p, const Double_t *w, Double_t *simulation, Double_t *spectrum, const Int_t column_begin, const Int_t column_end, const Int_t last_bin){
+	const ColumnKernels &k = kernels();
+	const Float_t *col = nullptr;
+	Double_t sum_squared = 0.;
+	for(Int_t j = column_begin; j <= column_end; ++j){
+		col = rema.column(j);
+		k.dotPair(col + 1, p + j + 1, w + j + 1, (size_t) (last_bin - j), simulation[j], sum_squared);
+		spectrum[j] = (Double_t) col[0]*col[0]*w[j] + sum_squared;
+	}
+}
+
+void adjointRows(const ResponseMatrix &rema, const Double_t *r, Double_t *result, const Int_t first_bin, const Int_t row_begin, const Int_t row_end, const Bool_t squared){
+	const ColumnKernels &k = kernels();
+
+	if(row_end < row_begin){
+		return;
+	}
+
+	for(Int_t i = row_begin; i <= row_end; ++i){
+		result[i] = 0.;
+	}
+
+	// Walk through the columns and update the rows [row_begin, row_end], which are a
+	// contiguous segment of each column.
+	Int_t start = 0;
+	for(Int_t j = first_bin; j <= row_end; ++j){
+		if(r[j] == 0.){
+			continue;
+		}
+		start = row_begin > j ? row_begin : j;
+		(squared ? k.axpySquared : k.axpy)(r[j], rema.column(j) + (start - j), result + start, (size_t) (row_end - start + 1));
+	}
+}
+
+// Split the bins [first_bin, last_bin] into n_blocks ranges [blocks[b], blocks[b + 1]) which contain
+// about the same number of matrix elements, either counted by columns (column j has last_bin - j + 1
+// elements) or by rows (row i has i - first_bin + 1 elements).
+void partition(const Int_t first_bin, const Int_t last_bin, const UInt_t n_blocks, const Bool_t by_rows, vector<Int_t> &blocks){
+	const Double_t n = (Double_t) (last_bin - first_bin + 1);
+	const Double_t elements_per_block = 0.5*n*(n + 1.)/n_blocks;
+
+	blocks.assign(n_blocks + 1, last_bin + 1);
+	blocks[0] = first_bin;
+
+	Double_t elements = 0.;
+	UInt_t block = 1;
+	for(Int_t b = first_bin; b <= last_bin && block < n_blocks; ++b){
+		elements += by_rows ? b - first_bin + 1 : last_bin - b + 1;
+		if(elements >= block*elements_per_block){
+			blocks[block++] = b + 1;
+		}
+	}
+}
+
+UInt_t nTasks(const Int_t first_bin, const Int_t last_bin){
+	const size_t n = last_bin >= first_bin ? (size_t) (last_bin - first_bin + 1) : 0;
+	return ThreadPool::instance().nTasks(n*(n + 1)/2);
+}
+
+// Each task computes the complete sums for its own bins. Therefore, the result does not depend on
+// the number of tasks.
+void forwardParallel(const ResponseMatrix &rema, const Double_t *p, Double_t *prediction, const Int_t first_bin, const Int_t last_bin, const Bool_t squared){
+	const UInt_t n_tasks = nTasks(first_bin, last_bin);
+	if(n_tasks == 1){
+		forwardColumns(rema, p, prediction, first_bin, last_bin, last_bin, squared);
+		return;
+	}
+
+	vector<Int_t> blocks;
+	partition(first_bin, last_bin, n_tasks, false, blocks);
+	ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+		forwardColumns(rema, p, prediction, blocks[task], blocks[task + 1] - 1, last_bin, squared);
+	});
+}
+
+void uncertaintyParallel(const ResponseMatrix &rema, const Double_t *p, const Double_t *w, Double_t *simulation, Double_t *spectrum, const Int_t first_bin, const Int_t last_bin){
+	const UInt_t n_tasks = nTasks(first_bin, last_bin);
+	if(n_tasks == 1){
+		uncertaintyColumns(rema, p, w, simulation, spectrum, first_bin, last_bin, last_bin);
+		return;
+	}
+
+	vector<Int_t> blocks;
+	partition(first_bin, last_bin, n_tasks, false, blocks);
+	ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+		uncertaintyColumns(rema, p, w, simulation, spectrum, blocks[task], blocks[task + 1] - 1, last_bin);
+	});
+}
+
+void adjointParallel(const ResponseMatrix &rema, const Double_t *r, Double_t *result, const Int_t first_bin, const Int_t last_bin, const Bool_t squared){
+	const UInt_t n_tasks = nTasks(first_bin, last_bin);
+	if(n_tasks == 1){
+		adjointRows(rema, r, result, first_bin, first_bin, last_bin, squared);
+		return;
+	}
+
+	vector<Int_t> blocks;
+	partition(first_bin, last_bin, n_tasks, true, blocks);
+	ThreadPool::instance().parallelFor(n_tasks, [&](const UInt_t task){
+		adjointRows(rema, r, result, first_bin, blocks[task], blocks[task + 1] - 1, squared);
+	});
+}
+
+}
+
+Double_t TriangularKernels::dot(const Float_t *a, const Double_t *x, const size_t n){
+	return kernels().dot(a, x, n);
+}
+
+Double_t TriangularKernels::dotSquared(const Float_t *a, const Double_t *x, const size_t n){
+	return kernels().dotSquared(a, x, n);
+}
+
+void TriangularKernels::dotPair(const Float_t *a, const Double_t *x, const Double_t *y, const size_t n, Double_t &sum_x, Double_t &sum_y){
+	kernels().dotPair(a, x, y, n, sum_x, sum_y);
+}
+
+void TriangularKernels::axpy(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	kernels().axpy(factor, a, y, n);
+}
+
+void TriangularKernels::axpySquared(const Double_t factor, const Float_t *a, Double_t *y, const size_t n){
+	kernels().axpySquared(factor, a, y, n);
+}
+
+void TriangularKernels::forward(const ResponseMatrix &rema, const Double_t *p, Double_t *prediction, const Int_t first_bin, const Int_t last_bin){
+	forwardParallel(rema, p, prediction, first_bin, last_bin, false);
+}
+
+void TriangularKernels::forwardSquared(const ResponseMatrix &rema, const Double_t *p, Double_t *prediction, const Int_t first_bin, const Int_t last_bin){
+	forwardParallel(rema, p, prediction, first_bin, last_bin, true);
+}
+
+void TriangularKernels::forwardUncertainty(const ResponseMatrix &rema, const Double_t *p, const Double_t *w, Double_t *simulation, Double_t *spectrum, const Int_t first_bin, const Int_t last_bin){
+	uncertaintyParallel(rema, p, w, simulation, spectrum, first_bin, last_bin);
+}
+
+void TriangularKernels::adjoint(const ResponseMatrix &rema, const Double_t *r, Double_t *result, const Int_t first_bin, const Int_t last_bin){
+	adjointParallel(rema, r, result, first_bin, last_bin, false);
+}
+
+void TriangularKernels::adjointSquared(const ResponseMatrix &rema, const Double_t *r, Double_t *result, const Int_t first_bin, const Int_t last_bin){
+	adjointParallel(rema, r, result, first_bin, last_bin, true);
+}
+
+void TriangularKernels::addRow(const ResponseMatrix &rema, const Int_t row, const Double_t factor, Double_t *prediction, const Int_t first_bin){
+	for(Int_t j = first_bin; j <= row; ++j){
+		prediction[j] += factor*rema.column(j)[row - j];
+	}
+}
+
+const char* TriangularKernels::instructionSet(){
+	return kernels().name;
+}
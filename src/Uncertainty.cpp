@@ -15,37 +15,41 @@
     along with Horst.  If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
+
 #include "Config.h"
-#include "FitFunction.h"
+#include "TriangularKernels.h"
 #include "Uncertainty.h"
 
-void Uncertainty::getUncertainty(const TH1F &params, const TH2F &rema, TH1F &simulation_statistical_uncertainty, const Int_t binstart, const Int_t binstop){
-	FitFunction fitFunction("rema_stat", rema, BINNING, binstart, binstop);
+void Uncertainty::getUncertainty(const TH1F &params, const ResponseMatrix &rema, TH1F &simulation_statistical_uncertainty, const Int_t binstart, const Int_t binstop){
+	vector<Double_t> parameters;
+	vector<Double_t> simulation_uncertainty;
+	vector<Double_t> spectrum_uncertainty;
+	getParameters(params, rema, binstart, binstop, parameters);
+	const vector<Double_t> weights(parameters.size(), 0.);
+	getStatisticalUncertainties(parameters, weights, rema, binstart, binstop, simulation_uncertainty, spectrum_uncertainty);
 
 	for(Int_t i = 1; i <= (Int_t) NBINS/ (Int_t) BINNING; ++i){
-		if(i < binstart || i > binstop){
-			simulation_statistical_uncertainty.SetBinContent(i, 0.);
-		} else{
-			simulation_statistical_uncertainty.SetBinContent(i, fitFunction.getSimulationStatisticalUncertainty(i, params));
-		}
+		simulation_statistical_uncertainty.SetBinContent(i, simulation_uncertainty[(size_t) i]);
 	}
 }
 
-void Uncertainty::getUncertainty(const TH1F &params, const TH1F &spectrum, const TH2F &rema, TH1F &simulation_statistical_uncertainty, TH1F &spectrum_statistical_uncertainty, const Int_t binstart, const Int_t binstop){
-	FitFunction fitFunction("rema_unc", rema, BINNING, binstart, binstop);
+void Uncertainty::getUncertainty(const TH1F &params, const TH1F &spectrum, const ResponseMatrix &rema, TH1F &simulation_statistical_uncertainty, TH1F &spectrum_statistical_uncertainty, const Int_t binstart, const Int_t binstop){
+	vector<Double_t> parameters;
+	vector<Double_t> weights;
+	vector<Double_t> simulation_uncertainty;
+	vector<Double_t> spectrum_uncertainty;
+	getParameters(params, rema, binstart, binstop, parameters);
+	getWeights(parameters, spectrum, rema, binstart, binstop, weights);
+	getStatisticalUncertainties(parameters, weights, rema, binstart, binstop, simulation_uncertainty, spectrum_uncertainty);
 
 	for(Int_t i = 1; i <= (Int_t) NBINS/ (Int_t) BINNING; ++i){
-		if(i < binstart || i > binstop){
-			simulation_statistical_uncertainty.SetBinContent(i, 0.);
-			spectrum_statistical_uncertainty.SetBinContent(i, 0.);
-		} else{
-			simulation_statistical_uncertainty.SetBinContent(i, fitFunction.getSimulationStatisticalUncertainty(i, params));
-			spectrum_statistical_uncertainty.SetBinContent(i, fitFunction.getSpectrumStatisticalUncertainty(i, params, spectrum));
-		}
+		simulation_statistical_uncertainty.SetBinContent(i, simulation_uncertainty[(size_t) i]);
+		spectrum_statistical_uncertainty.SetBinContent(i, spectrum_uncertainty[(size_t) i]);
 	}
 }
 
-void Uncertainty::getTotalUncertainty(vector<TH1F*> &uncertainties, TH1F &total_uncertainty){
+void Uncertainty::getTotalUncertainty(const vector<const TH1F*> &uncertainties, TH1F &total_uncertainty){
 	Double_t bin_content = 0.;
 
 	for(Int_t i = 1; i <= (Int_t) NBINS/ (Int_t) BINNING; ++i){
@@ -84,3 +88,47 @@ void Uncertainty::getLowerAndUpperLimit(const TH1F &spectrum, const TH1F &uncert
 	}
 }
 
+void Uncertainty::getParameters(const TH1F &params, const ResponseMatrix &rema, const Int_t binstart, const Int_t binstop, vector<Double_t> &parameters){
+	// Bin 0 is the underflow bin, whose response is zero.
+	const Int_t first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t last_bin = binstop < rema.GetNbins() ? binstop : rema.GetNbins();
+
+	const Int_t n = (Int_t) NBINS/ (Int_t) BINNING > rema.GetNbins() ? (Int_t) NBINS/ (Int_t) BINNING : rema.GetNbins();
+	parameters.assign((size_t) n + 2, 0.);
+	for(Int_t i = first_bin; i <= last_bin; ++i){
+		parameters[(size_t) i] = params.GetBinContent(i);
+	}
+}
+
+void Uncertainty::getWeights(const vector<Double_t> &parameters, const TH1F &spectrum, const ResponseMatrix &rema, const Int_t binstart, const Int_t binstop, vector<Double_t> &weights){
+	// p_i^2/s_i, ignoring bins with negative values (should not be in the original spectrum anyway)
+	// or zero content.
+	const Int_t first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t last_bin = binstop < rema.GetNbins() ? binstop : rema.GetNbins();
+
+	weights.assign(parameters.size(), 0.);
+	Double_t spectrum_bin_content = 0.;
+	for(Int_t i = first_bin; i <= last_bin; ++i){
+		spectrum_bin_content = spectrum.GetBinContent(i);
+		if(spectrum_bin_content > 0.){
+			weights[(size_t) i] = parameters[(size_t) i]*parameters[(size_t) i]/spectrum_bin_content;
+		}
+	}
+}
+
+void Uncertainty::getStatisticalUncertainties(const vector<Double_t> &parameters, const vector<Double_t> &weights, const ResponseMatrix &rema, const Int_t binstart, const Int_t binstop, vector<Double_t> &simulation_uncertainty, vector<Double_t> &spectrum_uncertainty){
+	// Simulation: sqrt(sum_{i > j} p_i R(i, j)), i.e. the response of all higher bins in bin j.
+	// Spectrum: sqrt(sum_{i >= j} p_i^2/s_i R(i, j)^2).
+	// Both are obtained from the same walk through column j of the matrix.
+	const Int_t first_bin = binstart < 1 ? 1 : binstart;
+	const Int_t last_bin = binstop < rema.GetNbins() ? binstop : rema.GetNbins();
+
+	simulation_uncertainty.assign(parameters.size(), 0.);
+	spectrum_uncertainty.assign(parameters.size(), 0.);
+	TriangularKernels::forwardUncertainty(rema, &parameters[0], &weights[0], &simulation_uncertainty[0], &spectrum_uncertainty[0], first_bin, last_bin);
+
+	for(Int_t j = first_bin; j <= last_bin; ++j){
+		simulation_uncertainty[(size_t) j] = sqrt(simulation_uncertainty[(size_t) j]);
+		spectrum_uncertainty[(size_t) j] = sqrt(spectrum_uncertainty[(size_t) j]);
+	}
+}
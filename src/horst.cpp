@@ -19,21 +19,38 @@
 #include <TCanvas.h>
 #include <TF1.h>
 #include <TFile.h>
+#include <TKey.h>
+#include <TNamed.h>
 #include <TMatrixDSym.h>
 #include <TROOT.h>
 #include <TStyle.h>
+#include <TSystem.h>
+#include <TTree.h>
 
 #include <argp.h>
+#include <atomic>
 #include <iostream>
+#include <map>
+#include <mutex>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sstream>
 #include <time.h>
 
 #include "Config.h"
 #include "Fitter.h"
 #include "InputFileReader.h"
+#include "LinearizedFit.h"
+#include "MonteCarloCheckpoint.h"
 #include "MonteCarloUncertainty.h"
+#include "MonteCarloWriter.h"
 #include "Reconstructor.h"
+#include "ResponseMatrix.h"
+#include "RunningCovariance.h"
+#include "RunningStatistics.h"
+#include "ThreadPool.h"
+#include "TriangularKernels.h"
 #include "Uncertainty.h"
 
 using std::cout;
@@ -63,8 +80,30 @@ struct Arguments{
 	Bool_t topdown_only = false;
 	Bool_t verbose = false;
 	Bool_t correlation = false;
+	FitSolver solver = FitSolver::minuit;
+	UnfoldingMethod method = UnfoldingMethod::fit;
+	UInt_t iterations = 100;
+	UInt_t threads = 0;
+	UInt_t mc_flush = 100;
+	Double_t mc_normal_threshold = MC_NORMAL_THRESHOLD;
+	Bool_t mc_linear = false;
+	Bool_t mc_sharded = false;
+	UInt_t mc_shard = 0;
+	UInt_t mc_n_shards = 1;
+	UInt_t mc_checkpoint = 0;
+	Bool_t resume = false;
+	UInt_t mc_interrupt = 0;
+	Double_t mc_precision = 0.;
+	UInt_t mc_min_iterations = MC_MIN_ITERATIONS;
+	MCSampling mc_sampling = MCSampling::random;
+	TString mc_sampling_name = "random";
+	vector<Double_t> mc_percentiles;
+	Bool_t mc_covariance = false;
 };
 
+// Keys for options which only have a long name
+enum LongOption { OPTION_SOLVER = 256, OPTION_METHOD, OPTION_ITERATIONS, OPTION_THREADS, OPTION_MC_FLUSH, OPTION_MC_NORMAL_THRESHOLD, OPTION_MC_LINEAR, OPTION_MC_SHARD, OPTION_MC_CHECKPOINT, OPTION_RESUME, OPTION_MC_INTERRUPT, OPTION_MC_PRECISION, OPTION_MC_MIN_ITERATIONS, OPTION_MC_SAMPLING, OPTION_MC_PERCENTILES, OPTION_MC_COVARIANCE };
+
 static char doc[] = "Horst, Histogram original reconstruction spectrum tool";
 static char args_doc[] = "INPUTFILENAME";
 
@@ -74,7 +113,7 @@ static struct argp_option options[] = {
 	{"uncertainty_mc", 'u', "NRANDOM", 0, "Determine uncertainty using a Monte-Carlo (MC) method to include correlations. NRANDOM is the number of MC iterations (default: 10).", 0},
 	{"uncertainty_mc_fast", 'U', "NRANDOM", 0, "Similar to '-u' option, but do not vary the response matrix when estimating the statistical uncertainty. This option can be used to disentangle the statistical uncertainty introduced by the input spectrum and the response matrix. Overrides the '-u' option if both are set. NRANDOM is the number of MC iterations (default: 10).", 0},
 	{"write_mc", 'w', 0, 0, "Write MC-generated spectra and reconstructed spectra. This option is ignored if '-u' option is not used. (default: false)", 0},
-	{"write_mc_only", 'W', 0, 0, "Similar to '-w' option, but does not evaluate MC results afterwards (i.e. leaves calculation of mean value and uncertainties to the user). The advantage compared to the '-w' option is that horst does not have to keep all MC spectra in memory until the end of the program execution, potentially saving a lot of RAM. MC spectra are dumped to file immediately. (default: false)", 0},
+	{"write_mc_only", 'W', 0, 0, "Similar to '-w' option, but does not evaluate MC results afterwards (i.e. leaves calculation of mean value and uncertainties to the user). With both options, MC spectra are dumped to file immediately and not kept in memory. (default: false)", 0},
 	{"outputfile", 'o', "OUTPUTFILENAME", 0, "Name of output file (default: output.root).", 0},
 	{"left", 'l', "LEFT", 0, "Left limit of fit range (default: 0).", 0},
 	{"right", 'r', "RIGHT", 0, "Right limit of fit range (default: NBINS)", 0},
@@ -82,10 +121,26 @@ static struct argp_option options[] = {
 	{"interactive_mode", 'i', 0, 0, "Interactive mode: show results in ROOT application (default: false).", 0},
 	{"tfile", 't', "SPECTRUM", 0, "Select SPECTRUM from a ROOT file called INPUTFILENAME, instead of a text file."
 	" Spectrum must be an object of TH1F. (default: none, i.e. don't read from ROOT file)", 0},
-	{"topdown_only", 'T', 0, 0, "Do not fit, just run the TopDown algorithm (default: false). This will put the TopDown-unfolded spectra into the top-level directory of the ROOT output file, and create an additional 2D matrix that contains the intermediate spectra at each step of the algorithms procedure.", 0},
+	{"topdown_only", 'T', 0, 0, "Do not fit, just run the TopDown algorithm (default: false). This will put the TopDown-unfolded spectra into the top-level directory of the ROOT output file, and create an additional tree that contains the intermediate spectra at each step of the algorithms procedure.", 0},
 	{"correlation", 'c', "CORRELATIONFILENAME", 0, "Write the correlation matrix of the fit to the specified output file. If the '-u' option is used, only one correlation matrix will be written, although NRANDOM fits are executed. (default: none, i.e. do not write write correlation file)", 0},
 	{"seed", 's', "SEED", 0, "Set the random number seed (default: 1. This ensures that a call of Horst with the same arguments gives the same results.)", 0},
 	{"verbose", 'v', 0, 0, "Enable ROOT to print verbose information about the fitting process (default: false)", 0},
+	{"solver", OPTION_SOLVER, "SOLVER", 0, "Algorithm for the fit. 'minuit': Minuit2 minimization of the chi^2 with bounds on all parameters. 'nnls': Non-negative least-squares active-set algorithm, which solves the same problem directly and is usually much faster for large numbers of bins. 'lbfgs': Bounded limited-memory quasi-Newton method, which needs only memory linear in the number of bins and can be used for fine binnings (e.g. '-b 1'). With 'lbfgs', the fit uncertainty is the uncertainty of each parameter with all other parameters fixed, which underestimates the true uncertainty; use the Monte-Carlo method ('-u') for reliable uncertainties. (default: minuit)", 0},
+	{"method", OPTION_METHOD, "METHOD", 0, "Unfolding method after the TopDown algorithm. 'fit': chi^2 fit with the solver given by '--solver'. 'mlem': Iterative maximum-likelihood expectation maximization (Richardson-Lucy), which assumes Poisson-distributed bin contents and is well suited for spectra with low counts. The results are stored like the results of the fit. (default: fit)", 0},
+	{"iterations", OPTION_ITERATIONS, "NITERATIONS", 0, "Number of iterations of the MLEM method. More iterations reproduce the spectrum more closely, but amplify statistical fluctuations. The MC spectra of the '-u' and '-U' options are unfolded with the same number of iterations, starting from the TopDown result like the original spectrum. (default: 100)", 0},
+	{"threads", OPTION_THREADS, "NTHREADS", 0, "Number of threads for the products with the response matrix and for the Monte-Carlo iterations. The results do not depend on the number of threads. (default: value of the environment variable HORST_THREADS or, if not set, the number of hardware threads)", 0},
+	{"mc-flush", OPTION_MC_FLUSH, "NITERATIONS", 0, "With the '-w' or '-W' option, save the MC histograms which have been written so far to the output file every NITERATIONS iterations. The histograms are written by a separate thread, which keeps the output file open. 0 means that the file is only saved at the end. (default: 100)", 0},
+	{"mc-normal-threshold", OPTION_MC_NORMAL_THRESHOLD, "MEAN", 0, "With the '-u' option, sample elements of the response matrix whose content is at least MEAN from a normal distribution instead of a Poisson distribution, which is faster. 0 means that all elements are sampled from a Poisson distribution. (default: 1000)", 0},
+	{"mc-linear", OPTION_MC_LINEAR, 0, 0, "With the '-U' option, calculate the fit parameters of each MC spectrum from the normal equations of the fit of the original spectrum, which are factorized only once, instead of fitting the spectrum again. This linearization is exact as long as the same parameters are at their bound of zero and the uncertainties of the original spectrum are used as weights. Spectra for which a parameter would reach or leave the bound are solved with the NNLS solver for the same weights, independent of the '--solver' option. Ignored with the '-u' option, which varies the response matrix, and with '--method mlem'. (default: false)", 0},
+	{"mc-shard", OPTION_MC_SHARD, "K/N", 0, "Run only the K-th of N parts (K = 0, ..., N-1) of the MC iterations of the '-u' or '-U' option, and write the accumulated MC statistics to the output file instead of the MC results. Each iteration uses the same random numbers as in a single run, so the N parts, which can run in separate processes with otherwise identical options, give the same results as a single run when they are combined with 'horst_merge'. (default: none, i.e. run all MC iterations)", 0},
+	{"mc-checkpoint", OPTION_MC_CHECKPOINT, "NITERATIONS", 0, "Every NITERATIONS MC iterations, save the accumulated MC statistics to the checkpoint file OUTPUTFILENAME.checkpoint, from which an interrupted run can be resumed with the '--resume' option. The checkpoint file is removed when the output file has been written. 0 means that no checkpoints are written. (default: 0)", 0},
+	{"resume", OPTION_RESUME, 0, 0, "Continue the MC iterations after the last checkpoint of an interrupted run with the same options (see '--mc-checkpoint'). If there is no checkpoint file, all MC iterations are run. With the '-w' or '-W' option, the output file of the interrupted run is continued: it keeps the MC histograms of the iterations before the checkpoint, which are not written again. (default: false)", 0},
+	{"mc-interrupt", OPTION_MC_INTERRUPT, "NITERATIONS", 0, "Stop the MC iterations at the first checkpoint after NITERATIONS iterations and exit without writing the MC results, as if the run was interrupted. The checkpoint file is kept for the '--resume' option. Requires '--mc-checkpoint'. Intended for tests of the '--resume' option. 0 means that the run is not interrupted. (default: 0)", 0},
+	{"mc-precision", OPTION_MC_PRECISION, "PRECISION", 0, "Stop the MC iterations of the '-u' or '-U' option as soon as the relative standard error of the MC uncertainty of each fit parameter is at most PRECISION, which is checked every 10 iterations. NRANDOM is the maximum number of iterations. The relative uncertainty of the reconstructed spectrum is smaller. Cannot be combined with '--mc-shard', because each shard would stop on its own. 0 means that NRANDOM iterations are run. (default: 0)", 0},
+	{"mc-min-iterations", OPTION_MC_MIN_ITERATIONS, "NITERATIONS", 0, "With the '--mc-precision' option, run at least NITERATIONS MC iterations. (default: 100)", 0},
+	{"mc-sampling", OPTION_MC_SAMPLING, "STRATEGY", 0, "Random numbers for the fluctuations of the MC iterations. 'random': independent random numbers. 'antithetic': Pairs of iterations with opposite fluctuations, which reduces the variance of the MC mean values. 'sobol': Scrambled quasi-random numbers, which stratify the fluctuations of each bin and reduce the variance of all MC results, preferably with a number of iterations that is a power of 2. The strategy is stored in the output file. With 'antithetic' and 'sobol', the iterations are not independent, so the precision of the '--mc-precision' option is underestimated. (default: random)", 0},
+	{"mc-percentiles", OPTION_MC_PERCENTILES, "LIST", 0, "Comma-separated list of percentiles (0 to 100) of the MC distributions of the fit parameters, the FEP and the reconstructed spectrum, which are written to the output file as histograms like 'mc_fit_params_p16'. Unlike the mean value +- the standard deviation, the percentiles describe asymmetric distributions, e.g. of bins with few counts. They are estimated with a t-digest of each bin, which does not store the MC samples, but needs up to about 10 kB of memory per bin, also in the checkpoint and shard files. Example: '16,50,84'. 'none' disables the percentiles. (default: none)", 0},
+	{"mc-covariance", OPTION_MC_COVARIANCE, 0, 0, "Accumulate the covariance matrix of the reconstructed spectrum in the fit range [BINSTART, BINSTOP] over the MC iterations of the '-u' or '-U' option, and write it to the output file as the vector 'monte_carlo/mc_reconstruction_covariance', which contains the first and the last bin, followed by the lower triangle of the symmetric matrix, packed row by row. The matrix needs memory quadratic in the number of bins. Ignored with the '-W' option. (default: false)", 0},
 	{ 0, 0, 0, 0, 0, 0}
 };
 
@@ -110,6 +165,76 @@ static int parse_opt(int key, char *arg, struct argp_state *state){
 		case 'c': arguments->correlation = true; arguments->correlation_matrix_filename = arg; break;
 		case 's': arguments->seed = (UInt_t) atoi(arg); break;
 		case 'v': arguments->verbose = true; break;
+		case OPTION_SOLVER:
+			if(strcmp(arg, "minuit") == 0){
+				arguments->solver = FitSolver::minuit;
+			} else if(strcmp(arg, "nnls") == 0){
+				arguments->solver = FitSolver::nnls;
+			} else if(strcmp(arg, "lbfgs") == 0){
+				arguments->solver = FitSolver::lbfgs;
+			} else{
+				cout << "Error: Unknown solver '" << arg << "'. Valid solvers are 'minuit', 'nnls' and 'lbfgs'. Aborting ..." << endl;
+				abort();
+			}
+			break;
+		case OPTION_METHOD:
+			if(strcmp(arg, "fit") == 0){
+				arguments->method = UnfoldingMethod::fit;
+			} else if(strcmp(arg, "mlem") == 0){
+				arguments->method = UnfoldingMethod::mlem;
+			} else{
+				cout << "Error: Unknown method '" << arg << "'. Valid methods are 'fit' and 'mlem'. Aborting ..." << endl;
+				abort();
+			}
+			break;
+		case OPTION_ITERATIONS: arguments->iterations = (UInt_t) atoi(arg); break;
+		case OPTION_THREADS: arguments->threads = (UInt_t) atoi(arg); break;
+		case OPTION_MC_FLUSH: arguments->mc_flush = (UInt_t) atoi(arg); break;
+		case OPTION_MC_NORMAL_THRESHOLD: arguments->mc_normal_threshold = atof(arg); break;
+		case OPTION_MC_LINEAR: arguments->mc_linear = true; break;
+		case OPTION_MC_SHARD:
+			if(sscanf(arg, "%u/%u", &arguments->mc_shard, &arguments->mc_n_shards) != 2 || arguments->mc_shard >= arguments->mc_n_shards){
+				cout << "Error: Invalid shard '" << arg << "'. The shard must have the form K/N with 0 <= K < N. Aborting ..." << endl;
+				abort();
+			}
+			arguments->mc_sharded = true;
+			break;
+		case OPTION_MC_CHECKPOINT: arguments->mc_checkpoint = (UInt_t) atoi(arg); break;
+		case OPTION_RESUME: arguments->resume = true; break;
+		case OPTION_MC_INTERRUPT: arguments->mc_interrupt = (UInt_t) atoi(arg); break;
+		case OPTION_MC_PRECISION: arguments->mc_precision = atof(arg); break;
+		case OPTION_MC_MIN_ITERATIONS: arguments->mc_min_iterations = (UInt_t) atoi(arg); break;
+		case OPTION_MC_SAMPLING:
+			if(strcmp(arg, "random") == 0){
+				arguments->mc_sampling = MCSampling::random;
+			} else if(strcmp(arg, "antithetic") == 0){
+				arguments->mc_sampling = MCSampling::antithetic;
+			} else if(strcmp(arg, "sobol") == 0){
+				arguments->mc_sampling = MCSampling::sobol;
+			} else{
+				cout << "Error: Unknown sampling strategy '" << arg << "'. Valid strategies are 'random', 'antithetic' and 'sobol'. Aborting ..." << endl;
+				abort();
+			}
+			arguments->mc_sampling_name = arg;
+			break;
+		case OPTION_MC_PERCENTILES:
+			arguments->mc_percentiles.clear();
+			if(strcmp(arg, "none") != 0){
+				const char *position = arg;
+				char *end = nullptr;
+				Double_t percentile = 0.;
+				while(*position != '\0'){
+					percentile = strtod(position, &end);
+					if(end == position || (*end != ',' && *end != '\0') || percentile < 0. || percentile > 100.){
+						cout << "Error: Invalid list of percentiles '" << arg << "'. The percentiles must be numbers between 0 and 100, separated by commas. Aborting ..." << endl;
+						abort();
+					}
+					arguments->mc_percentiles.push_back(percentile);
+					position = *end == ',' ? end + 1 : end;
+				}
+			}
+			break;
+		case OPTION_MC_COVARIANCE: arguments->mc_covariance = true; break;
 		case ARGP_KEY_END:
 			if(state->arg_num == 0){
 				argp_usage(state);
@@ -118,6 +243,15 @@ static int parse_opt(int key, char *arg, struct argp_state *state){
 				cout << "Error: No matrix file given. Aborting ..." << endl;
 				abort();
 			}
+			// Shards which stop on their own convergence do not combine to the iterations of a single run
+			if(arguments->mc_sharded && arguments->mc_precision > 0.){
+				cout << "Error: The '--mc-precision' option cannot be combined with '--mc-shard'. Aborting ..." << endl;
+				abort();
+			}
+			if(arguments->mc_interrupt > 0 && arguments->mc_checkpoint == 0){
+				cout << "Error: The '--mc-interrupt' option requires '--mc-checkpoint'. Aborting ..." << endl;
+				abort();
+			}
 			break;
 		default: return ARGP_ERR_UNKNOWN;
 	}
@@ -126,6 +260,49 @@ static int parse_opt(int key, char *arg, struct argp_state *state){
 
 static struct argp argp = { options, parse_opt, args_doc, doc, 0, 0, 0};
 
+// Remove the histograms of the iterations from first_removed_iteration on from the MC directories of
+// the output file. An interrupted run may have written them after its last checkpoint, and the
+// resumed run writes them again.
+static void removeMonteCarloHistograms(const string &filename, const vector<string> &directories, const UInt_t first_removed_iteration){
+	TFile file(filename.c_str(), "UPDATE");
+	TDirectory *directory = nullptr;
+	TKey *key = nullptr;
+	vector<TString> names;
+	TString name;
+	Ssiz_t separator = 0;
+
+	for(auto &directory_name: directories){
+		directory = file.GetDirectory(directory_name.c_str());
+		if(directory == nullptr){
+			continue;
+		}
+
+		// The histograms are called like 'mc_spectrum_<iteration>'
+		names.clear();
+		TIter next(directory->GetListOfKeys());
+		while((key = (TKey*) next()) != nullptr){
+			name = key->GetName();
+			separator = name.Last('_');
+			if(separator != kNPOS && (UInt_t) atoi(name.Data() + separator + 1) >= first_removed_iteration){
+				names.push_back(name);
+			}
+		}
+		for(auto &removed_name: names){
+			directory->Delete(removed_name + ";*");
+		}
+	}
+
+	file.Close();
+}
+
+// Copy the bin contents of a histogram, including the underflow and overflow bins
+static void getBinContents(const TH1F &histogram, vector<Double_t> &content){
+	content.resize((size_t) histogram.GetNbinsX() + 2);
+	for(Int_t i = 0; i <= histogram.GetNbinsX() + 1; ++i){
+		content[(size_t) i] = histogram.GetBinContent(i);
+	}
+}
+
 int main(int argc, char* argv[]){
 
 	time_t start, stop;
@@ -135,6 +312,7 @@ int main(int argc, char* argv[]){
 
 	Arguments arguments;
 	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+	ThreadPool::setDefaultSize(arguments.threads);
 
 	/************ Initialize auxiliary classes *************/
 
@@ -153,7 +331,7 @@ int main(int argc, char* argv[]){
 
 	TMatrixDSym correlation_matrix(nbins);
 	Reconstructor reconstructor(arguments.binning);
-	MonteCarloUncertainty monteCarloUncertainty(arguments.binning, arguments.seed);
+	MonteCarloUncertainty monteCarloUncertainty(arguments.binning, arguments.seed, arguments.mc_normal_threshold, arguments.mc_sampling);
 	Uncertainty uncertainty(arguments.binning);
 
 
@@ -162,7 +340,8 @@ int main(int argc, char* argv[]){
 	// Input
 	TH1F spectrum = TH1F("spectrum", "Input Spectrum",  (Int_t) NBINS, 0., max_bin);
 	TH1F n_simulated_particles("n_simulated_particles", "Number of simulated particles per bin", NBINS, 0., max_bin);
-	TH2F response_matrix("rema", "Response_Matrix", NBINS, 0., (Double_t) (NBINS - 1), NBINS, 0., max_bin);
+	// Only needed until it is converted to the packed ResponseMatrix
+	TH2F *response_matrix_histogram = new TH2F("rema", "Response_Matrix", NBINS, 0., (Double_t) (NBINS - 1), NBINS, 0., max_bin);
 
 	// TopDown algorithm
 
@@ -173,7 +352,6 @@ int main(int argc, char* argv[]){
 	TH1F topdown_total_uncertainty("topdown_total_uncertainty", "TopDown Total Uncertainty", nbins, 0., max_bin);
 	TH1F topdown_FEP("topdown_FEP", "TopDown FEP", nbins, 0., max_bin); 
 	TH1F topdown_spectrum_reconstructed("topdown_spectrum_reconstructed", "TopDown Spectrum Reconstructed", nbins, 0., max_bin);
-	TH2F topdown_steps("topdown_steps", "topdown_steps", nbins, 0., max_bin, nbins, 0., max_bin);
 
 	// Fit
 	TH1F fit_params("fit_params", "Fit Parameters", nbins, 0., max_bin);
@@ -193,17 +371,19 @@ int main(int argc, char* argv[]){
 	TH1F reconstruction_uncertainty_up("reconstruction_uncertainty_up", "Reconstruction Uncertainty upper Limit", nbins, 0., max_bin);
 
 	// Monte-Carlo Uncertainty
-	vector<TH1F*> mc_spectra;
-	vector<TH1F*> mc_fit_params_samples;
-	vector<TH1F*> mc_FEP_samples;
-	vector<TH1F*> mc_reconstruction_samples;
-
-	TH2F mc_matrix;
-	TH1F mc_fit_params, mc_fit_params_mean, mc_fit_params_uncertainty, mc_fit_total_uncertainty;
-	TH1F mc_fit_FEP, mc_fit_FEP_uncertainty;
-	TH1F mc_FEP_uncertainty_low, mc_FEP_uncertainty_up;
-	TH1F mc_spectrum_reconstructed, mc_reconstruction_uncertainty;
-	TH1F mc_reconstruction_uncertainty_low, mc_reconstruction_uncertainty_up;
+	// The fit parameters of each MC iteration are accumulated in mc_fit_params_statistics and
+	// discarded afterwards, so the memory does not depend on the number of iterations.
+	RunningStatistics mc_fit_params_statistics(binstart, binstop > nbins ? nbins : binstop, !arguments.mc_percentiles.empty());
+	MonteCarloCheckpoint *mc_checkpoint = nullptr;
+	// Options which determine the MC results. They have to be the same in all shards of a run and
+	// when a run is resumed from a checkpoint.
+	vector<Double_t> mc_run_parameters;
+	// With the '--mc-covariance' option, the covariance of the fit parameters is accumulated as well.
+	RunningCovariance *mc_fit_params_covariance = nullptr;
+	MonteCarloResults mc_results;
+	// The evaluation of the MC iterations only needs the diagonal of the response matrix, which is
+	// also written to the shards for 'horst_merge'
+	TH1F response_matrix_diagonal("response_matrix_diagonal", "Diagonal of the Response Matrix", nbins, 0., max_bin);
 
 	/************ Start ROOT application *************/
 
@@ -225,12 +405,20 @@ int main(int argc, char* argv[]){
 	spectrum.Rebin( (Int_t) arguments.binning);
 
 	cout << "> Reading matrix file " << arguments.matrixfile << " ..." << endl;
-	inputFileReader.readMatrix(response_matrix, n_simulated_particles, arguments.matrixfile);
+	inputFileReader.readMatrix(*response_matrix_histogram, n_simulated_particles, arguments.matrixfile);
 	cout << "> Rebinning response matrix ..." << endl;
-	response_matrix.Rebin2D((Int_t) arguments.binning, (Int_t) arguments.binning);
+	response_matrix_histogram->Rebin2D((Int_t) arguments.binning, (Int_t) arguments.binning);
 	n_simulated_particles.Rebin((Int_t) arguments.binning);
 
-	Fitter fitter(response_matrix, arguments.binning, binstart, binstop);
+	// This is the only copy of the response matrix. All other objects, including the Fitters of the
+	// Monte-Carlo workers, refer to it. Only the fluctuated matrices of the '-u' option are copies.
+	ResponseMatrix response_matrix(*response_matrix_histogram);
+	delete response_matrix_histogram;
+
+	Fitter fitter(response_matrix, arguments.binning, binstart, binstop, arguments.solver, arguments.method, arguments.iterations);
+	if(arguments.verbose){
+		cout << "> Using " << TriangularKernels::instructionSet() << " kernels and " << ThreadPool::instance().size() << " threads for products with the response matrix" << endl;
+	}
 
 	/************ Create output file *****************/
 
@@ -239,13 +427,19 @@ int main(int argc, char* argv[]){
 	stringstream outputfilename;
 	outputfilename << arguments.outputfile;
 
-	TFile *outputfile = new TFile(outputfilename.str().c_str(), "RECREATE");
+	// If an interrupted run with the '-w' or '-W' option is resumed from a checkpoint, its output file
+	// already contains the MC histograms of the iterations before the checkpoint, so it is continued.
+	const string checkpoint_filename = string(arguments.outputfile.Data()) + ".checkpoint";
+	// AccessPathName() returns true if the file does NOT exist
+	const Bool_t resume_output = arguments.resume && arguments.use_mc && arguments.write_mc && !arguments.topdown_only && !gSystem->AccessPathName(checkpoint_filename.c_str());
+	if(resume_output && gSystem->AccessPathName(outputfilename.str().c_str())){
+		cout << "Error: Output file " << arguments.outputfile << " of the interrupted run with the checkpoint " << checkpoint_filename << " does not exist, so the MC histograms of the iterations before the checkpoint are missing. Aborting ..." << endl;
+		abort();
+	}
+
+	TFile *outputfile = new TFile(outputfilename.str().c_str(), resume_output ? "UPDATE" : "RECREATE");
 
 	TDirectory *td_mc = nullptr;
-	TDirectory *td_mc_spectra = nullptr;
-	TDirectory *td_mc_fit_parameters = nullptr;
-	TDirectory *td_mc_FEP = nullptr;
-	TDirectory *td_mc_reconstructed = nullptr;
 
 	outputfile->Close();
 
@@ -253,7 +447,33 @@ int main(int argc, char* argv[]){
 
 	cout << "> Unfold spectrum using top-down algorithm ..." << endl;
 	if(arguments.topdown_only){
-		fitter.topdown(spectrum, response_matrix, topdown_params, binstart, binstop, topdown_steps);
+		// Stream the intermediate spectra into the output file, one tree entry per step,
+		// instead of keeping a matrix with nbins x nbins elements in memory.
+		// Element k of the 'spectrum' branch is bin first_step_bin + k.
+		const Int_t first_step_bin = binstart < 1 ? 1 : binstart;
+		const Int_t last_step_bin = binstop > nbins ? nbins : binstop;
+		const Int_t n_step_bins = last_step_bin >= first_step_bin ? last_step_bin - first_step_bin + 1 : 0;
+
+		Int_t topdown_step_bin = 0;
+		vector<Double_t> topdown_step_spectrum((size_t) n_step_bins + 1, 0.);
+
+		outputfile = new TFile(outputfilename.str().c_str(), "UPDATE");
+		TTree *topdown_steps = new TTree("topdown_steps", "Remaining spectrum after each step of the TopDown algorithm");
+		stringstream leaflist;
+		leaflist << "spectrum[" << n_step_bins << "]/D";
+		topdown_steps->Branch("bin", &topdown_step_bin, "bin/I");
+		topdown_steps->Branch("spectrum", &topdown_step_spectrum[0], leaflist.str().c_str());
+
+		fitter.topdown(spectrum, response_matrix, topdown_params, binstart, binstop, [&](const Int_t bin, const vector<Double_t> &remaining_spectrum){
+			topdown_step_bin = bin;
+			for(Int_t j = 0; j < n_step_bins; ++j){
+				topdown_step_spectrum[(size_t) j] = remaining_spectrum[(size_t) (first_step_bin + j)];
+			}
+			topdown_steps->Fill();
+		});
+
+		topdown_steps->Write();
+		outputfile->Close(); // Also deletes the tree
 	} else {
 		fitter.topdown(spectrum, response_matrix, topdown_params, binstart, binstop);
 	}
@@ -265,7 +485,7 @@ int main(int argc, char* argv[]){
 
 	uncertainty.getUncertainty(topdown_params, spectrum, response_matrix, topdown_simulation_uncertainty, topdown_spectrum_uncertainty, binstart, binstop);
 
-	vector<TH1F*> topdown_uncertainties(2);
+	vector<const TH1F*> topdown_uncertainties(2);
 	topdown_uncertainties[0] = &topdown_simulation_uncertainty;
 	topdown_uncertainties[1] = &topdown_spectrum_uncertainty;
 	uncertainty.getTotalUncertainty(topdown_uncertainties, topdown_total_uncertainty);
@@ -275,7 +495,11 @@ int main(int argc, char* argv[]){
 	/************ Fit *************/
 
 	if(!arguments.topdown_only){
-		cout << "> Fit spectrum using TopDown parameters as start parameters ..." << endl;
+		if(arguments.method == UnfoldingMethod::mlem){
+			cout << "> Unfold spectrum with " << arguments.iterations << " MLEM iterations using TopDown parameters as start parameters ..." << endl;
+		} else{
+			cout << "> Fit spectrum using TopDown parameters as start parameters ..." << endl;
+		}
 
 		fitter.fit(spectrum, response_matrix, topdown_params, fit_params, fit_algorithm_uncertainty, binstart, binstop, arguments.verbose, arguments.correlation, correlation_matrix);
 
@@ -287,154 +511,264 @@ int main(int argc, char* argv[]){
 		reconstructor.reconstruct(fit_params, n_simulated_particles, spectrum_reconstructed);
 
 		if(arguments.use_mc){
-			// Create directories in TFile for MC output
-
+			// Create directories in TFile for MC output, unless they are continued from an interrupted run
+			const vector<string> mc_directories = {"monte_carlo/spectra", "monte_carlo/fit_parameters", "monte_carlo/fep", "monte_carlo/reconstructed"};
 			outputfile = new TFile(outputfilename.str().c_str(), "UPDATE");
-			td_mc = outputfile->mkdir("monte_carlo");
-			td_mc_spectra = td_mc->mkdir("spectra");
-			td_mc_fit_parameters = td_mc->mkdir("fit_parameters");
-			td_mc_FEP = td_mc->mkdir("fep");
-			td_mc_reconstructed = td_mc->mkdir("reconstructed");
+			if(outputfile->GetDirectory("monte_carlo") == nullptr){
+				td_mc = outputfile->mkdir("monte_carlo");
+				td_mc->mkdir("spectra");
+				td_mc->mkdir("fit_parameters");
+				td_mc->mkdir("fep");
+				td_mc->mkdir("reconstructed");
+			}
 			outputfile->Close();
 
-			cout << "> Using Monte-Carlo algorithm to determine fit uncertainty (NRANDOM == " << arguments.uncertainty_mc << ")" << endl;
+			// With the '--mc-shard' option, only a contiguous range of the iterations is run.
+			const UInt_t first_iteration = (UInt_t) ((ULong64_t) arguments.mc_shard*arguments.uncertainty_mc/arguments.mc_n_shards);
+			const UInt_t stop_iteration = (UInt_t) ((ULong64_t) (arguments.mc_shard + 1)*arguments.uncertainty_mc/arguments.mc_n_shards);
+			const UInt_t n_iterations = stop_iteration - first_iteration;
 
-			stringstream histname("");
-			if(!arguments.use_mc_fast){
-				mc_matrix = TH2F("modified_response_matrix", "MC ResponseMatrix", nbins, 0., max_bin, nbins, 0., max_bin);
+			cout << "> Using Monte-Carlo algorithm to determine fit uncertainty (NRANDOM == " << arguments.uncertainty_mc << ")" << endl;
+			if(arguments.mc_sharded){
+				cout << "\t> Running shard " << arguments.mc_shard << "/" << arguments.mc_n_shards << " with iterations " << first_iteration << " to " << (Int_t) stop_iteration - 1 << endl;
 			}
 
-			mc_fit_params = TH1F ("mc_fit_params", "MC Fit Parameters", nbins, 0., max_bin);
-
-			// If the '-W' option is used, always write new MC spectra to the 0-th entry of the
-			// vectors mc_spectra, mc_FEP_samples and mc_reconstruction_samples to save memory
-			if(arguments.write_mc_only){
-				mc_spectra.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins,  0., max_bin));
-				mc_FEP_samples.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin));
-				mc_reconstruction_samples.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin));
-				mc_fit_params_samples.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin));
+			// The checkpoint only contains the accumulated statistics. Since the random numbers of an
+			// iteration are determined by the seed and the iteration index, the run continues with the
+			// first iteration that is not contained in the statistics.
+			UInt_t n_resumed = 0;
+			if(arguments.mc_covariance && !arguments.write_mc_only){
+				mc_fit_params_covariance = new RunningCovariance(mc_fit_params_statistics.firstBin(), mc_fit_params_statistics.lastBin());
 			}
-
-			UInt_t j = 0;
-
-			for(UInt_t i = 0; i < arguments.uncertainty_mc; ++i){
-
-				// If '-W' option is used, do not push back new entries, but work with the 0-th element
-				if(arguments.write_mc_only){
-					histname << "mc_spectrum_" << i;
-					mc_spectra[0] = new TH1F(histname.str().c_str(), histname.str().c_str(), nbins,  0., max_bin);
-					histname.str("");
-					histname << "mc_FEP_" << i;
-					mc_FEP_samples[0] = new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin);
-
-					histname.str("");
-					histname << "mc_reconstructed_spectrum_" << i;
-					mc_reconstruction_samples[0] = new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin);
+			mc_run_parameters = {
+				(Double_t) arguments.seed, (Double_t) arguments.uncertainty_mc, (Double_t) arguments.mc_n_shards,
+				(Double_t) arguments.binning, (Double_t) binstart, (Double_t) binstop, (Double_t) arguments.use_mc_fast, (Double_t) arguments.mc_linear,
+				(Double_t) arguments.method, (Double_t) arguments.solver, (Double_t) arguments.iterations, arguments.mc_normal_threshold,
+				arguments.mc_precision, (Double_t) arguments.mc_min_iterations, (Double_t) arguments.mc_sampling,
+				(Double_t) mc_fit_params_statistics.hasQuantiles(), (Double_t) (mc_fit_params_covariance != nullptr)
+			};
+			if(arguments.mc_checkpoint > 0 || arguments.resume){
+				// A checkpoint belongs to a single shard, and with '-w' the output file is continued
+				vector<Double_t> checkpoint_parameters(mc_run_parameters);
+				checkpoint_parameters.push_back((Double_t) arguments.mc_shard);
+				checkpoint_parameters.push_back((Double_t) arguments.write_mc);
+				mc_checkpoint = new MonteCarloCheckpoint(checkpoint_filename, checkpoint_parameters);
+			}
+			if(arguments.resume){
+				if(mc_checkpoint->read(mc_fit_params_statistics, mc_fit_params_covariance)){
+					n_resumed = mc_fit_params_statistics.getNSamples();
+					cout << "\t> Resuming after " << n_resumed << " Monte-Carlo iterations from checkpoint " << mc_checkpoint->getFilename() << endl;
+					if(resume_output){
+						removeMonteCarloHistograms(outputfilename.str(), mc_directories, first_iteration + n_resumed);
+					}
 				} else{
-					histname << "mc_spectrum_" << i;
-					mc_spectra.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins,  0., max_bin));
-					histname.str("");
-					histname << "mc_FEP_" << i;
-					mc_FEP_samples.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin));
-
-					histname.str("");
-					histname << "mc_reconstructed_spectrum_" << i;
-					mc_reconstruction_samples.push_back(new TH1F(histname.str().c_str(), histname.str().c_str(), nbins, 0., max_bin));
-
-					j = i;
+					cout << "\t> No checkpoint " << mc_checkpoint->getFilename() << " found. Starting from the first Monte-Carlo iteration ..." << endl;
 				}
+			}
 
-				monteCarloUncertainty.apply_fluctuations(*mc_spectra[j], spectrum, nbins, binstop);
-
-				histname.str("");
-				histname << "mc_fit_params_" << i;
-				mc_fit_params = TH1F(histname.str().c_str(), histname.str().c_str(), nbins,  0., max_bin);
+			// The Monte-Carlo iterations are independent. They are distributed among the threads of
+			// the ThreadPool, each of which uses its own Fitter and, if the response matrix is varied,
+			// its own copy of the response matrix. Iteration i always uses the random numbers with the
+			// key (seed, i), so the results do not depend on the number of threads.
+			// The products with the response matrix inside an iteration are not split further.
+			if(ThreadPool::instance().size() > 1 || arguments.write_mc){
+				ROOT::EnableThreadSafety();
+			}
+			// Histograms are created by several threads at the same time, so they must not be
+			// registered in the current directory. They are written explicitly.
+			TH1::AddDirectory(kFALSE);
+
+			// Each worker allocates its histograms and buffers once and reuses them for all of its
+			// iterations. The histograms get the name of an iteration only when they are written.
+			// The fit parameters are added to the statistics in the order of the iterations, so that
+			// the result does not depend on the number of threads. Iterations which finish early wait
+			// in 'pending_samples', whose buffers are recycled. With the '-w' or '-W' option, a sample
+			// also contains the other histograms of the iteration, which are only written when the
+			// iteration has been added to the statistics.
+			std::atomic<UInt_t> next_iteration(first_iteration + n_resumed);
+			std::mutex output_mutex;
+			UInt_t n_processed = n_resumed;
+			UInt_t n_checkpointed = n_resumed;
+			// With the '--mc-precision' option, the precision is checked when the statistics contain
+			// a multiple of MC_UPDATE_INTERVAL samples. After convergence, no more samples are added or
+			// written, so the number of iterations does not depend on the number of threads either.
+			std::atomic<Bool_t> mc_converged(false);
+			// With the '--mc-interrupt' option, no more samples are added after the checkpoint at which
+			// the run is interrupted.
+			std::atomic<Bool_t> mc_interrupted(false);
+			Double_t mc_precision = 0.;
+			std::map<UInt_t, vector<vector<Double_t> > > pending_samples;
+			vector<vector<vector<Double_t> > > spare_samples;
+
+			// With the '-w' or '-W' option, the histograms are written by a separate thread, which keeps
+			// the output file open, so that the fits do not wait for the output.
+			enum MCDirectory : UInt_t { MC_SPECTRA, MC_FIT_PARAMETERS, MC_FEP, MC_RECONSTRUCTED, MC_N_DIRECTORIES };
+			const vector<string> mc_histogram_names = {"mc_spectrum_", "mc_fit_params_", "mc_FEP_", "mc_reconstructed_spectrum_"};
+			MonteCarloWriter *mc_writer = nullptr;
+			if(arguments.write_mc){
+				mc_writer = new MonteCarloWriter(outputfilename.str().c_str(), mc_directories, nbins, max_bin, 4*arguments.mc_flush);
+			}
 
-				if(arguments.use_mc_fast){
-					fitter.fit(*mc_spectra[j], response_matrix, fit_params, mc_fit_params, binstart, binstop);
+			// With the '--mc-linear' option, spectra are only solved with the NNLS solver if the
+			// linearization of the central fit is not valid for them.
+			LinearizedFit *linearized_fit = nullptr;
+			std::atomic<UInt_t> n_nnls(0);
+			if(arguments.mc_linear){
+				if(!arguments.use_mc_fast || arguments.method == UnfoldingMethod::mlem){
+					cout << "> Warning: '--mc-linear' is only used with the '-U' option and the fit method. Fitting every MC spectrum ..." << endl;
 				} else{
-					monteCarloUncertainty.apply_fluctuations(mc_matrix, response_matrix, binstart, binstop);
-					fitter.fit(*mc_spectra[j], mc_matrix, fit_params, mc_fit_params, binstart, binstop);
-				}
-
-				if(arguments.write_mc_only){
-					mc_fit_params_samples[0] = &mc_fit_params;
-				}
-				else{
-					mc_fit_params_samples.push_back(&mc_fit_params);
+					linearized_fit = new LinearizedFit(response_matrix, spectrum, fit_params, binstart, binstop);
+					if(arguments.verbose){
+						cout << "> Linearized fit with " << linearized_fit->getNFree() << " free parameters" << endl;
+					}
 				}
+			}
 
-				reconstructor.reconstruct(mc_fit_params, n_simulated_particles, *mc_reconstruction_samples[j]);
-				fitter.fittedFEP(mc_fit_params, response_matrix, *mc_FEP_samples[j]);
-				histname.str("");
-
-				if(i % MC_UPDATE_INTERVAL == 0 && i > 0)
-					cout << "\t> Processed " << i << " Monte-Carlo iterations" << endl;
-
-				if(arguments.write_mc){
-					outputfile = new TFile(outputfilename.str().c_str(), "UPDATE");
-
-					td_mc_spectra = (TDirectory*) outputfile->Get("monte_carlo/spectra");
-					td_mc_spectra->cd();
-					mc_spectra[j]->Write();
-
-					td_mc_fit_parameters = (TDirectory*) outputfile->Get("monte_carlo/fit_parameters");
-					td_mc_fit_parameters->cd();
-					mc_fit_params_samples[j]->Write();
+			// The number of MLEM iterations regularizes the result, so each MC spectrum is unfolded from
+			// the same start parameters as the central result. A fit of an MC spectrum starts at the
+			// central fit result, which is close to its minimum.
+			const TH1F &mc_start_params = arguments.method == UnfoldingMethod::mlem ? topdown_params : fit_params;
 
-					td_mc_FEP = (TDirectory*) outputfile->Get("monte_carlo/fep");
-					td_mc_FEP->cd();
-					mc_FEP_samples[j]->Write();
+			const UInt_t n_workers = ThreadPool::instance().size() < n_iterations - n_resumed ? ThreadPool::instance().size() : n_iterations - n_resumed;
 
-					td_mc_reconstructed = (TDirectory*) outputfile->Get("monte_carlo/reconstructed");
-					td_mc_reconstructed->cd();
-					mc_reconstruction_samples[j]->Write();
+			ThreadPool::instance().parallelFor(n_workers, [&](const UInt_t){
+				// The copy is made once per worker. apply_fluctuations() overwrites all elements in the
+				// fit range in each iteration, the other ones keep the values of response_matrix.
+				ResponseMatrix mc_matrix;
+				if(!arguments.use_mc_fast){
+					mc_matrix = response_matrix;
+				}
+				Fitter mc_fitter(response_matrix, arguments.binning, binstart, binstop, arguments.solver, arguments.method, arguments.iterations);
+
+				TH1F mc_spectrum("mc_spectrum", "mc_spectrum", nbins, 0., max_bin);
+				TH1F mc_fit_params("mc_fit_params", "mc_fit_params", nbins, 0., max_bin);
+				TH1F mc_FEP("mc_FEP", "mc_FEP", nbins, 0., max_bin);
+				TH1F mc_reconstructed("mc_reconstructed_spectrum", "mc_reconstructed_spectrum", nbins, 0., max_bin);
+
+				vector<vector<Double_t> > sample(MC_N_DIRECTORIES);
+				stringstream histname;
+
+				for(UInt_t i = next_iteration++; i < stop_iteration && !mc_converged && !mc_interrupted; i = next_iteration++){
+					monteCarloUncertainty.apply_fluctuations(mc_spectrum, spectrum, nbins, binstop, i);
+
+					if(linearized_fit != nullptr){
+						if(!linearized_fit->solve(mc_spectrum, mc_fit_params)){
+							++n_nnls;
+						}
+					} else if(arguments.use_mc_fast){
+						mc_fitter.fit(mc_spectrum, response_matrix, mc_start_params, mc_fit_params, binstart, binstop);
+					} else{
+						monteCarloUncertainty.apply_fluctuations(mc_matrix, response_matrix, binstart, binstop, i);
+						mc_fitter.fit(mc_spectrum, mc_matrix, mc_start_params, mc_fit_params, binstart, binstop);
+					}
+
+					reconstructor.reconstruct(mc_fit_params, n_simulated_particles, mc_reconstructed);
+					mc_fitter.fittedFEP(mc_fit_params, response_matrix, mc_FEP);
+
+					getBinContents(mc_fit_params, sample[MC_FIT_PARAMETERS]);
+					if(mc_writer != nullptr){
+						getBinContents(mc_spectrum, sample[MC_SPECTRA]);
+						getBinContents(mc_FEP, sample[MC_FEP]);
+						getBinContents(mc_reconstructed, sample[MC_RECONSTRUCTED]);
+					}
+
+					{
+						std::lock_guard<std::mutex> lock(output_mutex);
+
+						pending_samples[i].swap(sample);
+						if(spare_samples.empty()){
+							sample.assign(MC_N_DIRECTORIES, vector<Double_t>());
+						} else{
+							sample.swap(spare_samples.back());
+							spare_samples.pop_back();
+						}
+						// Iterations after convergence are neither added to the statistics nor written
+						while(!mc_converged && !mc_interrupted && !pending_samples.empty() && pending_samples.begin()->first == first_iteration + mc_fit_params_statistics.getNSamples()){
+							const vector<vector<Double_t> > &accepted = pending_samples.begin()->second;
+							mc_fit_params_statistics.add(&accepted[MC_FIT_PARAMETERS][0]);
+							if(mc_fit_params_covariance != nullptr){
+								mc_fit_params_covariance->add(&accepted[MC_FIT_PARAMETERS][0]);
+							}
+							if(mc_writer != nullptr){
+								for(UInt_t d = 0; d < MC_N_DIRECTORIES; ++d){
+									histname.str("");
+									histname << mc_histogram_names[d] << pending_samples.begin()->first;
+									mc_writer->write(d, accepted[d], histname.str());
+								}
+							}
+							spare_samples.push_back(vector<vector<Double_t> >());
+							spare_samples.back().swap(pending_samples.begin()->second);
+							pending_samples.erase(pending_samples.begin());
+
+							if(arguments.mc_precision > 0. && mc_fit_params_statistics.getNSamples() >= arguments.mc_min_iterations && mc_fit_params_statistics.getNSamples() % MC_UPDATE_INTERVAL == 0){
+								mc_precision = monteCarloUncertainty.evaluatePrecision(mc_fit_params_statistics);
+								mc_converged = mc_precision <= arguments.mc_precision;
+							}
+						}
+
+						if(arguments.mc_checkpoint > 0 && mc_fit_params_statistics.getNSamples() >= n_checkpointed + arguments.mc_checkpoint){
+							// The histograms of all iterations in the checkpoint have to be in the output file
+							if(mc_writer != nullptr){
+								mc_writer->flush();
+							}
+							mc_checkpoint->write(mc_fit_params_statistics, mc_fit_params_covariance);
+							n_checkpointed = mc_fit_params_statistics.getNSamples();
+							mc_interrupted = arguments.mc_interrupt > 0 && n_checkpointed >= arguments.mc_interrupt;
+						}
+
+						++n_processed;
+						if(n_processed % MC_UPDATE_INTERVAL == 0 && n_processed < n_iterations)
+							cout << "\t> Processed " << n_processed << " Monte-Carlo iterations" << endl;
+					}
+
+					// The covariance matrix is updated by all workers at the same time, outside of the lock
+					if(mc_fit_params_covariance != nullptr){
+						mc_fit_params_covariance->update();
+					}
+				}
+			});
 
-					outputfile->Close();
+			if(mc_fit_params_covariance != nullptr){
+				mc_fit_params_covariance->finish();
+			}
+			if(mc_writer != nullptr){
+				mc_writer->close();
+				delete mc_writer;
+			}
+			if(linearized_fit != nullptr){
+				cout << "\t> " << n_nnls << " of " << n_processed - n_resumed << " Monte-Carlo spectra were solved with the NNLS solver, because a parameter reached or left its bound" << endl;
+				delete linearized_fit;
+			}
+			cout << "\t> Processed " << mc_fit_params_statistics.getNSamples() << " Monte-Carlo iterations" << endl;
+			if(mc_interrupted){
+				cout << "> Interrupted after the checkpoint " << mc_checkpoint->getFilename() << ", which can be resumed with the '--resume' option" << endl;
+				delete mc_checkpoint;
+				if(mc_fit_params_covariance != nullptr){
+					delete mc_fit_params_covariance;
+				}
+				return 0;
+			}
+			if(arguments.mc_precision > 0.){
+				if(mc_converged){
+					cout << "\t> Monte-Carlo uncertainty converged to a relative precision of " << mc_precision << endl;
+				} else{
+					cout << "> Warning: Monte-Carlo uncertainty reached only a relative precision of " << monteCarloUncertainty.evaluatePrecision(mc_fit_params_statistics) << " after the maximum number of iterations" << endl;
 				}
 			}
-			cout << "\t> Processed " << arguments.uncertainty_mc << " Monte-Carlo iterations" << endl;
 		}
 	}
 	/************ Uncertainties *************/
 
-	vector<TH1F*> uncertainties;
-
 	// Uncertainty of Monte-Carlo method
-	if(arguments.use_mc && !arguments.write_mc_only && !arguments.topdown_only){
-
+	// A shard only contains a part of the Monte-Carlo iterations, so its results are evaluated by
+	// 'horst_merge'.
+	for(Int_t i = 1; i <= nbins; ++i){
+		response_matrix_diagonal.SetBinContent(i, response_matrix.GetBinContent(i, i));
+	}
+	const Bool_t evaluate_mc = arguments.use_mc && !arguments.write_mc_only && !arguments.topdown_only && !arguments.mc_sharded;
+	if(evaluate_mc){
 		cout << "> Evaluating Monte-Carlo results ..." << endl;
-
-		mc_fit_params_mean = TH1F("mc_fit_params_mean", "MC Fit Parameters", nbins, 0., max_bin);
-		mc_fit_params_uncertainty = TH1F("mc_fit_params_uncertainty", "MC Fit Parameters Uncertainty", nbins, 0., max_bin);
-		mc_fit_total_uncertainty = TH1F("mc_fit_total_uncertainty", "MC Fit Total Uncertainty", nbins, 0., max_bin);
-
-		mc_fit_FEP = TH1F("mc_fit_FEP", "MC Fit FEP", nbins, 0., max_bin);
-		mc_fit_FEP_uncertainty = TH1F("mc_fit_FEP_uncertainty", "MC Fit FEP Uncertainty", nbins, 0., max_bin);
-		mc_FEP_uncertainty_low = TH1F("mc_FEP_uncertainty_low", "MC Fit FEP Uncertainty lower Limit", nbins, 0., max_bin);
-		mc_FEP_uncertainty_up = TH1F("mc_FEP_uncertainty_up", "MC Fit FEP Uncertainty upper Limit", nbins, 0., max_bin);
-
-		mc_spectrum_reconstructed = TH1F("mc_spectrum_reconstructed", "MC Reconstructed Spectrum", nbins, 0., max_bin);
-		mc_reconstruction_uncertainty = TH1F("mc_reconstruction_uncertainty", "MC Reconstruction Uncertainty", nbins, 0., max_bin);
-		mc_reconstruction_uncertainty_low = TH1F("mc_reconstruction_uncertainty_low", "MC Reconstruction Uncertainty lower Limit", nbins, 0., max_bin);
-		mc_reconstruction_uncertainty_up = TH1F("mc_reconstruction_uncertainty_up", "MC Reconstruction Uncertainty upper Limit", nbins, 0., max_bin);
-
-		monteCarloUncertainty.evaluateMeanAndStd(mc_fit_params_mean, mc_fit_params_uncertainty, mc_fit_params_samples, binstart, binstop);
-
-		// Use the fit uncertainty from a single fit as an estimate for the uncertainty
-		// of the fitting algorithm
-		uncertainties.push_back(&fit_algorithm_uncertainty);
-		uncertainties.push_back(&mc_fit_params_uncertainty);
-		uncertainty.getTotalUncertainty(uncertainties, mc_fit_total_uncertainty);
-
-		fitter.fittedFEP(mc_fit_params_mean, response_matrix, mc_fit_FEP);
-		fitter.fittedFEP(mc_fit_params_uncertainty, response_matrix, mc_fit_FEP_uncertainty);
-		uncertainty.getLowerAndUpperLimit(mc_fit_FEP, mc_fit_FEP_uncertainty, mc_FEP_uncertainty_low, mc_FEP_uncertainty_up, true);
-
-		reconstructor.reconstruct(mc_fit_params_mean, n_simulated_particles, mc_spectrum_reconstructed);
-		reconstructor.reconstruct(mc_fit_total_uncertainty, n_simulated_particles, mc_reconstruction_uncertainty);
-		uncertainty.getLowerAndUpperLimit(mc_spectrum_reconstructed, mc_reconstruction_uncertainty, mc_reconstruction_uncertainty_low, mc_reconstruction_uncertainty_up, true);
-
+		monteCarloUncertainty.evaluateResults(mc_results, mc_fit_params_statistics, mc_fit_params_covariance, arguments.mc_percentiles, fit_algorithm_uncertainty, response_matrix_diagonal, n_simulated_particles);
 	}
 
 	// Uncertainty of single fit
@@ -442,12 +776,14 @@ int main(int argc, char* argv[]){
 	if(!arguments.topdown_only){
 		uncertainty.getUncertainty(fit_params, spectrum, response_matrix, fit_simulation_uncertainty, fit_spectrum_uncertainty, binstart, binstop);
 		fitter.fittedFEP(fit_algorithm_uncertainty, response_matrix, fit_algorithm_FEP_uncertainty);
-		uncertainties.push_back(&fit_algorithm_FEP_uncertainty);
-		uncertainties.push_back(&fit_simulation_uncertainty);
-		uncertainties.push_back(&fit_spectrum_uncertainty);
-		uncertainty.getTotalUncertainty(uncertainties, fit_total_uncertainty);
 
-		reconstructor.uncertainty(fit_total_uncertainty, response_matrix, n_simulated_particles, reconstruction_uncertainty);
+		if(evaluate_mc){
+			monteCarloUncertainty.evaluateTotalUncertainty(fit_total_uncertainty, reconstruction_uncertainty, mc_results, fit_algorithm_uncertainty, fit_algorithm_FEP_uncertainty, fit_simulation_uncertainty, fit_spectrum_uncertainty, response_matrix_diagonal, n_simulated_particles);
+		} else{
+			const vector<const TH1F*> uncertainties = {&fit_algorithm_FEP_uncertainty, &fit_simulation_uncertainty, &fit_spectrum_uncertainty};
+			uncertainty.getTotalUncertainty(uncertainties, fit_total_uncertainty);
+			reconstructor.uncertainty(fit_total_uncertainty, response_matrix_diagonal, n_simulated_particles, reconstruction_uncertainty);
+		}
 
 		uncertainty.getLowerAndUpperLimit(spectrum_reconstructed, reconstruction_uncertainty, reconstruction_uncertainty_low, reconstruction_uncertainty_up, true);
 	}
@@ -523,9 +859,6 @@ int main(int argc, char* argv[]){
 	topdown_spectrum_uncertainty.Write();
 	topdown_total_uncertainty.Write();
 	topdown_spectrum_reconstructed.Write();
-	if(arguments.topdown_only){
-		topdown_steps.Write();
-	}
 	outputfile->cd();
 
 	// Write fit results
@@ -545,28 +878,70 @@ int main(int argc, char* argv[]){
 		fit_result.Write();
 	}
 	
-	// Write Monte-Carlo results (if Monte-Carlo uncertainty determination is activated)
+	// Record the sampling strategy of the Monte-Carlo iterations
 	if(arguments.use_mc && !arguments.topdown_only){
 		td_mc = (TDirectory*) outputfile->Get("monte_carlo");
 		td_mc->cd();
+		TNamed mc_sampling("mc_sampling", arguments.mc_sampling_name.Data());
+		mc_sampling.Write();
+	}
 
-		mc_fit_params_mean.Write();
-		mc_fit_params_uncertainty.Write();
+	// Write the state of the Monte-Carlo statistics of a shard, and everything else that 'horst_merge'
+	// needs to evaluate the Monte-Carlo results
+	if(arguments.use_mc && !arguments.topdown_only && arguments.mc_sharded){
+		td_mc = (TDirectory*) outputfile->Get("monte_carlo");
+		TDirectory *td_shard = td_mc->mkdir("shard");
+		td_shard->cd();
+
+		vector<Double_t> mc_fit_params_state;
+		mc_fit_params_statistics.getState(mc_fit_params_state);
+		td_shard->WriteObject(&mc_fit_params_state, "mc_fit_params_statistics");
+
+		vector<Double_t> mc_shard = {(Double_t) arguments.mc_shard, (Double_t) arguments.mc_n_shards, (Double_t) arguments.uncertainty_mc, (Double_t) arguments.seed, (Double_t) arguments.mc_sampling};
+		td_shard->WriteObject(&mc_shard, "mc_shard");
+		td_shard->WriteObject(&mc_run_parameters, "mc_run_parameters");
+		td_shard->WriteObject(&arguments.mc_percentiles, "mc_percentiles");
+		if(mc_fit_params_covariance != nullptr){
+			vector<Double_t> mc_fit_params_covariance_state;
+			mc_fit_params_covariance->getState(mc_fit_params_covariance_state);
+			td_shard->WriteObject(&mc_fit_params_covariance_state, "mc_fit_params_covariance");
+		}
+
+		response_matrix_diagonal.Write();
+	}
+
+	// Write Monte-Carlo results (if Monte-Carlo uncertainty determination is activated)
+	if(arguments.use_mc && !arguments.topdown_only && !arguments.mc_sharded){
+		td_mc = (TDirectory*) outputfile->Get("monte_carlo");
+		td_mc->cd();
+
+		mc_results.mc_fit_params_mean.Write();
+		mc_results.mc_fit_params_uncertainty.Write();
 		fit_algorithm_uncertainty.Write();
 		fitter.fittedFEP(fit_algorithm_uncertainty, response_matrix, fit_algorithm_FEP_uncertainty);
 		reconstructor.reconstruct(fit_algorithm_uncertainty, n_simulated_particles, fit_algorithm_reconstruction_uncertainty);
-		mc_fit_total_uncertainty.Write();
+		mc_results.mc_fit_total_uncertainty.Write();
 
-		mc_fit_FEP.Write();
-		mc_fit_FEP_uncertainty.Write();
-		mc_FEP_uncertainty_low.Write();
-		mc_FEP_uncertainty_up.Write();
+		mc_results.mc_fit_FEP.Write();
+		mc_results.mc_fit_FEP_uncertainty.Write();
+		mc_results.mc_FEP_uncertainty_low.Write();
+		mc_results.mc_FEP_uncertainty_up.Write();
 
 		if(!arguments.write_mc_only){
-			mc_spectrum_reconstructed.Write();
-			mc_reconstruction_uncertainty.Write();
-			mc_reconstruction_uncertainty_low.Write();
-			mc_reconstruction_uncertainty_up.Write();
+			mc_results.mc_fit_params_min.Write();
+			mc_results.mc_fit_params_max.Write();
+			mc_results.mc_spectrum_reconstructed.Write();
+			mc_results.mc_reconstruction_uncertainty.Write();
+			mc_results.mc_reconstruction_uncertainty_low.Write();
+			mc_results.mc_reconstruction_uncertainty_up.Write();
+			for(size_t i = 0; i < arguments.mc_percentiles.size(); ++i){
+				mc_results.mc_fit_params_percentiles[i].Write();
+				mc_results.mc_fit_FEP_percentiles[i].Write();
+				mc_results.mc_spectrum_reconstructed_percentiles[i].Write();
+			}
+			if(mc_fit_params_covariance != nullptr){
+				td_mc->WriteObject(&mc_results.mc_reconstruction_covariance, "mc_reconstruction_covariance");
+			}
 		}
 	}
 
@@ -574,6 +949,14 @@ int main(int argc, char* argv[]){
 
 	cout << "> Wrote output file " << arguments.outputfile << " ..." << endl;
 
+	if(mc_checkpoint != nullptr){
+		mc_checkpoint->remove();
+		delete mc_checkpoint;
+	}
+	if(mc_fit_params_covariance != nullptr){
+		delete mc_fit_params_covariance;
+	}
+
 	outputfilename.str("");
 	outputfilename << arguments.correlation_matrix_filename;
 
@@ -0,0 +1,310 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#include <TFile.h>
+#include <TH1.h>
+#include <TKey.h>
+#include <TROOT.h>
+
+#include <algorithm>
+#include <argp.h>
+#include <iostream>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Config.h"
+#include "MonteCarloUncertainty.h"
+#include "RunningCovariance.h"
+#include "RunningStatistics.h"
+#include "Uncertainty.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+struct Arguments{
+	vector<TString> shardfiles;
+	TString outputfile = "output.root";
+};
+
+static char doc[] = "Horst_merge, combine the Monte-Carlo shards of Horst\n\nCombines the output files of the runs 'horst --mc-shard K/N' with K = 0, ..., N-1 and otherwise identical options into the output file of a single run without the '--mc-shard' option.";
+static char args_doc[] = "SHARDFILENAME...";
+
+static struct argp_option options[] = {
+	{"outputfile", 'o', "OUTPUTFILENAME", 0, "Name of output file (default: output.root).", 0},
+	{ 0, 0, 0, 0, 0, 0}
+};
+
+static int parse_opt(int key, char *arg, struct argp_state *state){
+	struct Arguments *arguments = (struct Arguments*) state->input;
+
+	switch (key){
+		case ARGP_KEY_ARG: arguments->shardfiles.push_back(arg); break;
+		case 'o': arguments->outputfile = arg; break;
+		case ARGP_KEY_END:
+			if(state->arg_num == 0){
+				argp_usage(state);
+			}
+			break;
+		default: return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc, 0, 0, 0};
+
+// Directories of the histograms of single MC iterations (horst's '-w' option)
+static const char* mc_directories[] = {"monte_carlo/spectra", "monte_carlo/fit_parameters", "monte_carlo/fep", "monte_carlo/reconstructed"};
+
+template <class T>
+T* getObject(TFile &file, const char *name){
+	T *object = nullptr;
+	file.GetObject(name, object);
+	if(object == nullptr){
+		cout << "Error: File " << file.GetName() << " does not contain '" << name << "'. Aborting ..." << endl;
+		abort();
+	}
+	return object;
+}
+
+int main(int argc, char* argv[]){
+
+	time_t start, stop;
+	time(&start);
+
+	/************ Read command-line arguments  *************/
+
+	Arguments arguments;
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	TH1::AddDirectory(kFALSE);
+
+	/************ Read statistics of all shards *************/
+
+	// Each shard contains a vector 'mc_shard' with the index of the shard, the number of shards,
+	// the total number of MC iterations, the seed and the sampling strategy, and a vector
+	// 'mc_run_parameters' with all options which determine the MC results.
+	const UInt_t n_shards = (UInt_t) arguments.shardfiles.size();
+	vector<TString> shard_files(n_shards, "");
+	vector<vector<Double_t> > shard_info(n_shards);
+	// All options which determine the MC results, except for the index of the shard
+	vector<vector<Double_t> > shard_run_parameters(n_shards);
+	vector<RunningStatistics*> shard_statistics(n_shards, nullptr);
+	// Only present if horst was run with the '--mc-covariance' option
+	vector<RunningCovariance*> shard_covariances(n_shards, nullptr);
+
+	for(auto shardfile: arguments.shardfiles){
+		cout << "> Reading shard file " << shardfile << " ..." << endl;
+		TFile file(shardfile, "READ");
+		if(file.IsZombie()){
+			cout << "Error: Could not open shard file " << shardfile << ". Aborting ..." << endl;
+			abort();
+		}
+
+		vector<Double_t> *mc_shard = getObject<vector<Double_t> >(file, "monte_carlo/shard/mc_shard");
+		const UInt_t shard = (UInt_t) (*mc_shard)[0];
+		if((UInt_t) (*mc_shard)[1] != n_shards || shard >= n_shards){
+			cout << "Error: " << shardfile << " contains shard " << shard << "/" << (UInt_t) (*mc_shard)[1] << ", but " << n_shards << " shard files were given. Aborting ..." << endl;
+			abort();
+		}
+		if(shard_statistics[shard] != nullptr){
+			cout << "Error: " << shard_files[shard] << " and " << shardfile << " contain the same shard " << shard << "/" << n_shards << ". Aborting ..." << endl;
+			abort();
+		}
+
+		vector<Double_t> *mc_fit_params_state = getObject<vector<Double_t> >(file, "monte_carlo/shard/mc_fit_params_statistics");
+		vector<Double_t> *mc_run_parameters = getObject<vector<Double_t> >(file, "monte_carlo/shard/mc_run_parameters");
+
+		shard_files[shard] = shardfile;
+		shard_info[shard] = *mc_shard;
+		shard_run_parameters[shard] = *mc_run_parameters;
+		shard_statistics[shard] = new RunningStatistics(*mc_fit_params_state);
+
+		vector<Double_t> *mc_fit_params_covariance_state = nullptr;
+		file.GetObject("monte_carlo/shard/mc_fit_params_covariance", mc_fit_params_covariance_state);
+		if(mc_fit_params_covariance_state != nullptr){
+			shard_covariances[shard] = new RunningCovariance(*mc_fit_params_covariance_state);
+			delete mc_fit_params_covariance_state;
+		}
+
+		delete mc_shard;
+		delete mc_fit_params_state;
+		delete mc_run_parameters;
+	}
+
+	// n_shards files contain n_shards different shards, so all shards are present.
+	for(UInt_t shard = 1; shard < n_shards; ++shard){
+		if(shard_info[shard].size() != shard_info[0].size() || !std::equal(shard_info[shard].begin() + 2, shard_info[shard].end(), shard_info[0].begin() + 2)){
+			cout << "Error: " << shard_files[shard] << " and " << shard_files[0] << " were created with different numbers of MC iterations, seeds or sampling strategies. Aborting ..." << endl;
+			abort();
+		}
+		if(shard_run_parameters[shard] != shard_run_parameters[0]){
+			cout << "Error: " << shard_files[shard] << " and " << shard_files[0] << " were created with different options for the fit or the MC iterations. Aborting ..." << endl;
+			abort();
+		}
+		if((shard_covariances[shard] == nullptr) != (shard_covariances[0] == nullptr)){
+			cout << "Error: Only one of " << shard_files[shard] << " and " << shard_files[0] << " contains the covariance of the MC iterations. Aborting ..." << endl;
+			abort();
+		}
+	}
+
+	// The shards are merged in the order of the iterations, independent of the order of the
+	// files on the command line.
+	RunningStatistics mc_fit_params_statistics(*shard_statistics[0]);
+	for(UInt_t shard = 1; shard < n_shards; ++shard){
+		mc_fit_params_statistics.merge(*shard_statistics[shard]);
+	}
+	for(auto statistics: shard_statistics){
+		delete statistics;
+	}
+
+	// Merging into an empty accumulator copies the first shard
+	RunningCovariance *mc_fit_params_covariance = nullptr;
+	if(shard_covariances[0] != nullptr){
+		mc_fit_params_covariance = new RunningCovariance(shard_covariances[0]->firstBin(), shard_covariances[0]->lastBin());
+		for(auto covariance: shard_covariances){
+			mc_fit_params_covariance->merge(*covariance);
+			delete covariance;
+		}
+	}
+
+	cout << "> Merged " << mc_fit_params_statistics.getNSamples() << " Monte-Carlo iterations from " << n_shards << " shards" << endl;
+
+	/************ Create output file *****************/
+
+	// The results which do not depend on the MC iterations are the same in all shards.
+	cout << "> Copying " << shard_files[0] << " to output file " << arguments.outputfile << " ..." << endl;
+	if(!TFile::Cp(shard_files[0], arguments.outputfile, kFALSE)){
+		cout << "Error: Could not create output file " << arguments.outputfile << ". Aborting ..." << endl;
+		abort();
+	}
+
+	TFile outputfile(arguments.outputfile, "UPDATE");
+
+	// Copy the histograms of single MC iterations of the other shards
+	for(UInt_t shard = 1; shard < n_shards; ++shard){
+		TFile file(shard_files[shard], "READ");
+		for(auto directory: mc_directories){
+			TDirectory *source = file.GetDirectory(directory);
+			TDirectory *target = outputfile.GetDirectory(directory);
+			if(source == nullptr || target == nullptr || source->GetListOfKeys()->GetSize() == 0){
+				continue;
+			}
+
+			TIter next(source->GetListOfKeys());
+			TKey *key = nullptr;
+			TObject *object = nullptr;
+			while((key = (TKey*) next()) != nullptr){
+				object = key->ReadObj();
+				target->WriteTObject(object, key->GetName());
+				delete object;
+			}
+		}
+	}
+
+	/************ Evaluate Monte-Carlo results *************/
+
+	// The evaluation is the same as in horst, see MonteCarloUncertainty::evaluateResults()
+
+	TH1F *spectrum = getObject<TH1F>(outputfile, "spectrum");
+	const Int_t nbins = spectrum->GetNbinsX();
+	const UInt_t binning = (UInt_t) NBINS/(UInt_t) nbins;
+	const Double_t max_bin = (Double_t) NBINS - 1.;
+	delete spectrum;
+
+	MonteCarloUncertainty monteCarloUncertainty(binning, (UInt_t) shard_info[0][3]);
+	Uncertainty uncertainty(binning);
+
+	TH1F *n_simulated_particles = getObject<TH1F>(outputfile, "n_simulated_particles");
+	TH1F *spectrum_reconstructed = getObject<TH1F>(outputfile, "spectrum_reconstructed");
+	TH1F *fit_algorithm_uncertainty = getObject<TH1F>(outputfile, "fit/fit_algorithm_uncertainty");
+	TH1F *fit_algorithm_FEP_uncertainty = getObject<TH1F>(outputfile, "fit/fit_algorithm_FEP_uncertainty");
+	TH1F *fit_simulation_uncertainty = getObject<TH1F>(outputfile, "fit/fit_simulation_uncertainty");
+	TH1F *fit_spectrum_uncertainty = getObject<TH1F>(outputfile, "fit/fit_spectrum_uncertainty");
+	TH1F *response_matrix_diagonal = getObject<TH1F>(outputfile, "monte_carlo/shard/response_matrix_diagonal");
+	vector<Double_t> *mc_percentiles = getObject<vector<Double_t> >(outputfile, "monte_carlo/shard/mc_percentiles");
+
+	TH1F fit_total_uncertainty("fit_total_uncertainty", "Total Uncertainty", nbins, 0., max_bin);
+	TH1F reconstruction_uncertainty("reconstruction_uncertainty", "Reconstruction Uncertainty", nbins, 0., max_bin);
+	TH1F reconstruction_uncertainty_low("reconstruction_uncertainty_low", "Reconstruction Uncertainty lower Limit", nbins, 0., max_bin);
+	TH1F reconstruction_uncertainty_up("reconstruction_uncertainty_up", "Reconstruction Uncertainty upper Limit", nbins, 0., max_bin);
+
+	cout << "> Evaluating Monte-Carlo results ..." << endl;
+
+	MonteCarloResults mc_results;
+	monteCarloUncertainty.evaluateResults(mc_results, mc_fit_params_statistics, mc_fit_params_covariance, *mc_percentiles, *fit_algorithm_uncertainty, *response_matrix_diagonal, *n_simulated_particles);
+	if(mc_fit_params_covariance != nullptr){
+		delete mc_fit_params_covariance;
+	}
+
+	monteCarloUncertainty.evaluateTotalUncertainty(fit_total_uncertainty, reconstruction_uncertainty, mc_results, *fit_algorithm_uncertainty, *fit_algorithm_FEP_uncertainty, *fit_simulation_uncertainty, *fit_spectrum_uncertainty, *response_matrix_diagonal, *n_simulated_particles);
+	uncertainty.getLowerAndUpperLimit(*spectrum_reconstructed, reconstruction_uncertainty, reconstruction_uncertainty_low, reconstruction_uncertainty_up, true);
+
+	/************ Write results to file *************/
+
+	outputfile.cd();
+	reconstruction_uncertainty.Write("", TObject::kOverwrite);
+	reconstruction_uncertainty_low.Write("", TObject::kOverwrite);
+	reconstruction_uncertainty_up.Write("", TObject::kOverwrite);
+
+	outputfile.cd("fit");
+	fit_total_uncertainty.Write("", TObject::kOverwrite);
+
+	outputfile.cd("monte_carlo");
+	gDirectory->Delete("shard;*");
+
+	mc_results.mc_fit_params_mean.Write();
+	mc_results.mc_fit_params_uncertainty.Write();
+	fit_algorithm_uncertainty->Write();
+	mc_results.mc_fit_total_uncertainty.Write();
+
+	mc_results.mc_fit_FEP.Write();
+	mc_results.mc_fit_FEP_uncertainty.Write();
+	mc_results.mc_FEP_uncertainty_low.Write();
+	mc_results.mc_FEP_uncertainty_up.Write();
+
+	mc_results.mc_fit_params_min.Write();
+	mc_results.mc_fit_params_max.Write();
+	mc_results.mc_spectrum_reconstructed.Write();
+	mc_results.mc_reconstruction_uncertainty.Write();
+	mc_results.mc_reconstruction_uncertainty_low.Write();
+	mc_results.mc_reconstruction_uncertainty_up.Write();
+	for(size_t i = 0; i < mc_percentiles->size(); ++i){
+		mc_results.mc_fit_params_percentiles[i].Write();
+		mc_results.mc_fit_FEP_percentiles[i].Write();
+		mc_results.mc_spectrum_reconstructed_percentiles[i].Write();
+	}
+	if(!mc_results.mc_reconstruction_covariance.empty()){
+		gDirectory->WriteObject(&mc_results.mc_reconstruction_covariance, "mc_reconstruction_covariance");
+	}
+
+	outputfile.Close();
+
+	delete n_simulated_particles;
+	delete spectrum_reconstructed;
+	delete fit_algorithm_uncertainty;
+	delete fit_algorithm_FEP_uncertainty;
+	delete fit_simulation_uncertainty;
+	delete fit_spectrum_uncertainty;
+	delete response_matrix_diagonal;
+	delete mc_percentiles;
+
+	cout << "> Wrote output file " << arguments.outputfile << " ..." << endl;
+
+	time(&stop);
+	cout << "> Execution time: " << stop - start << " seconds" << endl;
+}
@@ -31,7 +31,7 @@
 #include "InputFileReader.h"
 #include "Reconstructor.h"
 #include "Resolution.h"
-#include "Fitter.h"
+#include "ResponseMatrix.h"
 
 using std::cout;
 using std::endl;
@@ -128,7 +128,8 @@ int main(int argc, char* argv[]){
 
 	TH1F n_simulated_particles("n_simulated_particles", "Number of simulated particles per bin", NBINS, 0., (Double_t) NBINS - 1);
 	TH1F inverse_n_simulated_particles("inverse_n_simulated_particles", "1 / Number of simulated particles per bin", NBINS, 0., (Double_t) NBINS - 1);
-	TH2F response_matrix("rema", "Response_Matrix", NBINS, 0., (Double_t) (NBINS - 1), NBINS, 0., (Double_t) (NBINS - 1));
+	// Only needed until it is converted to the packed ResponseMatrix
+	TH2F *response_matrix_histogram = new TH2F("rema", "Response_Matrix", NBINS, 0., (Double_t) (NBINS - 1), NBINS, 0., (Double_t) (NBINS - 1));
 
 	// Output
 	
@@ -159,18 +160,18 @@ int main(int argc, char* argv[]){
 	}
 
 	cout << "> Reading matrix file " << arguments.matrixfile << " ..." << endl;
-	inputFileReader.readMatrix(response_matrix, n_simulated_particles, arguments.matrixfile);
+	inputFileReader.readMatrix(*response_matrix_histogram, n_simulated_particles, arguments.matrixfile);
 	if(arguments.binning != 1){
 		cout << "> Rebinning response matrix ..." << endl;
-		response_matrix.Rebin2D((Int_t) arguments.binning, (Int_t) arguments.binning);
+		response_matrix_histogram->Rebin2D((Int_t) arguments.binning, (Int_t) arguments.binning);
 	}
+	ResponseMatrix response_matrix(*response_matrix_histogram);
+	delete response_matrix_histogram;
 	n_simulated_particles.Rebin((Int_t) arguments.binning);
 
 	for(Int_t i = 0; i <= (Int_t) NBINS/(Int_t) arguments.binning; ++i)
 		inverse_n_simulated_particles.SetBinContent(i, 1./n_simulated_particles.GetBinContent(i));
 
-	Fitter fitter(response_matrix, arguments.binning, 0, NBINS - 1);
-
 	/************ Read resolution parameters from file  *************/
 
 	if(arguments.resolution_file_given){
@@ -0,0 +1,239 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Compare histograms in the output files of the tests. Each histogram or directory is given as
+// FILENAME:PATH. Directories are compared histogram by histogram, including their subdirectories.
+// Bin i of A and B agree if
+// |A_i - B_i| <= ABSOLUTE + RELATIVE*max(|A_i|, |B_i|) + FACTOR*U_i,
+// where U is an optional uncertainty histogram. Without tolerances, the bins have to be identical.
+
+#include <TClass.h>
+#include <TDirectory.h>
+#include <TFile.h>
+#include <TH1.h>
+#include <TKey.h>
+#include <TROOT.h>
+
+#include <argp.h>
+#include <iostream>
+#include <math.h>
+#include <stdlib.h>
+#include <string>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+struct Arguments{
+	TString first = "";
+	TString second = "";
+	TString uncertainty = "";
+	Double_t absolute = 0.;
+	Double_t relative = 0.;
+	Double_t factor = 1.;
+};
+
+static char doc[] = "Compare_histograms, compare histograms in the output files of Horst\n\nExits with a nonzero status if a bin of FILENAME_A:PATH_A and FILENAME_B:PATH_B differs by more than the tolerance. If the paths are directories, all histograms in them are compared.";
+static char args_doc[] = "FILENAME_A:PATH_A FILENAME_B:PATH_B";
+
+static struct argp_option options[] = {
+	{"absolute", 'a', "ABSOLUTE", 0, "Absolute tolerance of each bin (default: 0).", 0},
+	{"relative", 'r', "RELATIVE", 0, "Tolerance of each bin relative to the larger absolute value of both bins (default: 0).", 0},
+	{"uncertainty", 'u', "FILENAME:PATH", 0, "Histogram with the uncertainty of each bin, which is added to the tolerance (default: none).", 0},
+	{"factor", 'k', "FACTOR", 0, "Multiple of the uncertainty of the '-u' option which is added to the tolerance (default: 1).", 0},
+	{ 0, 0, 0, 0, 0, 0}
+};
+
+static int parse_opt(int key, char *arg, struct argp_state *state){
+	struct Arguments *arguments = (struct Arguments*) state->input;
+
+	switch (key){
+		case ARGP_KEY_ARG:
+			if(state->arg_num == 0){
+				arguments->first = arg;
+			} else if(state->arg_num == 1){
+				arguments->second = arg;
+			} else{
+				argp_usage(state);
+			}
+			break;
+		case 'a': arguments->absolute = atof(arg); break;
+		case 'r': arguments->relative = atof(arg); break;
+		case 'u': arguments->uncertainty = arg; break;
+		case 'k': arguments->factor = atof(arg); break;
+		case ARGP_KEY_END:
+			if(state->arg_num != 2){
+				argp_usage(state);
+			}
+			break;
+		default: return ARGP_ERR_UNKNOWN;
+	}
+	return 0;
+}
+
+static struct argp argp = { options, parse_opt, args_doc, doc, 0, 0, 0};
+
+// Open FILENAME of FILENAME:PATH and return the object at PATH, or the file itself if PATH is empty
+static TObject* getObject(const TString &location, TFile *&file){
+	const string name(location.Data());
+	const size_t separator = name.rfind(':');
+	const string filename = name.substr(0, separator);
+	const string path = separator == string::npos ? "" : name.substr(separator + 1);
+
+	file = new TFile(filename.c_str(), "READ");
+	if(file->IsZombie()){
+		cout << "Error: Could not open file " << filename << ". Aborting ..." << endl;
+		abort();
+	}
+	if(path.empty()){
+		return file;
+	}
+	TObject *object = file->Get(path.c_str());
+	if(object == nullptr){
+		cout << "Error: File " << filename << " does not contain '" << path << "'. Aborting ..." << endl;
+		abort();
+	}
+	return object;
+}
+
+// Return the number of bins which differ by more than the tolerance
+static UInt_t compareHistograms(const TH1 &first, const TH1 &second, const TH1 *uncertainty, const Arguments &arguments, const string &name){
+	if(first.GetNbinsX() != second.GetNbinsX() || (uncertainty != nullptr && uncertainty->GetNbinsX() != first.GetNbinsX())){
+		cout << "Error: The histograms '" << name << "' have different numbers of bins." << endl;
+		return 1;
+	}
+
+	UInt_t n_different = 0;
+	Double_t a = 0., b = 0., tolerance = 0.;
+	for(Int_t i = 0; i <= first.GetNbinsX() + 1; ++i){
+		a = first.GetBinContent(i);
+		b = second.GetBinContent(i);
+		tolerance = arguments.absolute + arguments.relative*(fabs(a) > fabs(b) ? fabs(a) : fabs(b));
+		if(uncertainty != nullptr){
+			tolerance += arguments.factor*uncertainty->GetBinContent(i);
+		}
+		if(fabs(a - b) > tolerance){
+			if(n_different < 10){
+				cout << "Error: Bin " << i << " of '" << name << "' is " << a << " and " << b << ", the tolerance is " << tolerance << "." << endl;
+			}
+			++n_different;
+		}
+	}
+	return n_different;
+}
+
+// Histograms and directories are compared, other objects are ignored.
+// Only the last cycle of each key is used.
+static Bool_t isCompared(TDirectory &directory, TKey &key){
+	TClass *object_class = TClass::GetClass(key.GetClassName());
+	if(object_class == nullptr || !(object_class->InheritsFrom(TDirectory::Class()) || object_class->InheritsFrom(TH1::Class()))){
+		return false;
+	}
+	return key.GetCycle() == directory.GetKey(key.GetName())->GetCycle();
+}
+
+static Int_t nCompared(TDirectory &directory){
+	Int_t n = 0;
+	TIter next(directory.GetListOfKeys());
+	TKey *key = nullptr;
+	while((key = (TKey*) next()) != nullptr){
+		n += isCompared(directory, *key) ? 1 : 0;
+	}
+	return n;
+}
+
+// Compare all histograms of the first directory and its subdirectories with the ones in the second
+static UInt_t compareDirectories(TDirectory &first, TDirectory &second, const TH1 *uncertainty, const Arguments &arguments, const string &path, UInt_t &n_histograms){
+	UInt_t n_different = 0;
+	TIter next(first.GetListOfKeys());
+	TKey *key = nullptr;
+	while((key = (TKey*) next()) != nullptr){
+		if(!isCompared(first, *key)){
+			continue;
+		}
+		const string name = path + key->GetName();
+		TObject *object = key->ReadObj();
+		TObject *other = second.Get(key->GetName());
+		if(other == nullptr || other->IsA() != object->IsA()){
+			cout << "Error: '" << name << "' is missing in " << arguments.second << "." << endl;
+			++n_different;
+		} else if(object->InheritsFrom(TDirectory::Class())){
+			n_different += compareDirectories(*(TDirectory*) object, *(TDirectory*) other, uncertainty, arguments, name + "/", n_histograms);
+		} else{
+			n_different += compareHistograms(*(TH1*) object, *(TH1*) other, uncertainty, arguments, name);
+			++n_histograms;
+		}
+		// Directories belong to their files
+		if(!object->InheritsFrom(TDirectory::Class())){
+			delete object;
+			delete other;
+		}
+	}
+	if(nCompared(first) != nCompared(second)){
+		cout << "Error: '" << path << "' contains " << nCompared(first) << " and " << nCompared(second) << " histograms and directories." << endl;
+		++n_different;
+	}
+	return n_different;
+}
+
+int main(int argc, char* argv[]){
+	Arguments arguments;
+	argp_parse(&argp, argc, argv, 0, 0, &arguments);
+
+	TH1::AddDirectory(kFALSE);
+
+	TFile *first_file = nullptr;
+	TFile *second_file = nullptr;
+	TFile *uncertainty_file = nullptr;
+	TObject *first = getObject(arguments.first, first_file);
+	TObject *second = getObject(arguments.second, second_file);
+	TH1 *uncertainty = nullptr;
+	if(arguments.uncertainty != ""){
+		uncertainty = dynamic_cast<TH1*>(getObject(arguments.uncertainty, uncertainty_file));
+		if(uncertainty == nullptr){
+			cout << "Error: " << arguments.uncertainty << " is not a histogram. Aborting ..." << endl;
+			abort();
+		}
+	}
+
+	UInt_t n_different = 0;
+	UInt_t n_histograms = 0;
+	if(first->InheritsFrom(TDirectory::Class()) && second->InheritsFrom(TDirectory::Class())){
+		n_different = compareDirectories(*(TDirectory*) first, *(TDirectory*) second, uncertainty, arguments, "", n_histograms);
+	} else if(first->InheritsFrom(TH1::Class()) && second->InheritsFrom(TH1::Class())){
+		n_different = compareHistograms(*(TH1*) first, *(TH1*) second, uncertainty, arguments, first->GetName());
+		n_histograms = 1;
+	} else{
+		cout << "Error: " << arguments.first << " and " << arguments.second << " are not both histograms or both directories. Aborting ..." << endl;
+		abort();
+	}
+
+	if(n_histograms == 0){
+		cout << "Error: " << arguments.first << " does not contain any histograms." << endl;
+		++n_different;
+	}
+	cout << "> Compared " << n_histograms << " histograms of " << arguments.first << " and " << arguments.second << ": " << (n_different == 0 ? "no" : "some") << " differences beyond the tolerance" << endl;
+
+	first_file->Close();
+	second_file->Close();
+	if(uncertainty_file != nullptr){
+		uncertainty_file->Close();
+	}
+
+	return n_different == 0 ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Check that the Cholesky factor of the normal equations, after appending and
+// removing parameters, solves the reduced normal equations G_PP x_P = h_P like
+// a direct Gaussian elimination.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <TH1.h>
+#include <TH2.h>
+#include <TROOT.h>
+
+#include "Cholesky.h"
+#include "NormalEquations.h"
+#include "PhiloxRandom.h"
+#include "ResponseMatrix.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const Int_t N_BINS = 40;
+const Double_t TOLERANCE = 1e-9;
+
+// Solve G_PP x_P = h_P with Gaussian elimination
+static void directSolve(const NormalEquations &normal_equations, const vector<UInt_t> &indices, vector<Double_t> &x){
+	const size_t p = indices.size();
+	vector<Double_t> A(p*(p + 1), 0.);
+	for(size_t r = 0; r < p; ++r){
+		for(size_t c = 0; c < p; ++c){
+			A[r*(p + 1) + c] = normal_equations.G(indices[r], indices[c]);
+		}
+		A[r*(p + 1) + p] = normal_equations.h(indices[r]);
+	}
+
+	for(size_t c = 0; c < p; ++c){
+		for(size_t r = c + 1; r < p; ++r){
+			const Double_t factor = A[r*(p + 1) + c]/A[c*(p + 1) + c];
+			for(size_t k = c; k <= p; ++k){
+				A[r*(p + 1) + k] -= factor*A[c*(p + 1) + k];
+			}
+		}
+	}
+	for(size_t r = p; r-- > 0;){
+		Double_t sum = A[r*(p + 1) + p];
+		for(size_t c = r + 1; c < p; ++c){
+			sum -= A[r*(p + 1) + c]*x[indices[c]];
+		}
+		x[indices[r]] = sum/A[r*(p + 1) + r];
+	}
+}
+
+static Int_t compare(const Cholesky &cholesky, const NormalEquations &normal_equations, const char *step){
+	vector<Double_t> x(normal_equations.size(), 0.);
+	vector<Double_t> x_direct(normal_equations.size(), 0.);
+	cholesky.solve(normal_equations.getRightHandSide(), x);
+	directSolve(normal_equations, cholesky.getIndices(), x_direct);
+
+	for(auto a: cholesky.getIndices()){
+		if(fabs(x[a] - x_direct[a]) > TOLERANCE*(1. + fabs(x_direct[a]))){
+			cout << "Error: After " << step << ", parameter " << a << " is " << x[a] << " instead of " << x_direct[a] << "." << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(){
+	Int_t n_failures = 0;
+
+	// Response matrix with a photopeak and a random continuum
+	PhiloxRandom random(1, 0);
+	TH2F response_matrix_histogram("rema", "rema", N_BINS, 0., (Double_t) N_BINS, N_BINS, 0., (Double_t) N_BINS);
+	TH1F spectrum("spectrum", "spectrum", N_BINS, 0., (Double_t) N_BINS);
+	for(Int_t i = 1; i <= N_BINS; ++i){
+		response_matrix_histogram.SetBinContent(i, i, 0.5 + random.Uniform());
+		for(Int_t j = 1; j < i; ++j){
+			response_matrix_histogram.SetBinContent(i, j, 0.1*random.Uniform());
+		}
+		spectrum.SetBinContent(i, 1. + 100.*random.Uniform());
+	}
+	const ResponseMatrix response_matrix(response_matrix_histogram);
+	const NormalEquations normal_equations(response_matrix, spectrum, 1, N_BINS + 1);
+
+	Cholesky cholesky(normal_equations);
+	vector<UInt_t> even;
+	for(UInt_t a = 0; a < normal_equations.size(); a += 2){
+		even.push_back(a);
+	}
+	if(!cholesky.factorize(even)){
+		cout << "Error: Factorization failed." << endl;
+		return 1;
+	}
+	n_failures += compare(cholesky, normal_equations, "factorization");
+
+	for(UInt_t a = 1; a < normal_equations.size(); a += 2){
+		if(!cholesky.append(a)){
+			cout << "Error: Appending parameter " << a << " failed." << endl;
+			return 1;
+		}
+	}
+	n_failures += compare(cholesky, normal_equations, "appending");
+
+	// Remove parameters from the beginning, the middle and the end of the factor
+	for(auto a: {0u, 17u, 20u, 39u, 1u}){
+		cholesky.remove(a);
+		n_failures += compare(cholesky, normal_equations, "removing");
+	}
+
+	cholesky.append(17);
+	n_failures += compare(cholesky, normal_equations, "appending a removed parameter");
+
+	return n_failures == 0 ? 0 : 1;
+}
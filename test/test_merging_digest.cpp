@@ -0,0 +1,96 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Check the quantiles of the MergingDigest against the exact quantiles of the
+// samples, both for a single digest and for merged and restored digests.
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <TROOT.h>
+
+#include "MergingDigest.h"
+#include "PhiloxRandom.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const UInt_t N_SAMPLES = 100000;
+const UInt_t N_PARTS = 7;
+// Maximum deviation of the rank of a quantile, as a fraction of the samples
+const Double_t RANK_TOLERANCE = 0.005;
+
+static Int_t compare(const MergingDigest &digest, const vector<Double_t> &sorted, const char *name){
+	Int_t n_failures = 0;
+	if(digest.getWeight() != (Double_t) sorted.size()){
+		cout << "Error: The " << name << " digest has the weight " << digest.getWeight() << " instead of " << sorted.size() << "." << endl;
+		++n_failures;
+	}
+	for(auto q: {0.001, 0.01, 0.16, 0.5, 0.84, 0.99, 0.999}){
+		const Double_t quantile = digest.quantile(q);
+		const Double_t rank = (Double_t) (std::lower_bound(sorted.begin(), sorted.end(), quantile) - sorted.begin())/(Double_t) sorted.size();
+		if(fabs(rank - q) > RANK_TOLERANCE){
+			cout << "Error: The " << q << " quantile of the " << name << " digest is " << quantile << ", which is the " << rank << " quantile of the samples." << endl;
+			++n_failures;
+		}
+	}
+	if(digest.quantile(0.) != sorted.front() || digest.quantile(1.) != sorted.back()){
+		cout << "Error: The extreme quantiles of the " << name << " digest are not the minimum and the maximum." << endl;
+		++n_failures;
+	}
+	return n_failures;
+}
+
+int main(){
+	Int_t n_failures = 0;
+
+	// Skewed distribution, like the MC distribution of a bin with few counts
+	PhiloxRandom random(4, 0);
+	vector<Double_t> samples(N_SAMPLES, 0.);
+	for(auto &x: samples){
+		x = -log(random.Uniform());
+	}
+
+	MergingDigest sequential;
+	vector<MergingDigest> parts(N_PARTS);
+	for(UInt_t s = 0; s < N_SAMPLES; ++s){
+		sequential.add(samples[s]);
+		parts[(s*s) % N_PARTS].add(samples[s]);
+	}
+	for(UInt_t k = 1; k < N_PARTS; ++k){
+		parts[0].merge(parts[k]);
+	}
+
+	vector<Double_t> state;
+	sequential.appendState(state);
+	MergingDigest restored;
+	if(restored.restoreState(state, 0) != state.size()){
+		cout << "Error: The state of the digest was not read completely." << endl;
+		++n_failures;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	n_failures += compare(sequential, samples, "sequential");
+	n_failures += compare(parts[0], samples, "merged");
+	n_failures += compare(restored, samples, "restored");
+
+	return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Check the Karush-Kuhn-Tucker conditions of the NNLS solution of the normal
+// equations: with the negative half gradient w = h - G x, free parameters
+// (x > 0) have w = 0, and parameters at the bound (x = 0) have w <= 0.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <TH1.h>
+#include <TH2.h>
+#include <TROOT.h>
+
+#include "NNLSSolver.h"
+#include "NormalEquations.h"
+#include "PhiloxRandom.h"
+#include "ResponseMatrix.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const Int_t N_BINS = 60;
+const Double_t TOLERANCE = 1e-8;
+
+// Returns the number of violated conditions and counts the parameters at the bound
+static Int_t checkSolution(const NormalEquations &normal_equations, const vector<Double_t> &rhs, const vector<Double_t> &x, UInt_t &n_bound){
+	const UInt_t n = normal_equations.size();
+	Int_t n_failures = 0;
+
+	Double_t scale = 0.;
+	for(UInt_t a = 0; a < n; ++a){
+		scale = fabs(rhs[a]) > scale ? fabs(rhs[a]) : scale;
+	}
+
+	n_bound = 0;
+	Double_t w = 0.;
+	for(UInt_t a = 0; a < n; ++a){
+		w = rhs[a];
+		for(UInt_t b = 0; b < n; ++b){
+			w -= normal_equations.G(a, b)*x[b];
+		}
+
+		if(x[a] < 0.){
+			cout << "Error: Parameter " << a << " is negative (" << x[a] << ")." << endl;
+			++n_failures;
+		} else if(x[a] > 0. && fabs(w) > TOLERANCE*scale){
+			cout << "Error: Free parameter " << a << " has the gradient " << w << "." << endl;
+			++n_failures;
+		} else if(x[a] == 0.){
+			++n_bound;
+			if(w > TOLERANCE*scale){
+				cout << "Error: Parameter " << a << " at the bound has the gradient " << w << ", which points into the feasible region." << endl;
+				++n_failures;
+			}
+		}
+	}
+
+	return n_failures;
+}
+
+int main(){
+	Int_t n_failures = 0;
+
+	// A strong continuum makes the unconstrained solution negative in some bins
+	PhiloxRandom random(2, 0);
+	TH2F response_matrix_histogram("rema", "rema", N_BINS, 0., (Double_t) N_BINS, N_BINS, 0., (Double_t) N_BINS);
+	TH1F spectrum("spectrum", "spectrum", N_BINS, 0., (Double_t) N_BINS);
+	for(Int_t i = 1; i <= N_BINS; ++i){
+		response_matrix_histogram.SetBinContent(i, i, 0.2 + random.Uniform());
+		for(Int_t j = 1; j < i; ++j){
+			response_matrix_histogram.SetBinContent(i, j, 0.5*random.Uniform());
+		}
+		spectrum.SetBinContent(i, 1. + 100.*random.Uniform());
+	}
+	const ResponseMatrix response_matrix(response_matrix_histogram);
+	const NormalEquations normal_equations(response_matrix, spectrum, 1, N_BINS + 1);
+	const UInt_t n = normal_equations.size();
+
+	vector<Double_t> x(n, 1.);
+	NNLSSolver nnls(normal_equations);
+	nnls.solve(x);
+
+	UInt_t n_bound = 0;
+	n_failures += checkSolution(normal_equations, normal_equations.getRightHandSide(), x, n_bound);
+	if(n_bound == 0){
+		cout << "Error: No parameter is at the bound, so the test does not check the constraints." << endl;
+		++n_failures;
+	}
+
+	// A different right-hand side with the same G, started from the previous solution
+	vector<Double_t> rhs(normal_equations.getRightHandSide());
+	for(UInt_t a = 0; a < n; ++a){
+		rhs[a] *= 0.5 + random.Uniform();
+	}
+	nnls.solve(rhs, x);
+	n_failures += checkSolution(normal_equations, rhs, x, n_bound);
+
+	return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,74 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Compare PhiloxRandom to the known-answer vector of Philox4x32-10 from the
+// Random123 library, and check that the streams are reproducible and distinct.
+
+#include <iostream>
+
+#include <TROOT.h>
+
+#include "PhiloxRandom.h"
+
+using std::cout;
+using std::endl;
+
+// Uniform() combines the upper 27 bits of the first and the upper 26 bits of the second number
+static Double_t expectedUniform(const ULong64_t first, const ULong64_t second){
+	return ((Double_t) (((first >> 5) << 26) | (second >> 6)) + 0.5)/9007199254740992.; // 2^53
+}
+
+int main(){
+	Int_t n_failures = 0;
+
+	// Philox4x32-10 of counter {0, 0, 0, 0} and key {0, 0}
+	PhiloxRandom zero(0, 0);
+	const Double_t expected[2] = {expectedUniform(0x6627e8d5, 0xe169c58d), expectedUniform(0xbc57ac4c, 0x9b00dbd8)};
+	for(UInt_t k = 0; k < 2; ++k){
+		const Double_t uniform = zero.Uniform();
+		if(uniform != expected[k]){
+			cout << "Error: Uniform number " << k << " of the known-answer test is " << uniform << " instead of " << expected[k] << "." << endl;
+			++n_failures;
+		}
+	}
+
+	// The same seed, iteration and stream give the same numbers, any other one different numbers
+	PhiloxRandom reference(1, 2, 3, 4);
+	PhiloxRandom same(1, 2, 3, 4);
+	PhiloxRandom others[4] = {PhiloxRandom(5, 2, 3, 4), PhiloxRandom(1, 5, 3, 4), PhiloxRandom(1, 2, 5, 4), PhiloxRandom(1, 2, 3, 5)};
+	Double_t uniform = 0.;
+	for(UInt_t k = 0; k < 1000; ++k){
+		uniform = reference.Uniform();
+		if(uniform <= 0. || uniform >= 1.){
+			cout << "Error: Uniform number " << uniform << " is outside of (0, 1)." << endl;
+			++n_failures;
+		}
+		if(same.Uniform() != uniform){
+			cout << "Error: Uniform number " << k << " is not reproducible." << endl;
+			++n_failures;
+		}
+		for(auto &other: others){
+			if(other.Uniform() == uniform){
+				cout << "Error: Uniform number " << k << " is equal in different streams." << endl;
+				++n_failures;
+			}
+		}
+	}
+
+	return n_failures == 0 ? 0 : 1;
+}
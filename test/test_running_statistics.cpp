@@ -0,0 +1,150 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Check that RunningStatistics and RunningCovariance give the same moments
+// when the samples are accumulated in one sequence, in merged parts, or
+// restored from a saved state, and that they agree with a two-pass calculation.
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <TROOT.h>
+
+#include "PhiloxRandom.h"
+#include "RunningCovariance.h"
+#include "RunningStatistics.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const Int_t FIRST_BIN = 3;
+const Int_t LAST_BIN = 12;
+const UInt_t N_SAMPLES = 1000;
+const UInt_t N_PARTS = 3;
+const Double_t TOLERANCE = 1e-10;
+
+static Int_t compare(const Double_t value, const Double_t expected, const char *quantity, const Int_t bin){
+	if(fabs(value - expected) > TOLERANCE*(1. + fabs(expected))){
+		cout << "Error: " << quantity << " of bin " << bin << " is " << value << " instead of " << expected << "." << endl;
+		return 1;
+	}
+	return 0;
+}
+
+int main(){
+	Int_t n_failures = 0;
+
+	// Samples with bin-dependent offsets and correlations between neighbouring bins
+	PhiloxRandom random(3, 0);
+	vector<vector<Double_t> > samples(N_SAMPLES, vector<Double_t>((size_t) LAST_BIN + 1, 0.));
+	for(auto &sample: samples){
+		Double_t previous = 0.;
+		for(Int_t bin = FIRST_BIN; bin <= LAST_BIN; ++bin){
+			const Double_t x = 1e3*(Double_t) bin + random.Uniform()*random.Uniform();
+			sample[(size_t) bin] = x + 0.5*previous;
+			previous = x - 1e3*(Double_t) bin;
+		}
+	}
+
+	RunningStatistics sequential(FIRST_BIN, LAST_BIN);
+	RunningCovariance sequential_covariance(FIRST_BIN, LAST_BIN);
+	for(auto &sample: samples){
+		sequential.add(sample.data());
+		sequential_covariance.add(sample.data());
+	}
+	sequential_covariance.finish();
+
+	// Unequal parts, which are merged in order
+	vector<RunningStatistics> parts(N_PARTS, RunningStatistics(FIRST_BIN, LAST_BIN));
+	vector<RunningCovariance*> covariance_parts;
+	for(UInt_t k = 0; k < N_PARTS; ++k){
+		covariance_parts.push_back(new RunningCovariance(FIRST_BIN, LAST_BIN));
+	}
+	for(UInt_t s = 0; s < N_SAMPLES; ++s){
+		const UInt_t k = s < N_SAMPLES/10 ? 0 : (s < N_SAMPLES/2 ? 1 : 2);
+		parts[k].add(samples[s].data());
+		covariance_parts[k]->add(samples[s].data());
+	}
+	for(UInt_t k = 0; k < N_PARTS; ++k){
+		covariance_parts[k]->finish();
+	}
+	for(UInt_t k = 1; k < N_PARTS; ++k){
+		parts[0].merge(parts[k]);
+		covariance_parts[0]->merge(*covariance_parts[k]);
+	}
+	const RunningStatistics *merged = &parts[0];
+
+	vector<Double_t> state;
+	sequential.getState(state);
+	const RunningStatistics restored(state);
+	sequential_covariance.getState(state);
+	const RunningCovariance restored_covariance(state);
+
+	if(merged->getNSamples() != N_SAMPLES || restored.getNSamples() != N_SAMPLES || covariance_parts[0]->getNSamples() != N_SAMPLES || restored_covariance.getNSamples() != N_SAMPLES){
+		cout << "Error: Wrong number of samples." << endl;
+		++n_failures;
+	}
+
+	for(Int_t bin = FIRST_BIN; bin <= LAST_BIN; ++bin){
+		Double_t mean = 0.;
+		for(auto &sample: samples){
+			mean += sample[(size_t) bin];
+		}
+		mean /= (Double_t) N_SAMPLES;
+		Double_t variance = 0.;
+		for(auto &sample: samples){
+			variance += (sample[(size_t) bin] - mean)*(sample[(size_t) bin] - mean);
+		}
+		variance /= (Double_t) N_SAMPLES;
+
+		n_failures += compare(sequential.mean(bin), mean, "Mean", bin);
+		n_failures += compare(sequential.variance(bin), variance, "Variance", bin);
+		for(const RunningStatistics *statistics: {merged, &restored}){
+			n_failures += compare(statistics->mean(bin), sequential.mean(bin), "Merged mean", bin);
+			n_failures += compare(statistics->variance(bin), sequential.variance(bin), "Merged variance", bin);
+			n_failures += compare(statistics->standardDeviationError(bin), sequential.standardDeviationError(bin), "Merged uncertainty of the standard deviation", bin);
+			n_failures += compare(statistics->minimum(bin), sequential.minimum(bin), "Merged minimum", bin);
+			n_failures += compare(statistics->maximum(bin), sequential.maximum(bin), "Merged maximum", bin);
+		}
+
+		for(Int_t other_bin = FIRST_BIN; other_bin <= bin; ++other_bin){
+			Double_t other_mean = 0.;
+			for(auto &sample: samples){
+				other_mean += sample[(size_t) other_bin];
+			}
+			other_mean /= (Double_t) N_SAMPLES;
+			Double_t covariance = 0.;
+			for(auto &sample: samples){
+				covariance += (sample[(size_t) bin] - mean)*(sample[(size_t) other_bin] - other_mean);
+			}
+			covariance /= (Double_t) N_SAMPLES;
+
+			n_failures += compare(sequential_covariance.covariance(bin, other_bin), covariance, "Covariance", bin);
+			n_failures += compare(covariance_parts[0]->covariance(other_bin, bin), covariance, "Merged covariance", bin);
+			n_failures += compare(restored_covariance.covariance(bin, other_bin), covariance, "Restored covariance", bin);
+		}
+	}
+
+	for(auto covariance: covariance_parts){
+		delete covariance;
+	}
+
+	return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,63 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Check that the scrambled Sobol points are stratified: the first 2^m points
+// of each dimension, and of each pair of dimensions (2k, 2k + 1), fill every
+// elementary interval of volume 2^-m with exactly one point.
+
+#include <iostream>
+#include <vector>
+
+#include <TROOT.h>
+
+#include "SobolSequence.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+const UInt_t LOG_N_POINTS = 10;
+const UInt_t N_POINTS = 1 << LOG_N_POINTS;
+const UInt_t N_DIMENSIONS = 6;
+
+int main(){
+	Int_t n_failures = 0;
+
+	SobolSequence sobol(1, 2, 3);
+	vector<UInt_t> counts(N_POINTS, 0);
+	for(UInt_t dimension = 0; dimension < N_DIMENSIONS; dimension += 2){
+		// Elementary intervals [a/2^r, (a + 1)/2^r) x [b/2^(m - r), (b + 1)/2^(m - r))
+		for(UInt_t r = 0; r <= LOG_N_POINTS; ++r){
+			counts.assign(N_POINTS, 0);
+			for(UInt_t index = 0; index < N_POINTS; ++index){
+				const UInt_t a = (UInt_t) (sobol.Uniform(index, dimension, 0.)*(Double_t) (1u << r));
+				const UInt_t b = (UInt_t) (sobol.Uniform(index, dimension + 1, 0.)*(Double_t) (1u << (LOG_N_POINTS - r)));
+				++counts[(a << (LOG_N_POINTS - r)) + b];
+			}
+			for(UInt_t k = 0; k < N_POINTS; ++k){
+				if(counts[k] != 1){
+					cout << "Error: Elementary interval " << k << " of size 2^-" << r << " x 2^-" << LOG_N_POINTS - r << " in dimensions " << dimension << " and " << dimension + 1 << " contains " << counts[k] << " points." << endl;
+					++n_failures;
+					break;
+				}
+			}
+		}
+	}
+
+	return n_failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,122 @@
+/*
+    This file is part of Horst.
+
+    Horst is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Horst is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Horst.  If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+// Compare the triangular products of the selected column kernels to plain
+// loops over the response matrix. The test is run once for each value of the
+// environment variable HORST_SIMD, so that the scalar and the SIMD kernels
+// give the same results within the rounding errors.
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <TH2.h>
+#include <TROOT.h>
+
+#include "PhiloxRandom.h"
+#include "ResponseMatrix.h"
+#include "ThreadPool.h"
+#include "TriangularKernels.h"
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+// Not a multiple of the SIMD width, so that the remainder loops are tested too
+const Int_t N_BINS = 1037;
+const Int_t FIRST_BIN = 5;
+const Int_t LAST_BIN = 1031;
+const Double_t TOLERANCE = 1e-12;
+
+static Int_t compare(const vector<Double_t> &result, const vector<Double_t> &expected, const char *product){
+	for(Int_t bin = FIRST_BIN; bin <= LAST_BIN; ++bin){
+		if(fabs(result[(size_t) bin] - expected[(size_t) bin]) > TOLERANCE*(1. + fabs(expected[(size_t) bin]))){
+			cout << "Error: Bin " << bin << " of the " << product << " product with the " << TriangularKernels::instructionSet() << " kernels is " << result[(size_t) bin] << " instead of " << expected[(size_t) bin] << "." << endl;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[]){
+	Int_t n_failures = 0;
+
+	// Optional number of threads
+	ThreadPool::setDefaultSize(argc > 1 ? (UInt_t) atoi(argv[1]) : 4);
+	cout << "Testing the " << TriangularKernels::instructionSet() << " kernels with " << ThreadPool::instance().size() << " threads." << endl;
+
+	PhiloxRandom random(5, 0);
+	TH2F response_matrix_histogram("rema", "rema", N_BINS, 0., (Double_t) N_BINS, N_BINS, 0., (Double_t) N_BINS);
+	for(Int_t i = 1; i <= N_BINS; ++i){
+		for(Int_t j = 1; j <= i; ++j){
+			response_matrix_histogram.SetBinContent(i, j, random.Uniform());
+		}
+	}
+	const ResponseMatrix rema(response_matrix_histogram);
+
+	vector<Double_t> p((size_t) N_BINS + 1, 0.);
+	vector<Double_t> w((size_t) N_BINS + 1, 0.);
+	for(Int_t bin = 1; bin <= N_BINS; ++bin){
+		p[(size_t) bin] = 100.*random.Uniform() - 10.;
+		w[(size_t) bin] = random.Uniform();
+	}
+
+	// The element R(i, j) as it is stored, i.e. rounded to single precision
+	auto element = [&rema](const Int_t i, const Int_t j){ return (Double_t) rema.column(j)[i - j]; };
+
+	vector<Double_t> expected((size_t) N_BINS + 1, 0.);
+	vector<Double_t> expected_squared((size_t) N_BINS + 1, 0.);
+	vector<Double_t> expected_simulation((size_t) N_BINS + 1, 0.);
+	vector<Double_t> expected_spectrum((size_t) N_BINS + 1, 0.);
+	for(Int_t j = FIRST_BIN; j <= LAST_BIN; ++j){
+		for(Int_t i = j; i <= LAST_BIN; ++i){
+			expected[(size_t) j] += element(i, j)*p[(size_t) i];
+			expected_squared[(size_t) j] += element(i, j)*element(i, j)*p[(size_t) i];
+			expected_spectrum[(size_t) j] += element(i, j)*element(i, j)*w[(size_t) i];
+			if(i > j){
+				expected_simulation[(size_t) j] += element(i, j)*p[(size_t) i];
+			}
+		}
+	}
+
+	vector<Double_t> result((size_t) N_BINS + 1, 0.);
+	vector<Double_t> spectrum((size_t) N_BINS + 1, 0.);
+	TriangularKernels::forward(rema, p.data(), result.data(), FIRST_BIN, LAST_BIN);
+	n_failures += compare(result, expected, "forward");
+	TriangularKernels::forwardSquared(rema, p.data(), result.data(), FIRST_BIN, LAST_BIN);
+	n_failures += compare(result, expected_squared, "squared forward");
+	TriangularKernels::forwardUncertainty(rema, p.data(), w.data(), result.data(), spectrum.data(), FIRST_BIN, LAST_BIN);
+	n_failures += compare(result, expected_simulation, "simulation uncertainty");
+	n_failures += compare(spectrum, expected_spectrum, "spectrum uncertainty");
+
+	expected.assign((size_t) N_BINS + 1, 0.);
+	expected_squared.assign((size_t) N_BINS + 1, 0.);
+	for(Int_t i = FIRST_BIN; i <= LAST_BIN; ++i){
+		for(Int_t j = FIRST_BIN; j <= i; ++j){
+			expected[(size_t) i] += element(i, j)*p[(size_t) j];
+			expected_squared[(size_t) i] += element(i, j)*element(i, j)*p[(size_t) j];
+		}
+	}
+	TriangularKernels::adjoint(rema, p.data(), result.data(), FIRST_BIN, LAST_BIN);
+	n_failures += compare(result, expected, "adjoint");
+	TriangularKernels::adjointSquared(rema, p.data(), result.data(), FIRST_BIN, LAST_BIN);
+	n_failures += compare(result, expected_squared, "squared adjoint");
+
+	return n_failures == 0 ? 0 : 1;
+}